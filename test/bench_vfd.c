@@ -0,0 +1,236 @@
+/*
+
+  test/bench_vfd.c - latency benchmark for the VFD drivers on a simulated RS485 bus
+
+  Part of grblHAL
+
+  Copyright (c) 2026 Terje Io
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+ * Runs a scripted M3/S/M5 sequence for each scenario and reports, per command, the latency from the
+ * command to the VFD receiving it and the time until the VFD and the core respectively are at speed.
+ * Bus utilisation and round trip times per function code are reported for the whole sequence.
+ *
+ * Run bench_vfd from the build directory to see the report, ctest only checks that the scenarios
+ * behave as expected: commands reach the VFD and the spindle gets to speed, or an alarm is raised.
+ */
+
+// SPINDLE_HOST_TEST is defined on the command line by test/CMakeLists.txt only.
+#if SPINDLE_HOST_TEST
+
+#include "test.h"
+#include "mock.h"
+#include "sim/vfd_sim.h"
+#include "vfd/spindle.h"
+
+#define STEP_TIMEOUT 10000  // ms
+
+typedef struct {
+    const char *name;
+    vfd_sim_type_t type;
+    spindle_id_t spindle_id;            // driver registration order in vfd_init()
+    void (*setup)(vfd_sim_t *vfd);      // called when the spindle is ready, before the script is run
+    bool fails;                         // an alarm is expected
+} scenario_t;
+
+typedef struct {
+    const char *name;
+    spindle_state_t state;
+    float rpm;
+} step_t;
+
+static const step_t script[] = {
+    { "M3 S12000", { .on = On }, 12000.0f },
+    { "S18000",    { .on = On }, 18000.0f },
+    { "S6000",     { .on = On }, 6000.0f },
+    { "M4 S6000",  { .on = On, .ccw = On }, 6000.0f },
+    { "M5",        {0}, 0.0f }
+};
+
+static void silence_10ms (vfd_sim_t *vfd)
+{
+    vfd->config.silence_us = 10000;
+}
+
+static void baud_9600 (vfd_sim_t *vfd)
+{
+    vfd->config.baud = 9600;
+}
+
+static void turnaround_20ms (vfd_sim_t *vfd)
+{
+    vfd->config.turnaround_us = 20000;
+}
+
+static void bus_38400 (vfd_sim_t *vfd)
+{
+    vfd->config.baud = 38400;
+    CHECK(settings_store_setting(Setting_ModBus_BaudRate, "4") == Status_OK);
+}
+
+static void vfdbaud_38400 (vfd_sim_t *vfd)
+{
+    CHECK(mock_command("$VFDBAUD=38400") == Status_OK);
+    CHECK(vfd->config.baud == 38400 && mock_modbus_baud() == 38400);
+}
+
+static void telemetry_exceptions (vfd_sim_t *vfd)
+{
+    vfd_sim_inject(vfd, ModBus_ReadHoldingRegisters, 6, 3);
+}
+
+static void command_exception (vfd_sim_t *vfd)
+{
+    vfd_sim_inject(vfd, ModBus_WriteRegisters, 4, 1);
+}
+
+static void predictive_at_speed (vfd_sim_t *vfd)
+{
+    vfd_config.options.at_speed_predict = On;
+}
+
+static const scenario_t scenarios[] = {
+    { "Huanyang v1",                           VFDSim_Huanyang,     1, NULL },
+    { "Huanyang P2A",                          VFDSim_HuanyangP2A,  2, NULL },
+    { "Durapulse GS20",                        VFDSim_GS20,         3, NULL },
+    { "Yalang YL620",                          VFDSim_YL620,        4, NULL },
+    { "MODVFD",                                VFDSim_MODVFD,       5, NULL },
+    { "H-100",                                 VFDSim_H100,         6, NULL },
+    { "Nowforever",                            VFDSim_Nowforever,   7, NULL },
+    { "Durapulse GS20, 38400 baud",            VFDSim_GS20,         3, bus_38400 },
+    { "Durapulse GS20, 20 ms turnaround",      VFDSim_GS20,         3, turnaround_20ms },
+    { "Durapulse GS20, predictive at speed",   VFDSim_GS20,         3, predictive_at_speed },
+    { "Durapulse GS20, telemetry exceptions",  VFDSim_GS20,         3, telemetry_exceptions },
+    { "Yalang YL620, $VFDBAUD=38400",          VFDSim_YL620,        4, vfdbaud_38400 },
+    { "Huanyang v1, $VFDBAUD=38400",           VFDSim_Huanyang,     1, vfdbaud_38400 },
+    { "Durapulse GS20, command exception",     VFDSim_GS20,         3, command_exception, true },
+    { "Huanyang v1, 10 ms silence required",   VFDSim_Huanyang,     1, silence_10ms },
+    { "Durapulse GS20, VFD at 9600 baud",      VFDSim_GS20,         3, baud_9600, true }
+};
+
+static const scenario_t *scenario;
+
+static void report_time (uint64_t us)
+{
+    if(us)
+        printf(" %9.1f", (float)us / 1000.0f);
+    else
+        printf("         -");
+}
+
+// Runs a script step, returns false if the command did not reach the VFD.
+static bool step_run (vfd_sim_t *vfd, const step_t *step, const step_t *previous)
+{
+    bool control = step->state.on != previous->state.on || (step->state.on && step->state.ccw != previous->state.ccw),
+         speed = step->state.on && step->rpm != previous->rpm;
+    uint32_t ms = 0;
+    uint64_t t0 = mock_time_us(), latency = 0, vfd_at_speed = 0, at_speed = 0;
+    spindle_ptrs_t *spindle = spindle_get(0);
+
+    mock_spindle_set_state(step->state, step->rpm);
+
+    while(ms++ < STEP_TIMEOUT && !(latency && vfd_at_speed && (at_speed || !step->state.on)) && mock_alarm() == Alarm_None) {
+
+        mock_run(1);
+
+        if(!latency && (!control || vfd->control_us > t0) && (!speed || vfd->frequency_us > t0))
+            latency = max(control ? vfd->control_us : 0, speed ? vfd->frequency_us : 0) - t0;
+
+        if(latency && !vfd_at_speed && vfd_sim_at_speed(vfd))
+            vfd_at_speed = mock_time_us() - t0;
+
+        if(latency && !at_speed && step->state.on && spindle->get_state(spindle).at_speed)
+            at_speed = mock_time_us() - t0;
+    }
+
+    printf("  %-10s", step->name);
+    report_time(latency);
+    report_time(vfd_at_speed);
+    report_time(at_speed);
+    printf("\n");
+
+    if(!scenario->fails) {
+        CHECK(latency > 0);
+        CHECK(vfd_at_speed > 0);
+        CHECK(at_speed > 0 || !step->state.on);
+    }
+
+    return latency > 0;
+}
+
+static void bench (void)
+{
+    uint_fast8_t idx;
+    uint32_t frames;
+    uint64_t t0, busy_us;
+    vfd_sim_t vfd;
+    const vfd_sim_round_trip_t *round_trip;
+    const step_t stopped = {0};
+
+    vfd_sim_init(&vfd, scenario->type, 1);
+    vfd_sim_attach(&vfd);
+    mock_init(scenario->spindle_id);
+
+    settings.spindle.at_speed_tolerance = 5.0f;
+    hal.settings_changed(&settings, (settings_changed_flags_t){ .spindle = On });
+    mock_run(100);
+
+    CHECK(spindle_get(0)->id == scenario->spindle_id);
+
+    if(scenario->setup)
+        scenario->setup(&vfd);
+
+    printf("%s: %lu baud, %.1f ms turnaround, %.1f ms silence", scenario->name, (unsigned long)mock_modbus_baud(),
+            (float)vfd.config.turnaround_us / 1000.0f, (float)mock_modbus_silence());
+    if(vfd.config.silence_us)
+        printf(", %.1f ms required by VFD", (float)vfd.config.silence_us / 1000.0f);
+    printf("\n");
+    printf("  command     latency  VFD at speed  at speed (ms)\n");
+
+    t0 = mock_time_us();
+    frames = mock_modbus_stats()->frames;
+    busy_us = mock_modbus_stats()->busy_us;
+
+    for(idx = 0; idx < sizeof(script) / sizeof(step_t); idx++) {
+        if(!step_run(&vfd, &script[idx], idx ? &script[idx - 1] : &stopped))
+            break;
+    }
+
+    printf("  frames %lu, bus utilisation %.1f%%, timeouts %lu, exceptions %lu, not seen by VFD %lu\n",
+            (unsigned long)(mock_modbus_stats()->frames - frames), 100.0f * (float)(mock_modbus_stats()->busy_us - busy_us) / (float)(mock_time_us() - t0),
+            (unsigned long)mock_modbus_stats()->timeouts, (unsigned long)mock_modbus_stats()->exceptions, (unsigned long)vfd.ignored);
+
+    for(idx = ModBus_ReadCoils; idx <= ModBus_WriteRegisters; idx++) {
+        if((round_trip = vfd_sim_round_trip(idx))->n)
+            printf("  function 0x%02X n %4lu, round trip avg %5.1f ms, max %5.1f ms\n", (unsigned int)idx, (unsigned long)round_trip->n, (float)round_trip->sum_us / (float)round_trip->n / 1000.0f, (float)round_trip->max_us / 1000.0f);
+    }
+
+    printf("\n");
+
+    CHECK((mock_alarm() != Alarm_None) == scenario->fails);
+}
+
+int main (void)
+{
+    for(scenario = scenarios; scenario < scenarios + sizeof(scenarios) / sizeof(scenario_t); scenario++)
+        test_run(scenario->name, bench);
+
+    return test_result();
+}
+
+#endif // SPINDLE_HOST_TEST
@@ -0,0 +1,57 @@
+/*
+
+  test/mock/driver.h - mock driver for host builds of the spindle plugins
+
+  Part of grblHAL
+
+  Copyright (c) 2026 Terje Io
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// Plugin configuration is set on the command line by test/CMakeLists.txt, defaults are for the VFD plugin.
+
+#ifndef _DRIVER_H_
+#define _DRIVER_H_
+
+#ifndef N_AXIS
+#define N_AXIS 4
+#endif
+
+#ifndef N_SPINDLE
+#define N_SPINDLE 8
+#endif
+
+#ifndef MODBUS_MAX_ADU_SIZE
+#define MODBUS_MAX_ADU_SIZE 16
+#endif
+
+#include "grbl/hal.h"
+
+#ifndef SPINDLE_ENABLE
+#define SPINDLE_ENABLE SPINDLE_ALL
+#endif
+
+#ifndef SPINDLE_OFFSET
+#define SPINDLE_OFFSET 0
+#endif
+
+#if SPINDLE_ENABLE & SPINDLE_ALL_VFD
+#define VFD_ENABLE 1
+#else
+#define VFD_ENABLE 0
+#endif
+
+#endif // _DRIVER_H_
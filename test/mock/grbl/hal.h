@@ -0,0 +1,904 @@
+/*
+
+  test/mock/grbl/hal.h - minimal mock of the grblHAL core API used by the spindle plugins
+
+  Part of grblHAL
+
+  Copyright (c) 2026 Terje Io
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+ * Only the types, fields and functions referenced by the plugins are provided, names and signatures
+ * follow the core. The other grbl/ headers include this file. The implementation is in mock.c,
+ * functions for driving it from tests are declared in mock.h.
+ */
+
+#ifndef _MOCK_HAL_H_
+#define _MOCK_HAL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// grbl/config.h
+
+#ifndef N_AXIS
+#define N_AXIS 3
+#endif
+#ifndef N_SPINDLE
+#define N_SPINDLE 1
+#endif
+#ifndef N_SYS_SPINDLE
+#define N_SYS_SPINDLE 1
+#endif
+#ifndef N_SPINDLE_SELECTABLE
+#define N_SPINDLE_SELECTABLE 4
+#endif
+#ifndef MODBUS_MAX_ADU_SIZE
+#define MODBUS_MAX_ADU_SIZE 16
+#endif
+#define N_SPINDLE_SETTINGS 8
+
+// grbl/gcode.h, grbl/system.h
+
+#define On 1
+#define Off 0
+#define PROGMEM
+#define ASCII_EOL "\r\n"
+#define UNUSED(x) (void)(x)
+#define bit(n) (1UL << (n))
+#ifndef min
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+#ifndef max
+#define max(a, b) (((a) > (b)) ? (a) : (b))
+#endif
+#define isintf(x) (truncf(x) == (x))
+
+#define CMD_FEED_HOLD '!'
+#define CMD_OVERRIDE_FEED_FINE_PLUS 0x93
+#define CMD_OVERRIDE_FEED_FINE_MINUS 0x94
+
+#define STATE_IDLE        0
+#define STATE_ALARM       bit(0)
+#define STATE_CHECK_MODE  bit(1)
+#define STATE_HOMING      bit(2)
+#define STATE_CYCLE       bit(3)
+#define STATE_HOLD        bit(4)
+#define STATE_JOG         bit(5)
+
+typedef uint_fast16_t sys_state_t;
+typedef uint32_t tool_id_t;
+
+typedef enum {
+    Status_OK = 0,
+    Status_BadNumberFormat = 2,
+    Status_InvalidStatement = 3,
+    Status_SettingDisabled = 5,
+    Status_IdleError = 8,
+    Status_GcodeValueWordMissing = 28,
+    Status_SettingValueOutOfRange = 33,
+    Status_GcodeValueOutOfRange = 52,
+    Status_Unhandled = 84
+} status_code_t;
+
+typedef enum {
+    Alarm_None = 0,
+    Alarm_ModbusException = 14
+} alarm_code_t;
+
+typedef enum {
+    Message_Plain = 0,
+    Message_Info,
+    Message_Warning
+} message_type_t;
+
+typedef enum {
+    Mode_Standard = 0,
+    Mode_Laser,
+    Mode_Lathe
+} machine_mode_t;
+
+typedef union {
+    uint8_t mask;
+    struct {
+        uint8_t x :1,
+                y :1,
+                z :1,
+                a :1,
+                unused :4;
+    };
+} axes_signals_t;
+
+typedef union {
+    float values[N_AXIS];
+    struct {
+        float x;
+        float y;
+        float z;
+    };
+} coord_data_t;
+
+// grbl/spindle_control.h
+
+#define SPINDLE_NONE        0
+#define SPINDLE_HUANYANG1   1
+#define SPINDLE_HUANYANG2   2
+#define SPINDLE_GS20        3
+#define SPINDLE_YL620A      4
+#define SPINDLE_MODVFD      5
+#define SPINDLE_H100        6
+#define SPINDLE_ONOFF0      7
+#define SPINDLE_ONOFF0_DIR  8
+#define SPINDLE_ONOFF1      9
+#define SPINDLE_ONOFF1_DIR  10
+#define SPINDLE_PWM0        11
+#define SPINDLE_PWM0_NODIR  12
+#define SPINDLE_PWM1        13
+#define SPINDLE_PWM1_NODIR  14
+#define SPINDLE_PWM2        15
+#define SPINDLE_PWM2_NODIR  16
+#define SPINDLE_PWM0_CLONE  17
+#define SPINDLE_STEPPER     19
+#define SPINDLE_NOWFOREVER  20
+#define SPINDLE_ALL_VFD     ((1<<SPINDLE_HUANYANG1)|(1<<SPINDLE_HUANYANG2)|(1<<SPINDLE_GS20)|(1<<SPINDLE_YL620A)|(1<<SPINDLE_MODVFD)|(1<<SPINDLE_H100)|(1<<SPINDLE_NOWFOREVER))
+#define SPINDLE_ALL         (SPINDLE_ALL_VFD|(1<<SPINDLE_PWM0))
+
+typedef int8_t spindle_id_t;
+typedef int8_t spindle_num_t;
+
+typedef enum {
+    SpindleType_PWM,
+    SpindleType_Basic,
+    SpindleType_VFD,
+    SpindleType_Solenoid,
+    SpindleType_Stepper,
+    SpindleType_Null
+} spindle_type_t;
+
+typedef enum {
+    SpindleData_Counters,
+    SpindleData_RPM,
+    SpindleData_AngularPosition,
+    SpindleData_AtSpeed
+} spindle_data_request_t;
+
+typedef enum {
+    SpindleHAL_Raw,
+    SpindleHAL_Configured,
+    SpindleHAL_Active
+} spindle_hal_t;
+
+typedef union {
+    uint8_t value;
+    uint8_t mask;
+    struct {
+        uint8_t on               :1,
+                ccw              :1,
+                pwm              :1,
+                reserved         :1,
+                override_disable :1,
+                encoder_error    :1,
+                at_speed         :1,
+                synchronized     :1;
+    };
+} spindle_state_t;
+
+typedef union {
+    uint16_t value;
+    struct {
+        uint16_t variable          :1,
+                 direction         :1,
+                 at_speed          :1,
+                 laser             :1,
+                 pwm_invert        :1,
+                 pid               :1,
+                 pwm_linearization :1,
+                 rpm_range_locked  :1,
+                 gpio_controlled   :1,
+                 torch             :1,
+                 cmd_controlled    :1,
+                 cloned            :1,
+                 unassigned        :4;
+    };
+} spindle_cap_t;
+
+typedef struct {
+    float rpm;
+    float rpm_low_limit;
+    float rpm_high_limit;
+    float angular_position;
+    float rpm_programmed;
+    uint32_t index_count;
+    uint32_t pulse_count;
+    uint32_t error_count;
+    bool at_speed_enabled;
+    spindle_state_t state_programmed;
+} spindle_data_t;
+
+typedef struct {
+    float rpm_min;
+    float rpm_max;
+    float pwm_freq;
+    float pwm_period;
+    float pwm_off_value;
+    float pwm_min_value;
+    float pwm_max_value;
+} spindle_pwm_settings_t;
+
+typedef struct {
+    uint32_t f_clock;
+    uint_fast16_t period;
+    uint_fast16_t off_value;
+    uint_fast16_t min_value;
+    uint_fast16_t max_value;
+    float pwm_gradient;
+    union {
+        uint8_t value;
+        struct {
+            uint8_t invert_pwm     :1,
+                    always_on      :1,
+                    cloned         :1,
+                    laser_off_overdrive :1,
+                    unused         :4;
+        };
+    } flags;
+} spindle_pwm_t;
+
+typedef struct {
+    uint8_t port_on;
+    uint8_t port_dir;
+    uint8_t port_pwm;
+    spindle_pwm_settings_t cfg;
+} spindle1_pwm_settings_t;
+
+typedef struct spindle_ptrs spindle_ptrs_t;
+
+typedef bool (*spindle_config_ptr)(spindle_ptrs_t *spindle);
+typedef void (*spindle_set_state_ptr)(spindle_ptrs_t *spindle, spindle_state_t state, float rpm);
+typedef spindle_state_t (*spindle_get_state_ptr)(spindle_ptrs_t *spindle);
+typedef uint_fast16_t (*spindle_get_pwm_ptr)(spindle_ptrs_t *spindle, float rpm);
+typedef void (*spindle_update_pwm_ptr)(spindle_ptrs_t *spindle, uint_fast16_t pwm);
+typedef void (*spindle_update_rpm_ptr)(spindle_ptrs_t *spindle, float rpm);
+typedef spindle_data_t *(*spindle_get_data_ptr)(spindle_data_request_t request);
+typedef void (*spindle_reset_data_ptr)(void);
+typedef void (*spindle_off_ptr)(spindle_ptrs_t *spindle);
+
+struct spindle_ptrs {
+    spindle_type_t type;
+    spindle_id_t id;
+    uint8_t ref_id;
+    spindle_cap_t cap;
+    union {
+        void *context;
+        spindle_pwm_t *pwm;
+    } context;
+    float rpm_min;
+    float rpm_max;
+    float at_speed_tolerance;
+    spindle_config_ptr config;
+    spindle_set_state_ptr set_state;
+    spindle_get_state_ptr get_state;
+    spindle_get_pwm_ptr get_pwm;
+    spindle_update_pwm_ptr update_pwm;
+    spindle_update_rpm_ptr update_rpm;
+    spindle_get_data_ptr get_data;
+    spindle_reset_data_ptr reset_data;
+#ifdef GRBL_ESP32
+    spindle_off_ptr esp32_off;
+#endif
+};
+
+typedef struct {
+    spindle_id_t id;
+    uint8_t ref_id;
+    spindle_num_t num;
+    const char *name;
+    bool enabled;
+    bool is_current;
+    spindle_ptrs_t *hal;
+} spindle_info_t;
+
+typedef bool (*spindle_enumerate_callback_ptr)(spindle_info_t *spindle, void *data);
+typedef void (*spindle1_settings_changed_ptr)(spindle1_pwm_settings_t *settings);
+
+#define spindle_validate_at_speed(d, r) { (d).rpm = (r); (d).state_programmed.at_speed = !(d).at_speed_enabled || ((d).rpm >= (d).rpm_low_limit && (d).rpm <= (d).rpm_high_limit); }
+
+spindle_id_t spindle_register (const spindle_ptrs_t *spindle, const char *name);
+spindle_id_t spindle_add_null (void);
+bool spindle_select (spindle_id_t spindle_id);
+bool spindle_enable (spindle_id_t spindle_id);
+spindle_ptrs_t *spindle_get (spindle_num_t spindle_num);
+spindle_ptrs_t *spindle_get_hal (spindle_id_t spindle_id, spindle_hal_t hal);
+const char *spindle_get_name (spindle_id_t spindle_id);
+uint8_t spindle_get_count (void);
+spindle_id_t spindle_get_default (void);
+bool spindle_enumerate_spindles (spindle_enumerate_callback_ptr callback, void *data);
+void spindle_set_at_speed_range (spindle_ptrs_t *spindle, spindle_data_t *spindle_data, float rpm);
+bool spindle_precompute_pwm_values (spindle_ptrs_t *spindle, spindle_pwm_t *pwm_data, spindle_pwm_settings_t *settings, uint32_t clock_hz);
+spindle1_pwm_settings_t *spindle1_settings_add (bool claim_ports);
+void spindle1_settings_register (spindle_cap_t cap, spindle1_settings_changed_ptr on_changed);
+
+// grbl/settings.h
+
+typedef uint16_t setting_id_t;
+
+enum {
+    Setting_VFD_ModbusAddress = 360,
+    Setting_ModBus_BaudRate = 374,
+    Setting_ModBus_RXTimeout = 375,
+    Setting_SpindleType = 395,
+    Setting_VFD_Type = 460,
+    Setting_VFD_RPM_Hz = 461,
+    Setting_VFD_10 = 462,
+    Setting_VFD_11 = 463,
+    Setting_VFD_12 = 464,
+    Setting_VFD_13 = 465,
+    Setting_VFD_14 = 466,
+    Setting_VFD_15 = 467,
+    Setting_VFD_16 = 468,
+    Setting_VFD_17 = 469,
+    Setting_VFD_18 = 470,
+    Setting_VFD_19 = 471,
+    Setting_VFD_ModbusAddress0 = 476,
+    Setting_VFD_ModbusAddress1 = 477,
+    Setting_VFD_ModbusAddress2 = 478,
+    Setting_VFD_ModbusAddress3 = 479,
+    Setting_Spindle_OnPort = 486,
+    Setting_Spindle_DirPort = 487,
+    Setting_SpindleEnableBase = 510,
+    Setting_SpindleEnable7 = 517,
+    Setting_SpindleToolStartBase = 520,
+    Setting_SpindleToolStart7 = 527,
+    Setting_StepperSpindle_Options = 540,
+    Setting_SpindleOffsetX = 770,
+    Setting_SpindleOffsetY = 771,
+    Setting_SpindleOffsetOptions = 772
+};
+
+typedef enum {
+    Group_Root = 0,
+    Group_General,
+    Group_Spindle,
+    Group_AuxPorts,
+    Group_ModBus,
+    Group_VFD,
+    Group_Unknown = 99
+} setting_group_t;
+
+typedef enum {
+    Format_Bool = 0,
+    Format_Bitfield,
+    Format_XBitfield,
+    Format_RadioButtons,
+    Format_AxisMask,
+    Format_Integer,
+    Format_Decimal,
+    Format_String,
+    Format_Password,
+    Format_IPv4,
+    Format_Int8,
+    Format_Int16
+} setting_datatype_t;
+
+typedef enum {
+    Setting_NonCore = 0,
+    Setting_NonCoreFn,
+    Setting_IsExtended,
+    Setting_IsExtendedFn,
+    Setting_IsLegacy,
+    Setting_IsLegacyFn
+} setting_type_t;
+
+typedef union {
+    uint8_t value;
+    struct {
+        uint8_t reboot_required :1,
+                allow_null      :1,
+                subgroups       :1,
+                increment       :4,
+                hidden          :1;
+    };
+} setting_detail_flags_t;
+
+typedef struct setting_detail setting_detail_t;
+
+typedef bool (*setting_is_available_ptr)(const setting_detail_t *setting, uint_fast16_t offset);
+typedef status_code_t (*setting_set_int_ptr)(setting_id_t id, uint_fast16_t value);
+typedef uint32_t (*setting_get_int_ptr)(setting_id_t id);
+typedef status_code_t (*setting_set_float_ptr)(setting_id_t id, float value);
+typedef float (*setting_get_float_ptr)(setting_id_t id);
+
+struct setting_detail {
+    setting_id_t id;
+    setting_group_t group;
+    const char *name;
+    const char *unit;
+    setting_datatype_t datatype;
+    const char *format;
+    const char *min_value;
+    const char *max_value;
+    setting_type_t type;
+    void *value;
+    void *get_value;
+    setting_is_available_ptr is_available;
+    setting_detail_flags_t flags;
+};
+
+typedef struct {
+    setting_group_t parent;
+    setting_group_t id;
+    const char *name;
+} setting_group_detail_t;
+
+typedef struct {
+    setting_id_t id;
+    const char *description;
+} setting_descr_t;
+
+typedef bool (*setting_output_ptr)(const setting_detail_t *setting, uint_fast16_t offset, void *data);
+
+typedef struct setting_details {
+    bool is_core;
+    uint8_t n_groups;
+    const setting_group_detail_t *groups;
+    uint16_t n_settings;
+    const setting_detail_t *settings;
+    uint16_t n_descriptions;
+    const setting_descr_t *descriptions;
+    void (*save)(void);
+    void (*load)(void);
+    void (*restore)(void);
+    bool (*iterator)(const setting_detail_t *setting, setting_output_ptr callback, void *data);
+    setting_id_t (*normalize)(setting_id_t id);
+    struct setting_details *next;
+} setting_details_t;
+
+typedef union {
+    uint8_t mask;
+    struct {
+        uint8_t allow_axis_control :1,
+                sync_position      :1,
+                unused             :6;
+    };
+} stepper_spindle_settings_flags_t;
+
+typedef struct {
+    float steps_per_mm;
+    float max_rate;
+    float acceleration;
+} axis_settings_t;
+
+typedef struct {
+    machine_mode_t mode;
+    struct {
+        float at_speed_tolerance;
+        struct {
+            uint8_t type;
+        } flags;
+    } spindle;
+    struct {
+        float pwm_freq;
+        struct {
+            uint8_t g92offset :1;
+        } flags;
+    } pwm_spindle;
+    struct {
+        uint8_t g92_is_volatile :1;
+    } flags;
+    stepper_spindle_settings_flags_t stepper_spindle_flags;
+    axis_settings_t axis[N_AXIS];
+} settings_t;
+
+typedef union {
+    uint32_t value;
+    struct {
+        uint32_t spindle :1,
+                 unused  :31;
+    };
+} settings_changed_flags_t;
+
+typedef enum {
+    CoordinateSystem_G92 = 10
+} coord_system_id_t;
+
+extern settings_t settings;
+
+void settings_register (setting_details_t *details);
+void settings_write_global (void);
+void settings_write_coord_data (coord_system_id_t id, float (*coord_data)[N_AXIS]);
+status_code_t settings_store_setting (setting_id_t id, char *svalue);
+const setting_detail_t *setting_get_details (setting_id_t id, setting_details_t **set);
+uint32_t setting_get_int_value (const setting_detail_t *setting, uint_fast16_t offset);
+
+// grbl/nvs.h, grbl/nvs_buffer.h
+
+typedef uint32_t nvs_address_t;
+
+typedef enum {
+    NVS_TransferResult_Failed = 0,
+    NVS_TransferResult_Busy,
+    NVS_TransferResult_OK
+} nvs_transfer_result_t;
+
+typedef struct {
+    nvs_transfer_result_t (*memcpy_from_nvs)(uint8_t *dest, nvs_address_t source, size_t size, bool with_checksum);
+    nvs_transfer_result_t (*memcpy_to_nvs)(nvs_address_t dest, uint8_t *source, size_t size, bool with_checksum);
+} nvs_io_t;
+
+nvs_address_t nvs_alloc (size_t size);
+
+// grbl/ioports.h
+
+#define IOPORT_UNASSIGNED 255
+
+typedef enum {
+    Port_Analog = 0,
+    Port_Digital
+} io_port_type_t;
+
+typedef enum {
+    Port_Input = 0,
+    Port_Output
+} io_port_direction_t;
+
+typedef union {
+    uint32_t mask;
+    struct {
+        uint32_t invert :1,
+                 pwm    :1,
+                 servo_pwm :1,
+                 claimable :1,
+                 claimed :1,
+                 unused :27;
+    };
+} pin_cap_t;
+
+typedef struct {
+    float freq_hz;
+    float min;
+    float max;
+    float off_value;
+    float min_value;
+    float max_value;
+    bool invert;
+} pwm_config_t;
+
+typedef struct xbar xbar_t;
+
+typedef bool (*xbar_config_ptr)(xbar_t *pin, void *cfg_data, bool persistent);
+
+struct xbar {
+    uint8_t id;
+    uint8_t pin;
+    const char *description;
+    pin_cap_t cap;
+    xbar_config_ptr config;
+};
+
+typedef struct io_port_cfg io_port_cfg_t;
+
+struct io_port_cfg {
+    io_port_type_t type;
+    io_port_direction_t dir;
+    uint8_t n_ports;
+    char port_maxs[4];
+    status_code_t (*set_value)(io_port_cfg_t *p, uint8_t *port, pin_cap_t caps, float value);
+    float (*get_value)(io_port_cfg_t *p, uint8_t port);
+    uint8_t (*get_next)(io_port_cfg_t *p, uint8_t port, const char *description, pin_cap_t caps);
+    xbar_t *(*claim)(io_port_cfg_t *p, uint8_t *port, const char *description, pin_cap_t caps);
+};
+
+io_port_cfg_t *ioports_cfg (io_port_cfg_t *p, io_port_type_t type, io_port_direction_t dir);
+bool ioport_claim (io_port_type_t type, io_port_direction_t dir, uint8_t *port, const char *description);
+xbar_t *ioport_get_info (io_port_type_t type, io_port_direction_t dir, uint8_t port);
+bool ioport_digital_out (uint8_t port, bool on);
+bool ioport_analog_out (uint8_t port, float value);
+
+// grbl/stepper.h
+
+typedef void (*stepper_enable_ptr)(axes_signals_t enable, bool hold);
+typedef void (*stepper_claim_motor_ptr)(uint_fast8_t axis_id, bool claim);
+
+// grbl/modbus.h
+
+#define MODBUS_SET_MSB16(var, value) { (var)[0] = (uint8_t)((value) >> 8); (var)[1] = (uint8_t)((value) & 0xFF); }
+
+typedef enum {
+    ModBus_ReadCoils = 1,
+    ModBus_ReadDiscreteInputs = 2,
+    ModBus_ReadHoldingRegisters = 3,
+    ModBus_ReadInputRegisters = 4,
+    ModBus_WriteCoil = 5,
+    ModBus_WriteRegister = 6,
+    ModBus_WriteCoils = 15,
+    ModBus_WriteRegisters = 16
+} modbus_function_t;
+
+typedef struct {
+    void *context;
+    uint8_t tx_length;
+    uint8_t rx_length;
+    bool crc_check;
+    uint8_t adu[MODBUS_MAX_ADU_SIZE];
+} modbus_message_t;
+
+typedef struct {
+    uint8_t retries;
+    uint16_t retry_delay;
+    void (*on_rx_packet)(modbus_message_t *msg);
+    void (*on_rx_exception)(uint8_t code, void *context);
+} modbus_callbacks_t;
+
+typedef struct {
+    uint16_t b2400;
+    uint16_t b4800;
+    uint16_t b9600;
+    uint16_t b19200;
+    uint16_t b38400;
+    uint16_t b115200;
+} modbus_silence_timeout_t;
+
+typedef union {
+    uint8_t ok;
+    struct {
+        uint8_t online :1,
+                rtu    :1,
+                tcp    :1,
+                unused :5;
+    };
+} modbus_cap_t;
+
+bool modbus_enabled (void);
+modbus_cap_t modbus_isup (void);
+bool modbus_send (modbus_message_t *msg, const modbus_callbacks_t *callbacks, bool block);
+void modbus_flush_queue (void);
+void modbus_set_silence (const modbus_silence_timeout_t *timeout);
+
+// grbl/stream.h, grbl/report.h
+
+typedef void (*stream_write_ptr)(const char *s);
+
+typedef union {
+    uint32_t value;
+    struct {
+        uint32_t all     :1,
+                 spindle :1,
+                 unused  :30;
+    };
+} report_tracking_flags_t;
+
+typedef enum {
+    Report_Spindle = 1
+} report_tracking_t;
+
+void report_message (const char *msg, message_type_t type);
+void report_warning (void *message);
+void report_plugin (const char *name, const char *version);
+void report_add_realtime (report_tracking_t report);
+
+// grbl/nuts_bolts.h
+
+char *uitoa (uint32_t n);
+char *ftoa (float n, uint8_t decimal_places);
+
+// grbl/task.h
+
+typedef void (*foreground_task_ptr)(void *data);
+
+bool task_add_immediate (foreground_task_ptr fn, void *data);
+bool task_add_delayed (foreground_task_ptr fn, void *data, uint32_t delay_ms);
+bool task_run_on_startup (foreground_task_ptr fn, void *data);
+
+// grbl/system.h
+
+typedef struct {
+    uint8_t noargs         :1,
+            allow_blocking :1,
+            help_fn        :1,
+            unused         :5;
+} sys_command_flags_t;
+
+typedef status_code_t (*sys_command_ptr)(sys_state_t state, char *args);
+
+typedef struct {
+    const char *command;
+    sys_command_ptr execute;
+    sys_command_flags_t flags;
+    union {
+        const char *str;
+    } help;
+} sys_command_t;
+
+typedef struct sys_commands_str {
+    uint8_t n_commands;
+    const sys_command_t *commands;
+    struct sys_commands_str *next;
+} sys_commands_t;
+
+typedef struct {
+    bool cold_start;
+    bool driver_started;
+    int32_t position[N_AXIS];
+    struct {
+        uint8_t feed_rate;
+    } override;
+} system_t;
+
+extern system_t sys;
+
+sys_state_t state_get (void);
+void system_raise_alarm (alarm_code_t alarm);
+void system_register_commands (sys_commands_t *commands);
+void system_convert_array_steps_to_mpos (float *position, int32_t *steps);
+void system_flag_wco_change (void);
+void enqueue_feed_override (uint8_t cmd);
+
+// grbl/gcode.h, grbl/planner.h, grbl/motion_control.h, grbl/protocol.h
+
+typedef enum {
+    Spindle_Select = 104,
+    UserMCode_Ignore = 0
+} user_mcode_t;
+
+typedef enum {
+    UserMCode_Unsupported = 0,
+    UserMCode_Normal,
+    UserMCode_NoValueWords
+} user_mcode_type_t;
+
+typedef struct {
+    uint32_t p :1,
+             q :1,
+             s :1,
+             unused :29;
+} parameter_words_t;
+
+typedef struct {
+    float p;
+    float q;
+    float s;
+} gc_values_t;
+
+typedef struct {
+    user_mcode_t user_mcode;
+    bool user_mcode_sync;
+    parameter_words_t words;
+    gc_values_t values;
+} parser_block_t;
+
+typedef struct {
+    coord_data_t coord;
+} gc_offset_t;
+
+typedef struct {
+    gc_offset_t g92_offset;
+} parser_state_t;
+
+extern parser_state_t gc_state;
+
+typedef struct {
+    struct {
+        uint8_t rapid_motion :1,
+                unused       :7;
+    } condition;
+} plan_line_data_t;
+
+typedef struct {
+    tool_id_t tool_id;
+} tool_data_t;
+
+typedef user_mcode_type_t (*user_mcode_check_ptr)(user_mcode_t mcode);
+typedef status_code_t (*user_mcode_validate_ptr)(parser_block_t *gc_block);
+typedef void (*user_mcode_execute_ptr)(sys_state_t state, parser_block_t *gc_block);
+
+typedef struct {
+    user_mcode_check_ptr check;
+    user_mcode_validate_ptr validate;
+    user_mcode_execute_ptr execute;
+} user_mcode_ptrs_t;
+
+void plan_data_init (plan_line_data_t *plan_data);
+bool mc_line (float *target, plan_line_data_t *pl_data);
+bool protocol_buffer_synchronize (void);
+void plan_sync_position (void);
+
+#define sync_position() plan_sync_position()
+
+// grbl/stepper2.h
+
+#define Stepper2_InfiniteSteps 0x7FFFFFFFFFFFFFFFLL
+
+typedef struct st2_motor st2_motor_t;
+
+typedef void (*st2_motor_stopped_ptr)(void *data);
+
+st2_motor_t *st2_motor_init (uint_fast8_t axis_idx, bool is_spindle);
+bool st2_motor_bind_spindle (uint_fast8_t axis_idx);
+bool st2_motor_poll (st2_motor_t *motor);
+bool st2_motor_run (st2_motor_t *motor);
+bool st2_motor_running (st2_motor_t *motor);
+bool st2_motor_cruising (st2_motor_t *motor);
+bool st2_motor_move (st2_motor_t *motor, const float move, const float speed, const int64_t steps);
+float st2_motor_set_speed (st2_motor_t *motor, float speed);
+bool st2_motor_stop (st2_motor_t *motor);
+float st2_get_speed (st2_motor_t *motor);
+int64_t st2_get_position (st2_motor_t *motor);
+void st2_set_position (st2_motor_t *motor, int64_t position);
+bool st2_motor_register_stopped_callback (st2_motor_t *motor, st2_motor_stopped_ptr callback);
+
+// grbl/vfs.h
+
+typedef struct vfs_file vfs_file_t;
+
+vfs_file_t *vfs_open (const char *filename, const char *mode);
+size_t vfs_read (void *buffer, size_t size, size_t count, vfs_file_t *file);
+void vfs_close (vfs_file_t *file);
+
+// grbl/hal.h, grbl/core_handlers.h
+
+typedef bool (*driver_setup_ptr)(settings_t *settings);
+typedef void (*driver_reset_ptr)(void);
+typedef void (*settings_changed_ptr)(settings_t *settings, settings_changed_flags_t changed);
+typedef void (*on_spindle_selected_ptr)(spindle_ptrs_t *spindle);
+typedef void (*on_realtime_report_ptr)(stream_write_ptr stream_write, report_tracking_flags_t report);
+typedef void (*on_execute_realtime_ptr)(uint_fast16_t state);
+typedef void (*on_report_options_ptr)(bool newopt);
+typedef void (*on_tool_selected_ptr)(tool_data_t *tool);
+typedef bool (*enqueue_realtime_command_ptr)(char c);
+
+typedef struct {
+    const char *info;
+    uint32_t (*get_elapsed_ticks)(void);
+    driver_setup_ptr driver_setup;
+    driver_reset_ptr driver_reset;
+    settings_changed_ptr settings_changed;
+    nvs_io_t nvs;
+    struct {
+        stream_write_ptr write;
+    } stream;
+    struct {
+        stepper_enable_ptr enable;
+        stepper_claim_motor_ptr claim_motor;
+    } stepper;
+    struct {
+        spindle_get_data_ptr get;
+        spindle_reset_data_ptr reset;
+    } spindle_data;
+} grbl_hal_t;
+
+typedef struct {
+    on_spindle_selected_ptr on_spindle_selected;
+    on_realtime_report_ptr on_realtime_report;
+    on_execute_realtime_ptr on_execute_realtime;
+    on_execute_realtime_ptr on_execute_delay;
+    on_report_options_ptr on_report_options;
+    on_tool_selected_ptr on_tool_selected;
+    enqueue_realtime_command_ptr enqueue_realtime_command;
+    user_mcode_ptrs_t user_mcode;
+    struct {
+        tool_id_t n_tools;
+    } tool_table;
+} grbl_t;
+
+extern grbl_hal_t hal;
+extern grbl_t grbl;
+
+#endif // _MOCK_HAL_H_
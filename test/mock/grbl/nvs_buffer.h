@@ -0,0 +1,5 @@
+/*
+  test/mock/grbl/nvs_buffer.h - part of the grblHAL core mock, see hal.h
+*/
+
+#include "hal.h"
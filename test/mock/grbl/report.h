@@ -0,0 +1,5 @@
+/*
+  test/mock/grbl/report.h - part of the grblHAL core mock, see hal.h
+*/
+
+#include "hal.h"
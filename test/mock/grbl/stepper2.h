@@ -0,0 +1,5 @@
+/*
+  test/mock/grbl/stepper2.h - part of the grblHAL core mock, see hal.h
+*/
+
+#include "hal.h"
@@ -0,0 +1,1572 @@
+/*
+
+  test/mock/mock.c - minimal mock of the grblHAL core for host builds of the spindle plugins
+
+  Part of grblHAL
+
+  Copyright (c) 2026 Terje Io
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// SPINDLE_HOST_TEST is defined on the command line by test/CMakeLists.txt only.
+#if SPINDLE_HOST_TEST
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mock.h"
+
+#define MOCK_NVS_SIZE 4096
+#define MOCK_NVS_CORE 256   // NVS reserved for core settings, nvs_alloc() never returns 0 when successful
+#define MOCK_TASKS 16
+#define MOCK_MODBUS_QUEUE 8
+#define MOCK_MODBUS_RX_SIZE 256
+
+grbl_hal_t hal;
+grbl_t grbl;
+system_t sys;
+settings_t settings;
+parser_state_t gc_state;
+
+static uint64_t now_us;
+static sys_state_t state;
+static alarm_code_t alarm;
+static char realtime_command;
+static char output[MOCK_OUTPUT_SIZE];
+static const char *vfs_root = NULL;
+
+/*
+ * Foreground tasks.
+ */
+
+typedef struct {
+    foreground_task_ptr fn;
+    void *data;
+    uint64_t due;
+} task_t;
+
+static struct {
+    uint_fast8_t n_immediate, n_delayed, n_startup;
+    task_t immediate[MOCK_TASKS];
+    task_t delayed[MOCK_TASKS];
+    task_t startup[MOCK_TASKS];
+} tasks;
+
+static bool task_add (task_t *list, uint_fast8_t *n, foreground_task_ptr fn, void *data, uint64_t due)
+{
+    bool ok;
+
+    if((ok = *n < MOCK_TASKS)) {
+        list[*n].fn = fn;
+        list[*n].data = data;
+        list[(*n)++].due = due;
+    }
+
+    return ok;
+}
+
+bool task_add_immediate (foreground_task_ptr fn, void *data)
+{
+    return task_add(tasks.immediate, &tasks.n_immediate, fn, data, 0);
+}
+
+bool task_add_delayed (foreground_task_ptr fn, void *data, uint32_t delay_ms)
+{
+    return task_add(tasks.delayed, &tasks.n_delayed, fn, data, now_us + (uint64_t)delay_ms * 1000);
+}
+
+bool task_run_on_startup (foreground_task_ptr fn, void *data)
+{
+    return task_add(tasks.startup, &tasks.n_startup, fn, data, 0);
+}
+
+// Runs tasks queued before the call, tasks added by them are run on the next call.
+static void tasks_execute (void)
+{
+    task_t task;
+    uint_fast8_t idx = 0, n = tasks.n_immediate;
+
+    while(idx < tasks.n_delayed) {
+        if(tasks.delayed[idx].due <= now_us) {
+            task = tasks.delayed[idx];
+            memmove(&tasks.delayed[idx], &tasks.delayed[idx + 1], sizeof(task_t) * (--tasks.n_delayed - idx));
+            task.fn(task.data);
+        } else
+            idx++;
+    }
+
+    while(n--) {
+        task = tasks.immediate[0];
+        memmove(&tasks.immediate[0], &tasks.immediate[1], sizeof(task_t) * --tasks.n_immediate);
+        task.fn(task.data);
+    }
+}
+
+/*
+ * Output and reports.
+ */
+
+static void stream_write (const char *s)
+{
+    size_t len = strlen(output);
+
+    strncat(output, s, sizeof(output) - len - 1);
+}
+
+void report_message (const char *msg, message_type_t type)
+{
+    hal.stream.write("[MSG:");
+    if(type == Message_Warning)
+        hal.stream.write("Warning: ");
+    hal.stream.write(msg);
+    hal.stream.write("]" ASCII_EOL);
+}
+
+void report_warning (void *message)
+{
+    report_message((char *)message, Message_Warning);
+}
+
+void report_plugin (const char *name, const char *version)
+{
+    hal.stream.write("[PLUGIN:");
+    hal.stream.write(name);
+    hal.stream.write(" v");
+    hal.stream.write(version);
+    hal.stream.write("]" ASCII_EOL);
+}
+
+void report_add_realtime (report_tracking_t report)
+{
+}
+
+char *uitoa (uint32_t n)
+{
+    static char buf[12];
+
+    sprintf(buf, "%u", (unsigned int)n);
+
+    return buf;
+}
+
+char *ftoa (float n, uint8_t decimal_places)
+{
+    static char buf[32];
+
+    sprintf(buf, "%.*f", decimal_places, (double)n);
+
+    return buf;
+}
+
+/*
+ * System and motion.
+ */
+
+sys_state_t state_get (void)
+{
+    return state;
+}
+
+void system_raise_alarm (alarm_code_t code)
+{
+    alarm = code;
+    state = STATE_ALARM;
+}
+
+static bool enqueue_realtime_command (char c)
+{
+    realtime_command = c;
+
+    if(c == CMD_FEED_HOLD && state == STATE_CYCLE)
+        state = STATE_HOLD;
+
+    return true;
+}
+
+void enqueue_feed_override (uint8_t cmd)
+{
+    if(cmd == CMD_OVERRIDE_FEED_FINE_PLUS && sys.override.feed_rate < 200)
+        sys.override.feed_rate++;
+    else if(cmd == CMD_OVERRIDE_FEED_FINE_MINUS && sys.override.feed_rate > 10)
+        sys.override.feed_rate--;
+}
+
+void system_convert_array_steps_to_mpos (float *position, int32_t *steps)
+{
+    uint_fast8_t idx;
+
+    for(idx = 0; idx < N_AXIS; idx++)
+        position[idx] = (float)steps[idx] / settings.axis[idx].steps_per_mm;
+}
+
+void system_flag_wco_change (void)
+{
+}
+
+void plan_data_init (plan_line_data_t *plan_data)
+{
+    memset(plan_data, 0, sizeof(plan_line_data_t));
+}
+
+bool mc_line (float *target, plan_line_data_t *pl_data)
+{
+    uint_fast8_t idx;
+
+    for(idx = 0; idx < N_AXIS; idx++)
+        sys.position[idx] = (int32_t)lroundf(target[idx] * settings.axis[idx].steps_per_mm);
+
+    return true;
+}
+
+bool protocol_buffer_synchronize (void)
+{
+    return true;
+}
+
+void plan_sync_position (void)
+{
+}
+
+/*
+ * NVS.
+ */
+
+static struct {
+    nvs_address_t next;
+    uint8_t data[MOCK_NVS_SIZE];
+    bool written[MOCK_NVS_SIZE];
+} nvs;
+
+nvs_address_t nvs_alloc (size_t size)
+{
+    nvs_address_t address = 0;
+
+    if(nvs.next + size <= MOCK_NVS_SIZE) {
+        address = nvs.next;
+        nvs.next += size;
+    }
+
+    return address;
+}
+
+// Reading data never written fails as a checksum mismatch does.
+static nvs_transfer_result_t memcpy_from_nvs (uint8_t *dest, nvs_address_t source, size_t size, bool with_checksum)
+{
+    size_t idx;
+
+    for(idx = 0; idx < size; idx++) {
+        if(!nvs.written[source + idx])
+            return NVS_TransferResult_Failed;
+    }
+
+    memcpy(dest, &nvs.data[source], size);
+
+    return NVS_TransferResult_OK;
+}
+
+static nvs_transfer_result_t memcpy_to_nvs (nvs_address_t dest, uint8_t *source, size_t size, bool with_checksum)
+{
+    memcpy(&nvs.data[dest], source, size);
+    memset(&nvs.written[dest], true, size);
+
+    return NVS_TransferResult_OK;
+}
+
+/*
+ * Settings.
+ */
+
+static setting_details_t *setting_details = NULL;
+
+static struct {
+    uint8_t baud_rate;
+    uint16_t rx_timeout;
+    uint8_t spindle_type;
+} core;
+
+static char spindle_format[N_SPINDLE * 24];
+
+static const setting_detail_t core_settings[] = {
+    { Setting_ModBus_BaudRate, Group_ModBus, "ModBus baud rate", NULL, Format_RadioButtons, "2400,4800,9600,19200,38400,115200", NULL, NULL, Setting_NonCore, &core.baud_rate, NULL, NULL },
+    { Setting_ModBus_RXTimeout, Group_ModBus, "ModBus RX timeout", "milliseconds", Format_Int16, "####0", "50", "250", Setting_NonCore, &core.rx_timeout, NULL, NULL },
+    { Setting_SpindleType, Group_Spindle, "Default spindle", NULL, Format_RadioButtons, spindle_format, NULL, NULL, Setting_NonCore, &core.spindle_type, NULL, NULL }
+};
+
+static setting_details_t core_details = {
+    .is_core = true,
+    .settings = core_settings,
+    .n_settings = sizeof(core_settings) / sizeof(setting_detail_t)
+};
+
+void settings_register (setting_details_t *details)
+{
+    setting_details_t **last = &setting_details;
+
+    while(*last)
+        last = &(*last)->next;
+
+    details->next = NULL;
+    *last = details;
+}
+
+void settings_write_global (void)
+{
+}
+
+void settings_write_coord_data (coord_system_id_t id, float (*coord_data)[N_AXIS])
+{
+}
+
+const setting_detail_t *setting_get_details (setting_id_t id, setting_details_t **set)
+{
+    uint_fast16_t idx;
+    setting_id_t base;
+    setting_details_t *details = setting_details;
+
+    while(details) {
+        base = details->normalize ? details->normalize(id) : id;
+        for(idx = 0; idx < details->n_settings; idx++) {
+            if(details->settings[idx].id == base) {
+                if(set)
+                    *set = details;
+                return &details->settings[idx];
+            }
+        }
+        details = details->next;
+    }
+
+    return NULL;
+}
+
+static bool is_fn (const setting_detail_t *setting)
+{
+    return setting->type == Setting_NonCoreFn || setting->type == Setting_IsExtendedFn || setting->type == Setting_IsLegacyFn;
+}
+
+uint32_t setting_get_int_value (const setting_detail_t *setting, uint_fast16_t offset)
+{
+    uint32_t value = 0;
+
+    if(is_fn(setting))
+        value = setting->datatype == Format_Decimal
+                 ? (uint32_t)((setting_get_float_ptr)setting->get_value)(setting->id + offset)
+                 : ((setting_get_int_ptr)setting->get_value)(setting->id + offset);
+    else switch(setting->datatype) {
+
+        case Format_Int16:
+            value = *(uint16_t *)setting->value;
+            break;
+
+        case Format_Integer:
+            value = *(uint32_t *)setting->value;
+            break;
+
+        case Format_Decimal:
+            value = (uint32_t)*(float *)setting->value;
+            break;
+
+        default:
+            value = *(uint8_t *)setting->value;
+            break;
+    }
+
+    return value;
+}
+
+static uint_fast8_t n_options (const char *format)
+{
+    uint_fast8_t n = 1;
+
+    while(*format) {
+        if(*format++ == ',')
+            n++;
+    }
+
+    return n;
+}
+
+status_code_t settings_store_setting (setting_id_t id, char *svalue)
+{
+    char *end;
+    float value;
+    setting_details_t *details;
+    const setting_detail_t *setting;
+
+    if((setting = setting_get_details(id, &details)) == NULL)
+        return Status_InvalidStatement;
+
+    if(setting->is_available && !setting->is_available(setting, id - setting->id))
+        return Status_SettingDisabled;
+
+    value = strtof(svalue, &end);
+    if(end == svalue || *end != '\0')
+        return Status_BadNumberFormat;
+
+    if((setting->min_value && value < strtof(setting->min_value, NULL)) ||
+        (setting->max_value && value > strtof(setting->max_value, NULL)) ||
+         ((setting->datatype == Format_RadioButtons) && (value < 0.0f || value >= (float)n_options(setting->format))) ||
+          ((setting->datatype == Format_Bitfield) && (value < 0.0f || value >= (float)(1 << n_options(setting->format)))))
+        return Status_SettingValueOutOfRange;
+
+    if(is_fn(setting)) {
+
+        status_code_t status = setting->datatype == Format_Decimal
+                                ? ((setting_set_float_ptr)setting->value)(id, value)
+                                : ((setting_set_int_ptr)setting->value)(id, (uint_fast16_t)value);
+        if(status != Status_OK)
+            return status;
+
+    } else switch(setting->datatype) {
+
+        case Format_Int16:
+            *(uint16_t *)setting->value = (uint16_t)value;
+            break;
+
+        case Format_Integer:
+            *(uint32_t *)setting->value = (uint32_t)value;
+            break;
+
+        case Format_Decimal:
+            *(float *)setting->value = value;
+            break;
+
+        default:
+            *(uint8_t *)setting->value = (uint8_t)value;
+            break;
+    }
+
+    if(details->save)
+        details->save();
+
+    if(details->is_core)
+        hal.settings_changed(&settings, (settings_changed_flags_t){ .spindle = setting->group == Group_Spindle });
+
+    return Status_OK;
+}
+
+/*
+ * Spindles.
+ */
+
+typedef struct {
+    const spindle_ptrs_t *hal;
+    spindle_ptrs_t cfg;
+    const char *name;
+} spindle_reg_t;
+
+static struct {
+    uint_fast8_t n;
+    spindle_id_t null_id;
+    spindle_ptrs_t active;
+    bool selected;
+    spindle_reg_t spindle[N_SPINDLE];
+} spindles;
+
+static spindle1_pwm_settings_t spindle1;
+static uint_fast8_t n_spindle1_changed = 0;
+static spindle1_settings_changed_ptr spindle1_changed[2]; // PWM2 and the cloned PWM spindle
+
+spindle_id_t spindle_register (const spindle_ptrs_t *spindle, const char *name)
+{
+    spindle_id_t id = -1;
+
+    if(spindles.n < N_SPINDLE) {
+        id = (spindle_id_t)spindles.n++;
+        spindles.spindle[id].hal = spindle;
+        spindles.spindle[id].name = name;
+        memcpy(&spindles.spindle[id].cfg, spindle, sizeof(spindle_ptrs_t));
+        spindles.spindle[id].cfg.id = id;
+        if(id)
+            strcat(spindle_format, ",");
+        strcat(spindle_format, name);
+    }
+
+    return id;
+}
+
+static void null_set_state (spindle_ptrs_t *spindle, spindle_state_t state, float rpm)
+{
+}
+
+static spindle_state_t null_get_state (spindle_ptrs_t *spindle)
+{
+    return (spindle_state_t){0};
+}
+
+spindle_id_t spindle_add_null (void)
+{
+    static const spindle_ptrs_t spindle = {
+        .type = SpindleType_Null,
+        .set_state = null_set_state,
+        .get_state = null_get_state
+    };
+
+    if(spindles.null_id == -1)
+        spindles.null_id = spindle_register(&spindle, "NULL");
+
+    return spindles.null_id;
+}
+
+bool spindle_select (spindle_id_t spindle_id)
+{
+    bool ok;
+    spindle_ptrs_t *spindle;
+
+    if((ok = spindle_id >= 0 && spindle_id < spindles.n)) {
+
+        spindle = &spindles.spindle[spindle_id].cfg;
+
+        if(spindles.selected && spindles.active.id != spindle_id)
+            spindles.active.set_state(&spindles.active, (spindle_state_t){0}, 0.0f);
+
+        if((ok = spindle->config == NULL || spindle->config(spindle))) {
+
+            memcpy(&spindles.active, spindle, sizeof(spindle_ptrs_t));
+            spindles.selected = true;
+
+            if(grbl.on_spindle_selected)
+                grbl.on_spindle_selected(&spindles.active);
+        }
+    }
+
+    return ok;
+}
+
+bool spindle_enable (spindle_id_t spindle_id)
+{
+    return spindle_id >= 0 && spindle_id < spindles.n;
+}
+
+spindle_ptrs_t *spindle_get (spindle_num_t spindle_num)
+{
+    return spindle_num == 0 && spindles.selected ? &spindles.active : NULL;
+}
+
+spindle_ptrs_t *spindle_get_hal (spindle_id_t spindle_id, spindle_hal_t hal)
+{
+    spindle_ptrs_t *spindle = NULL;
+
+    if(spindle_id >= 0 && spindle_id < spindles.n) switch(hal) {
+
+        case SpindleHAL_Raw:
+            spindle = (spindle_ptrs_t *)spindles.spindle[spindle_id].hal;
+            break;
+
+        case SpindleHAL_Configured:
+            spindle = &spindles.spindle[spindle_id].cfg;
+            break;
+
+        case SpindleHAL_Active:
+            spindle = spindles.selected && spindles.active.id == spindle_id ? &spindles.active : NULL;
+            break;
+    }
+
+    return spindle;
+}
+
+const char *spindle_get_name (spindle_id_t spindle_id)
+{
+    return spindle_id >= 0 && spindle_id < spindles.n ? spindles.spindle[spindle_id].name : NULL;
+}
+
+uint8_t spindle_get_count (void)
+{
+    return spindles.n;
+}
+
+spindle_id_t spindle_get_default (void)
+{
+    return (spindle_id_t)core.spindle_type;
+}
+
+bool spindle_enumerate_spindles (spindle_enumerate_callback_ptr callback, void *data)
+{
+    uint_fast8_t idx;
+    spindle_info_t info;
+
+    for(idx = 0; idx < spindles.n; idx++) {
+        info.id = (spindle_id_t)idx;
+        info.ref_id = spindles.spindle[idx].hal->ref_id;
+        info.name = spindles.spindle[idx].name;
+        info.is_current = spindles.selected && spindles.active.id == info.id;
+        info.num = info.is_current ? 0 : -1;
+        info.enabled = info.is_current;
+        info.hal = &spindles.spindle[idx].cfg;
+        if(callback(&info, data))
+            return true;
+    }
+
+    return false;
+}
+
+void spindle_set_at_speed_range (spindle_ptrs_t *spindle, spindle_data_t *spindle_data, float rpm)
+{
+    spindle_data->rpm_programmed = rpm;
+    spindle_data->state_programmed.at_speed = false;
+
+    if((spindle_data->at_speed_enabled = spindle->at_speed_tolerance > 0.0f)) {
+        spindle_data->rpm_low_limit = rpm * (1.0f - (spindle->at_speed_tolerance / 100.0f));
+        spindle_data->rpm_high_limit = rpm * (1.0f + (spindle->at_speed_tolerance / 100.0f));
+    }
+}
+
+bool spindle_precompute_pwm_values (spindle_ptrs_t *spindle, spindle_pwm_t *pwm_data, spindle_pwm_settings_t *settings, uint32_t clock_hz)
+{
+    bool ok;
+
+    if((ok = settings->rpm_max > settings->rpm_min && settings->pwm_freq > 0.0f)) {
+        pwm_data->f_clock = clock_hz;
+        pwm_data->period = (uint_fast16_t)((float)clock_hz / settings->pwm_freq);
+        pwm_data->off_value = (uint_fast16_t)(pwm_data->period * settings->pwm_off_value / 100.0f);
+        pwm_data->min_value = (uint_fast16_t)(pwm_data->period * settings->pwm_min_value / 100.0f);
+        pwm_data->max_value = (uint_fast16_t)(pwm_data->period * settings->pwm_max_value / 100.0f);
+        pwm_data->pwm_gradient = (float)(pwm_data->max_value - pwm_data->min_value) / (settings->rpm_max - settings->rpm_min);
+    }
+
+    return ok;
+}
+
+spindle1_pwm_settings_t *spindle1_settings_add (bool claim_ports)
+{
+    return &spindle1;
+}
+
+void spindle1_settings_register (spindle_cap_t cap, spindle1_settings_changed_ptr on_changed)
+{
+    if(n_spindle1_changed < sizeof(spindle1_changed) / sizeof(spindle1_settings_changed_ptr))
+        spindle1_changed[n_spindle1_changed++] = on_changed;
+}
+
+// PWM spindle provided by the driver, spindle 0.
+
+static spindle_state_t pwm0_state;
+static uint_fast16_t pwm0_value;
+static spindle_pwm_t pwm0_data;
+
+static uint_fast16_t pwm0GetPWM (spindle_ptrs_t *spindle, float rpm)
+{
+    return rpm <= 0.0f ? pwm0_data.off_value : pwm0_data.min_value + (uint_fast16_t)((rpm - spindle->rpm_min) * pwm0_data.pwm_gradient);
+}
+
+static void pwm0UpdatePWM (spindle_ptrs_t *spindle, uint_fast16_t pwm_value)
+{
+    pwm0_value = pwm_value;
+}
+
+static void pwm0SetState (spindle_ptrs_t *spindle, spindle_state_t state, float rpm)
+{
+    pwm0_state = state;
+    pwm0_value = state.on ? pwm0GetPWM(spindle, rpm) : pwm0_data.off_value;
+}
+
+static spindle_state_t pwm0GetState (spindle_ptrs_t *spindle)
+{
+    return pwm0_state;
+}
+
+static bool pwm0Config (spindle_ptrs_t *spindle)
+{
+    spindle_pwm_settings_t cfg = { .rpm_min = 0.0f, .rpm_max = 1000.0f, .pwm_freq = settings.pwm_spindle.pwm_freq, .pwm_max_value = 100.0f };
+
+    return spindle_precompute_pwm_values(spindle, &pwm0_data, &cfg, 1000000);
+}
+
+static const spindle_ptrs_t pwm0_spindle = {
+    .type = SpindleType_PWM,
+    .ref_id = SPINDLE_PWM0,
+    .cap = {
+        .variable = On,
+        .direction = On,
+        .laser = On,
+        .gpio_controlled = On
+    },
+    .context.pwm = &pwm0_data,
+    .rpm_max = 1000.0f,
+    .config = pwm0Config,
+    .set_state = pwm0SetState,
+    .get_state = pwm0GetState,
+    .get_pwm = pwm0GetPWM,
+    .update_pwm = pwm0UpdatePWM
+};
+
+/*
+ * Auxiliary ports.
+ */
+
+static struct {
+    bool claimed[MOCK_DIGITAL_PORTS];
+    bool value[MOCK_DIGITAL_PORTS];
+    xbar_t xbar[MOCK_DIGITAL_PORTS];
+} digital_out;
+
+static struct {
+    bool claimed[MOCK_ANALOG_PORTS];
+    float value[MOCK_ANALOG_PORTS];
+    pwm_config_t config[MOCK_ANALOG_PORTS];
+    xbar_t xbar[MOCK_ANALOG_PORTS];
+} analog_out;
+
+static bool analog_config (xbar_t *pin, void *cfg_data, bool persistent)
+{
+    memcpy(&analog_out.config[pin->id], cfg_data, sizeof(pwm_config_t));
+
+    return true;
+}
+
+static bool *port_claimed (io_port_type_t type, uint8_t port)
+{
+    if(type == Port_Digital)
+        return port < MOCK_DIGITAL_PORTS ? &digital_out.claimed[port] : NULL;
+
+    return port < MOCK_ANALOG_PORTS ? &analog_out.claimed[port] : NULL;
+}
+
+xbar_t *ioport_get_info (io_port_type_t type, io_port_direction_t dir, uint8_t port)
+{
+    if(dir != Port_Output || port_claimed(type, port) == NULL)
+        return NULL;
+
+    return type == Port_Digital ? &digital_out.xbar[port] : &analog_out.xbar[port];
+}
+
+bool ioport_claim (io_port_type_t type, io_port_direction_t dir, uint8_t *port, const char *description)
+{
+    bool *claimed;
+
+    if(dir != Port_Output || (claimed = port_claimed(type, *port)) == NULL || *claimed)
+        return false;
+
+    return *claimed = true;
+}
+
+bool ioport_digital_out (uint8_t port, bool on)
+{
+    bool ok;
+
+    if((ok = port < MOCK_DIGITAL_PORTS))
+        digital_out.value[port] = on;
+
+    return ok;
+}
+
+bool ioport_analog_out (uint8_t port, float value)
+{
+    bool ok;
+
+    if((ok = port < MOCK_ANALOG_PORTS))
+        analog_out.value[port] = value;
+
+    return ok;
+}
+
+static status_code_t port_set_value (io_port_cfg_t *p, uint8_t *port, pin_cap_t caps, float value)
+{
+    if(value < 0.0f)
+        *port = IOPORT_UNASSIGNED;
+    else if(value < (float)p->n_ports)
+        *port = (uint8_t)value;
+    else
+        return Status_SettingValueOutOfRange;
+
+    return Status_OK;
+}
+
+static float port_get_value (io_port_cfg_t *p, uint8_t port)
+{
+    return port == IOPORT_UNASSIGNED ? -1.0f : (float)port;
+}
+
+static uint8_t port_get_next (io_port_cfg_t *p, uint8_t port, const char *description, pin_cap_t caps)
+{
+    port = port == IOPORT_UNASSIGNED ? 0 : port + 1;
+
+    while(port < p->n_ports && *port_claimed(p->type, port))
+        port++;
+
+    return port < p->n_ports ? port : IOPORT_UNASSIGNED;
+}
+
+// An unassigned port is not claimed and not an error.
+static xbar_t *port_claim (io_port_cfg_t *p, uint8_t *port, const char *description, pin_cap_t caps)
+{
+    static xbar_t unassigned;
+
+    if(*port == IOPORT_UNASSIGNED)
+        return &unassigned;
+
+    return ioport_claim(p->type, p->dir, port, description) ? ioport_get_info(p->type, p->dir, *port) : NULL;
+}
+
+io_port_cfg_t *ioports_cfg (io_port_cfg_t *p, io_port_type_t type, io_port_direction_t dir)
+{
+    memset(p, 0, sizeof(io_port_cfg_t));
+
+    p->type = type;
+    p->dir = dir;
+    p->n_ports = dir != Port_Output ? 0 : (type == Port_Digital ? MOCK_DIGITAL_PORTS : MOCK_ANALOG_PORTS);
+    strcpy(p->port_maxs, uitoa(p->n_ports ? p->n_ports - 1 : 0));
+    p->set_value = port_set_value;
+    p->get_value = port_get_value;
+    p->get_next = port_get_next;
+    p->claim = port_claim;
+
+    return p;
+}
+
+/*
+ * Stepper motor driven by the secondary stepper API, speed is ramped at the axis acceleration.
+ * Speed is in axis units per minute, for a spindle RPM when steps/mm is set to steps per revolution.
+ */
+
+struct st2_motor {
+    uint_fast8_t axis;
+    bool running;
+    bool stopping;
+    float direction;
+    float speed;
+    float target;
+    double position;
+    uint64_t last;
+    st2_motor_stopped_ptr on_stopped;
+};
+
+static st2_motor_t motor;
+static bool motor_claimed[N_AXIS];
+
+st2_motor_t *st2_motor_init (uint_fast8_t axis_idx, bool is_spindle)
+{
+    memset(&motor, 0, sizeof(st2_motor_t));
+    motor.axis = axis_idx;
+
+    return &motor;
+}
+
+bool st2_motor_bind_spindle (uint_fast8_t axis_idx)
+{
+    return axis_idx == motor.axis;
+}
+
+bool st2_motor_poll (st2_motor_t *motor)
+{
+    return true;
+}
+
+bool st2_motor_run (st2_motor_t *motor)
+{
+    float dt = (float)(now_us - motor->last) / 1000000.0f, accel = settings.axis[motor->axis].acceleration * 60.0f * dt;
+
+    motor->last = now_us;
+
+    if(motor->running) {
+
+        if(motor->speed < motor->target)
+            motor->speed = fminf(motor->target, motor->speed + accel);
+        else
+            motor->speed = fmaxf(motor->target, motor->speed - accel);
+
+        motor->position += motor->direction * motor->speed / 60.0f * dt * settings.axis[motor->axis].steps_per_mm;
+
+        if(motor->stopping && motor->speed == 0.0f) {
+            motor->running = motor->stopping = false;
+            if(motor->on_stopped)
+                motor->on_stopped(NULL);
+        }
+    }
+
+    return motor->running;
+}
+
+bool st2_motor_running (st2_motor_t *motor)
+{
+    // Time advances while the motor runs so that busy waiting for it to stop ends.
+    if(motor->running)
+        now_us += 1000;
+
+    return st2_motor_run(motor);
+}
+
+bool st2_motor_cruising (st2_motor_t *motor)
+{
+    return motor->running && !motor->stopping && motor->speed == motor->target;
+}
+
+bool st2_motor_move (st2_motor_t *motor, const float move, const float speed, const int64_t steps)
+{
+    motor->direction = move < 0.0f ? -1.0f : 1.0f;
+    motor->target = fminf(speed, settings.axis[motor->axis].max_rate);
+    motor->running = true;
+    motor->stopping = false;
+    motor->last = now_us;
+
+    return true;
+}
+
+float st2_motor_set_speed (st2_motor_t *motor, float speed)
+{
+    return motor->target = fminf(speed, settings.axis[motor->axis].max_rate);
+}
+
+bool st2_motor_stop (st2_motor_t *motor)
+{
+    if(motor->running) {
+        motor->target = 0.0f;
+        motor->stopping = true;
+    }
+
+    return motor->running;
+}
+
+float st2_get_speed (st2_motor_t *motor)
+{
+    return motor->speed;
+}
+
+int64_t st2_get_position (st2_motor_t *motor)
+{
+    return (int64_t)motor->position;
+}
+
+void st2_set_position (st2_motor_t *motor, int64_t position)
+{
+    motor->position = (double)position;
+}
+
+bool st2_motor_register_stopped_callback (st2_motor_t *motor, st2_motor_stopped_ptr callback)
+{
+    motor->on_stopped = callback;
+
+    return true;
+}
+
+static void stepper_enable (axes_signals_t enable, bool hold)
+{
+}
+
+static void stepper_claim_motor (uint_fast8_t axis_id, bool claim)
+{
+    motor_claimed[axis_id] = claim;
+}
+
+/*
+ * File system, files are read from the directory set by mock_vfs_root().
+ */
+
+vfs_file_t *vfs_open (const char *filename, const char *mode)
+{
+    char path[256];
+
+    if(vfs_root == NULL || strlen(vfs_root) + strlen(filename) >= sizeof(path))
+        return NULL;
+
+    strcat(strcpy(path, vfs_root), filename);
+
+    return (vfs_file_t *)fopen(path, mode);
+}
+
+size_t vfs_read (void *buffer, size_t size, size_t count, vfs_file_t *file)
+{
+    return fread(buffer, size, count, (FILE *)file);
+}
+
+void vfs_close (vfs_file_t *file)
+{
+    fclose((FILE *)file);
+}
+
+/*
+ * System commands.
+ */
+
+static sys_commands_t *commands = NULL;
+
+void system_register_commands (sys_commands_t *cmds)
+{
+    cmds->next = commands;
+    commands = cmds;
+}
+
+/*
+ * ModBus RTU transport.
+ */
+
+typedef struct {
+    modbus_message_t msg;
+    modbus_message_t *caller;   // message of a blocking request, NULL if not blocking
+    int_fast8_t *result;        // set to 1 on success and -1 on failure for a blocking request
+    modbus_callbacks_t callbacks;
+    uint_fast8_t retries;
+} modbus_entry_t;
+
+typedef enum {
+    ModBus_Idle = 0,
+    ModBus_AwaitReply,
+    ModBus_Retry
+} modbus_state_t;
+
+static struct {
+    modbus_state_t state;
+    uint_fast8_t head, n;
+    modbus_entry_t queue[MOCK_MODBUS_QUEUE];
+    uint64_t done;              // time the reply is received or times out
+    uint64_t bus_free;          // end of the last frame on the bus
+    uint_fast8_t rx_length;
+    uint8_t rx[MOCK_MODBUS_RX_SIZE];
+    const modbus_silence_timeout_t *silence;
+    mock_modbus_device_ptr device;
+    mock_modbus_stats_t stats;
+} modbus;
+
+static const uint32_t baud_rates[] = { 2400, 4800, 9600, 19200, 38400, 115200 };
+static const modbus_silence_timeout_t silence_default = { .b2400 = 16, .b4800 = 8, .b9600 = 4, .b19200 = 2, .b38400 = 2, .b115200 = 2 };
+
+uint16_t mock_modbus_crc (const uint8_t *adu, uint_fast8_t length)
+{
+    uint_fast8_t bit;
+    uint16_t crc = 0xFFFF;
+
+    while(length--) {
+        crc ^= *adu++;
+        for(bit = 0; bit < 8; bit++)
+            crc = crc & 1 ? (crc >> 1) ^ 0xA001 : crc >> 1;
+    }
+
+    return crc;
+}
+
+uint32_t mock_modbus_baud (void)
+{
+    return baud_rates[core.baud_rate < 6 ? core.baud_rate : 3];
+}
+
+uint16_t mock_modbus_silence (void)
+{
+    const modbus_silence_timeout_t *silence = modbus.silence ? modbus.silence : &silence_default;
+    const uint16_t timeouts[] = { silence->b2400, silence->b4800, silence->b9600, silence->b19200, silence->b38400, silence->b115200 };
+
+    return timeouts[core.baud_rate < 6 ? core.baud_rate : 3];
+}
+
+static uint32_t frame_us (uint_fast8_t length)
+{
+    return (uint32_t)((uint64_t)length * 10 * 1000000 / mock_modbus_baud());
+}
+
+static void modbus_transmit (void)
+{
+    uint16_t crc;
+    uint32_t tx_us, gap_us, turnaround_us = 0;
+    modbus_entry_t *entry = &modbus.queue[modbus.head];
+
+    crc = mock_modbus_crc(entry->msg.adu, entry->msg.tx_length - 2);
+    entry->msg.adu[entry->msg.tx_length - 2] = crc & 0xFF;
+    entry->msg.adu[entry->msg.tx_length - 1] = crc >> 8;
+
+    tx_us = frame_us(entry->msg.tx_length);
+    gap_us = (uint32_t)min(now_us - modbus.bus_free, 0xFFFFFFFFULL);
+
+    modbus.rx_length = 0;
+    modbus.stats.frames++;
+    modbus.stats.busy_us += tx_us;
+
+    if(modbus.device)
+        turnaround_us = modbus.device(entry->msg.adu, entry->msg.tx_length, modbus.rx, &modbus.rx_length, gap_us);
+
+    if(modbus.rx_length) {
+        // Reception ends at the expected length, the rest of a longer response still occupies the bus.
+        uint_fast8_t received = (modbus.rx[1] & 0x80) ? modbus.rx_length : min(modbus.rx_length, entry->msg.rx_length);
+        modbus.stats.busy_us += frame_us(modbus.rx_length);
+        modbus.bus_free = now_us + tx_us + turnaround_us + frame_us(modbus.rx_length);
+        modbus.done = now_us + tx_us + turnaround_us + frame_us(received);
+        modbus.rx_length = received;
+    } else {
+        modbus.bus_free = now_us + tx_us;
+        modbus.done = modbus.bus_free + (uint64_t)core.rx_timeout * 1000;
+    }
+
+    modbus.state = ModBus_AwaitReply;
+}
+
+static bool modbus_can_transmit (void)
+{
+    return modbus.n && now_us >= modbus.bus_free + (uint64_t)mock_modbus_silence() * 1000 &&
+            (modbus.state == ModBus_Idle || (modbus.state == ModBus_Retry && now_us >= modbus.done));
+}
+
+static void modbus_completed (bool ok, uint8_t code)
+{
+    modbus_message_t *msg;
+    modbus_entry_t entry = modbus.queue[modbus.head];
+
+    modbus.head = (modbus.head + 1) % MOCK_MODBUS_QUEUE;
+    modbus.n--;
+    modbus.state = ModBus_Idle;
+
+    if(ok)
+        memcpy(entry.msg.adu, modbus.rx, min(modbus.rx_length, MODBUS_MAX_ADU_SIZE));
+
+    if((msg = entry.caller)) {
+        memcpy(msg, &entry.msg, sizeof(modbus_message_t));
+        *entry.result = ok ? 1 : -1;
+    } else
+        msg = &entry.msg;
+
+    if(ok) {
+        if(entry.callbacks.on_rx_packet)
+            entry.callbacks.on_rx_packet(msg);
+    } else if(entry.callbacks.on_rx_exception)
+        entry.callbacks.on_rx_exception(code, msg->context);
+}
+
+static void modbus_poll (void)
+{
+    modbus_entry_t *entry = &modbus.queue[modbus.head];
+
+    if(modbus.state == ModBus_AwaitReply && now_us >= modbus.done) {
+
+        uint_fast8_t len = modbus.rx_length;
+        bool crc_ok = len >= 4 && (!entry->msg.crc_check || mock_modbus_crc(modbus.rx, len - 2) == (modbus.rx[len - 2] | (modbus.rx[len - 1] << 8)));
+
+        if(len == 0 || !crc_ok || (!(modbus.rx[1] & 0x80) && len != entry->msg.rx_length)) {
+            if(len)
+                modbus.stats.crc_errors++;
+            else
+                modbus.stats.timeouts++;
+            if(entry->retries < entry->callbacks.retries) {
+                entry->retries++;
+                modbus.state = ModBus_Retry;
+                modbus.done = now_us + (uint64_t)entry->callbacks.retry_delay * 1000;
+            } else
+                modbus_completed(false, 0);
+        } else if(modbus.rx[1] & 0x80) {
+            modbus.stats.exceptions++;
+            modbus_completed(false, modbus.rx[2]);
+        } else
+            modbus_completed(true, 0);
+    }
+
+    if(modbus_can_transmit())
+        modbus_transmit();
+}
+
+static void tick (void)
+{
+    now_us += 1000;
+
+    modbus_poll();
+}
+
+bool modbus_enabled (void)
+{
+    return true;
+}
+
+modbus_cap_t modbus_isup (void)
+{
+    return (modbus_cap_t){ .online = On, .rtu = On };
+}
+
+bool modbus_send (modbus_message_t *msg, const modbus_callbacks_t *callbacks, bool block)
+{
+    int_fast8_t result = 0;
+    modbus_entry_t *entry;
+
+    while(block && modbus.n == MOCK_MODBUS_QUEUE) {
+        tick();
+        grbl.on_execute_delay(state);
+    }
+
+    if(modbus.n == MOCK_MODBUS_QUEUE)
+        return false;
+
+    entry = &modbus.queue[(modbus.head + modbus.n++) % MOCK_MODBUS_QUEUE];
+    memcpy(&entry->msg, msg, sizeof(modbus_message_t));
+    entry->caller = block ? msg : NULL;
+    entry->result = &result;
+    entry->retries = 0;
+    if(callbacks)
+        memcpy(&entry->callbacks, callbacks, sizeof(modbus_callbacks_t));
+    else
+        memset(&entry->callbacks, 0, sizeof(modbus_callbacks_t));
+
+    if(modbus_can_transmit())
+        modbus_transmit();
+
+    // Queued requests are completed before this, the core keeps running while waiting.
+    if(block) {
+        while(result == 0) {
+            tick();
+            grbl.on_execute_delay(state);
+        }
+    }
+
+    return !block || result == 1;
+}
+
+// Blocking requests flushed fail.
+void modbus_flush_queue (void)
+{
+    while(modbus.n) {
+        if(modbus.queue[modbus.head].caller)
+            *modbus.queue[modbus.head].result = -1;
+        modbus.head = (modbus.head + 1) % MOCK_MODBUS_QUEUE;
+        modbus.n--;
+    }
+
+    modbus.state = ModBus_Idle;
+}
+
+void modbus_set_silence (const modbus_silence_timeout_t *silence)
+{
+    modbus.silence = silence;
+}
+
+/*
+ * Handlers not claimed by the plugins.
+ */
+
+// Drivers apply the settings at the end of setup, plugins wrapping driver_setup see spindles registered on settings changed.
+static bool driver_setup (settings_t *settings)
+{
+    hal.settings_changed(settings, (settings_changed_flags_t){ .spindle = On });
+
+    return true;
+}
+
+static void driver_reset (void)
+{
+}
+
+static void settings_changed (settings_t *settings, settings_changed_flags_t changed)
+{
+    uint_fast8_t idx;
+
+    for(idx = 0; idx < n_spindle1_changed; idx++)
+        spindle1_changed[idx](&spindle1);
+}
+
+static void on_execute_realtime (uint_fast16_t state)
+{
+}
+
+static void on_report_options (bool newopt)
+{
+}
+
+static void on_realtime_report (stream_write_ptr stream_write, report_tracking_flags_t report)
+{
+}
+
+static uint32_t get_elapsed_ticks (void)
+{
+    return (uint32_t)(now_us / 1000);
+}
+
+/*
+ * Test interface.
+ */
+
+// Initializes the core and the plugins as on power up, spindle_type is the default spindle, $395.
+// Plugins cannot be initialized again, tests needing a fresh start are run in separate processes.
+void mock_init (spindle_id_t spindle_type)
+{
+    uint_fast8_t idx;
+
+    now_us = 1000000;
+    state = STATE_IDLE;
+    spindles.null_id = -1;
+    nvs.next = MOCK_NVS_CORE;
+    core.baud_rate = 3;
+    core.rx_timeout = 50;
+    core.spindle_type = (uint8_t)spindle_type;
+
+    for(idx = 0; idx < MOCK_DIGITAL_PORTS; idx++)
+        digital_out.xbar[idx].id = idx;
+
+    for(idx = 0; idx < MOCK_ANALOG_PORTS; idx++) {
+        analog_out.xbar[idx].id = idx;
+        analog_out.xbar[idx].cap.pwm = On;
+        analog_out.xbar[idx].config = analog_config;
+    }
+
+    hal.info = "Mock";
+    hal.get_elapsed_ticks = get_elapsed_ticks;
+    hal.driver_setup = driver_setup;
+    hal.driver_reset = driver_reset;
+    hal.settings_changed = settings_changed;
+    hal.nvs.memcpy_from_nvs = memcpy_from_nvs;
+    hal.nvs.memcpy_to_nvs = memcpy_to_nvs;
+    hal.stream.write = stream_write;
+    hal.stepper.enable = stepper_enable;
+    hal.stepper.claim_motor = stepper_claim_motor;
+
+    grbl.on_execute_realtime = grbl.on_execute_delay = on_execute_realtime;
+    grbl.on_report_options = on_report_options;
+    grbl.on_realtime_report = on_realtime_report;
+    grbl.enqueue_realtime_command = enqueue_realtime_command;
+
+    sys.cold_start = true;
+    sys.override.feed_rate = 100;
+
+    settings.spindle.at_speed_tolerance = 0.0f;
+    settings.pwm_spindle.pwm_freq = 5000.0f;
+    for(idx = 0; idx < N_AXIS; idx++) {
+        settings.axis[idx].steps_per_mm = 200.0f;
+        settings.axis[idx].max_rate = 3000.0f;
+        settings.axis[idx].acceleration = 50.0f;
+    }
+
+    spindle1.port_on = 2;           // ports 0 and 1 are taken by the on/off spindle
+    spindle1.port_dir = 3;
+    spindle1.port_pwm = 0;
+    spindle1.cfg.rpm_min = 0.0f;
+    spindle1.cfg.rpm_max = 1000.0f;
+    spindle1.cfg.pwm_freq = 5000.0f;
+    spindle1.cfg.pwm_max_value = 100.0f;
+
+    settings_register(&core_details);
+
+#if SPINDLE_ENABLE & (1<<SPINDLE_PWM0)
+    spindle_register(&pwm0_spindle, "PWM");
+#endif
+
+    // Plugins are initialized in the order of grbl/plugins_init.h.
+
+#if SPINDLE_ENABLE & ((1<<SPINDLE_ONOFF1)|(1<<SPINDLE_ONOFF1_DIR))
+    extern void onoff_spindle_init (void);
+    onoff_spindle_init();
+#endif
+
+#if SPINDLE_ENABLE & ((1<<SPINDLE_PWM2)|(1<<SPINDLE_PWM2_NODIR))
+    extern void pwm_spindle_init (void);
+    pwm_spindle_init();
+#endif
+
+#if (SPINDLE_ENABLE & (1<<SPINDLE_PWM0)) && (SPINDLE_ENABLE & (1<<SPINDLE_PWM0_CLONE))
+    extern void cloned_spindle_init (void);
+    cloned_spindle_init();
+#endif
+
+#if SPINDLE_ENABLE & (1<<SPINDLE_STEPPER)
+    extern void stepper_spindle_init (void);
+    stepper_spindle_init();
+#endif
+
+#if VFD_ENABLE
+    extern void vfd_init (void);
+    vfd_init();
+#endif
+
+#if N_SPINDLE > 1
+    extern void spindle_select_init (void);
+    spindle_select_init();
+#endif
+
+#if SPINDLE_OFFSET == 1
+    extern void spindle_offset_init (void);
+    spindle_offset_init();
+#endif
+
+    // Settings are loaded after all plugins are initialized, then the driver is set up.
+
+    mock_settings_load();
+
+    hal.driver_setup(&settings);
+
+    spindle_select(spindle_get_default());
+
+    sys.driver_started = true;
+
+    for(idx = 0; idx < tasks.n_startup; idx++)
+        tasks.startup[idx].fn(tasks.startup[idx].data);
+
+    tasks.n_startup = 0;
+}
+
+// Loads settings from NVS as on power up.
+void mock_settings_load (void)
+{
+    setting_details_t *details = setting_details;
+
+    while(details) {
+        if(details->load)
+            details->load();
+        details = details->next;
+    }
+}
+
+// Advances time in 1 ms ticks, running the ModBus transport, foreground tasks and realtime handlers.
+void mock_run (uint32_t ms)
+{
+    while(ms--) {
+        tick();
+        tasks_execute();
+        grbl.on_execute_realtime(state);
+    }
+}
+
+uint64_t mock_time_us (void)
+{
+    return now_us;
+}
+
+void mock_set_state (sys_state_t new_state)
+{
+    state = new_state;
+}
+
+alarm_code_t mock_alarm (void)
+{
+    return alarm;
+}
+
+char mock_realtime_command (void)
+{
+    char c = realtime_command;
+
+    realtime_command = 0;
+
+    return c;
+}
+
+const char *mock_output (void)
+{
+    return output;
+}
+
+void mock_output_clear (void)
+{
+    *output = '\0';
+}
+
+// Executes a system command such as "$VFDBAUD=9600", returns Status_InvalidStatement if not found.
+status_code_t mock_command (const char *command)
+{
+    char cmd[64], *args;
+    uint_fast8_t idx;
+    sys_commands_t *cmds = commands;
+
+    if(*command == '$')
+        command++;
+
+    if(strlen(command) >= sizeof(cmd))
+        return Status_InvalidStatement;
+
+    if((args = strchr(strcpy(cmd, command), '=')))
+        *args++ = '\0';
+
+    while(cmds) {
+        for(idx = 0; idx < cmds->n_commands; idx++) {
+            if(!strcmp(cmds->commands[idx].command, cmd)) {
+                if(cmds->commands[idx].flags.noargs && args)
+                    return Status_InvalidStatement;
+                return cmds->commands[idx].execute(state, args);
+            }
+        }
+        cmds = cmds->next;
+    }
+
+    return Status_InvalidStatement;
+}
+
+// Validates and executes a user M-code as the parser does.
+status_code_t mock_user_mcode (parser_block_t *block)
+{
+    status_code_t status;
+
+    if(grbl.user_mcode.check == NULL || grbl.user_mcode.check(block->user_mcode) == UserMCode_Unsupported)
+        return Status_GcodeValueOutOfRange;
+
+    if((status = grbl.user_mcode.validate(block)) == Status_OK)
+        grbl.user_mcode.execute(state, block);
+
+    return status;
+}
+
+void mock_tool_select (tool_id_t tool_id)
+{
+    tool_data_t tool = { .tool_id = tool_id };
+
+    if(grbl.on_tool_selected)
+        grbl.on_tool_selected(&tool);
+}
+
+void mock_report_options (void)
+{
+    grbl.on_report_options(false);
+}
+
+void mock_realtime_report (void)
+{
+    grbl.on_realtime_report(hal.stream.write, (report_tracking_flags_t){0});
+}
+
+// Sets the state of the current spindle as M3, M4, M5 and S do.
+void mock_spindle_set_state (spindle_state_t state, float rpm)
+{
+    spindle_ptrs_t *spindle;
+
+    if((spindle = spindle_get(0)))
+        spindle->set_state(spindle, state, state.on ? rpm : 0.0f);
+}
+
+// Waits for the current spindle to report at speed as the core does after a synchronized spindle command.
+bool mock_spindle_at_speed (uint32_t timeout_ms)
+{
+    spindle_ptrs_t *spindle;
+
+    if((spindle = spindle_get(0)) == NULL || !spindle->cap.at_speed)
+        return true;
+
+    while(!spindle->get_state(spindle).at_speed) {
+        if(timeout_ms-- == 0)
+            return false;
+        mock_run(1);
+    }
+
+    return true;
+}
+
+bool mock_digital_out (uint8_t port)
+{
+    return port < MOCK_DIGITAL_PORTS && digital_out.value[port];
+}
+
+float mock_analog_out (uint8_t port)
+{
+    return port < MOCK_ANALOG_PORTS ? analog_out.value[port] : 0.0f;
+}
+
+bool mock_motor_claimed (uint_fast8_t axis_idx)
+{
+    return axis_idx < N_AXIS && motor_claimed[axis_idx];
+}
+
+void mock_vfs_root (const char *path)
+{
+    vfs_root = path;
+}
+
+void mock_modbus_device (mock_modbus_device_ptr device)
+{
+    modbus.device = device;
+}
+
+mock_modbus_stats_t *mock_modbus_stats (void)
+{
+    return &modbus.stats;
+}
+
+#endif // SPINDLE_HOST_TEST
@@ -0,0 +1,89 @@
+/*
+
+  test/mock/mock.h - functions for driving the grblHAL core mock from host tests
+
+  Part of grblHAL
+
+  Copyright (c) 2026 Terje Io
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+ * Time is simulated, it only advances in mock_run() and while a blocking ModBus request is waited for.
+ * Each 1 ms tick the ModBus transport, delayed and immediate foreground tasks and the realtime
+ * handlers are run in that order, as the core does from protocol_execute_realtime().
+ *
+ * The ModBus transport sends one frame at a time from a queue, waits the inter-frame silence set by
+ * modbus_set_silence() before each and times frames from the $374 baud rate, 8N1. What is on the bus
+ * is provided by a device function, requests are not answered if none is set. Reception of a response
+ * ends at the length expected by the request, see test/sim for VFD models.
+ */
+
+#ifndef _MOCK_H_
+#define _MOCK_H_
+
+#include "driver.h"
+
+#define MOCK_DIGITAL_PORTS 4
+#define MOCK_ANALOG_PORTS  2
+#define MOCK_OUTPUT_SIZE   4096
+
+// Called when a request has been transmitted, gap_us is the bus idle time before it.
+// Returns the time in us from the end of the request to the first byte of the response and
+// sets *rx_length to the response length, 0 if there is no response.
+typedef uint32_t (*mock_modbus_device_ptr)(const uint8_t *request, uint_fast8_t tx_length, uint8_t *response, uint_fast8_t *rx_length, uint32_t gap_us);
+
+typedef struct {
+    uint32_t frames;        // requests transmitted, including retries
+    uint32_t timeouts;
+    uint32_t exceptions;
+    uint32_t crc_errors;
+    uint64_t busy_us;       // time the bus has carried frames
+} mock_modbus_stats_t;
+
+void mock_init (spindle_id_t spindle_type);
+void mock_settings_load (void);
+void mock_run (uint32_t ms);
+uint64_t mock_time_us (void);
+void mock_set_state (sys_state_t state);
+alarm_code_t mock_alarm (void);
+char mock_realtime_command (void);
+
+const char *mock_output (void);
+void mock_output_clear (void);
+
+status_code_t mock_command (const char *command);
+status_code_t mock_user_mcode (parser_block_t *block);
+void mock_tool_select (tool_id_t tool_id);
+void mock_report_options (void);
+void mock_realtime_report (void);
+
+void mock_spindle_set_state (spindle_state_t state, float rpm);
+bool mock_spindle_at_speed (uint32_t timeout_ms);
+
+bool mock_digital_out (uint8_t port);
+float mock_analog_out (uint8_t port);
+bool mock_motor_claimed (uint_fast8_t axis_idx);
+
+void mock_vfs_root (const char *path);
+
+void mock_modbus_device (mock_modbus_device_ptr device);
+uint32_t mock_modbus_baud (void);
+uint16_t mock_modbus_silence (void);
+mock_modbus_stats_t *mock_modbus_stats (void);
+uint16_t mock_modbus_crc (const uint8_t *adu, uint_fast8_t length);
+
+#endif // _MOCK_H_
@@ -0,0 +1,5 @@
+/*
+  test/mock/spindle/shared.h - makes the plugin sources available as spindle/ for the host build
+*/
+
+#include "../../../shared.h"
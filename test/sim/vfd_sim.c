@@ -0,0 +1,570 @@
+/*
+
+  test/sim/vfd_sim.c - simulated RS485 bus with behavioural VFD models
+
+  Part of grblHAL
+
+  Copyright (c) 2026 Terje Io
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// SPINDLE_HOST_TEST is defined on the command line by test/CMakeLists.txt only.
+#if SPINDLE_HOST_TEST
+
+#include <math.h>
+
+#include "vfd_sim.h"
+#include "vfd/spindle.h"
+
+#define RPM_PER_HZ  60.0f
+#define DC_BUS_VOLTAGE 310.0f
+#define AC_VOLTAGE 220.0f
+#define TEMPERATURE 35
+
+#define FN(f) (1 << (f))
+
+typedef struct {
+    uint32_t functions;         // supported function codes, bit n for code n
+    uint32_t turnaround_us;
+    uint32_t silence_us;
+} vfd_model_t;
+
+static const vfd_model_t models[] = {
+    [VFDSim_Huanyang]    = { FN(1) | FN(2) | FN(3) | FN(4) | FN(5), 8000, 6000 }, // fails to respond if silence is < 6 ms
+    [VFDSim_HuanyangP2A] = { FN(ModBus_ReadHoldingRegisters) | FN(ModBus_WriteRegister), 5000, 0 },
+    [VFDSim_H100]        = { FN(ModBus_ReadHoldingRegisters) | FN(ModBus_ReadInputRegisters) | FN(ModBus_WriteCoil) | FN(ModBus_WriteRegister), 5000, 0 },
+    [VFDSim_GS20]        = { FN(ModBus_ReadHoldingRegisters) | FN(ModBus_WriteRegister) | FN(ModBus_WriteRegisters), 2000, 0 },
+    [VFDSim_YL620]       = { FN(ModBus_ReadHoldingRegisters) | FN(ModBus_WriteRegister), 5000, 0 },
+    [VFDSim_Nowforever]  = { FN(ModBus_ReadHoldingRegisters) | FN(ModBus_WriteRegisters), 5000, 0 },
+    [VFDSim_MODVFD]      = { FN(ModBus_ReadHoldingRegisters) | FN(ModBus_WriteRegister) | FN(ModBus_WriteRegisters), 2000, 0 }
+};
+
+static struct {
+    uint_fast8_t n;
+    vfd_sim_t *device[VFD_SIM_DEVICES];
+    vfd_sim_round_trip_t round_trip[ModBus_WriteRegisters + 1];
+} bus;
+
+static uint32_t frame_us (uint_fast8_t length)
+{
+    return (uint32_t)((uint64_t)length * 10 * 1000000 / mock_modbus_baud());
+}
+
+static uint32_t silence_us (vfd_sim_t *vfd)
+{
+    return vfd->config.silence_us ? vfd->config.silence_us : 35 * 1000000 / vfd->config.baud;
+}
+
+static float target (vfd_sim_t *vfd)
+{
+    return vfd->dir ? (float)vfd->dir * fminf(fmaxf(vfd->freq_set, vfd->config.freq_min), vfd->config.freq_max) : 0.0f;
+}
+
+// Ramps the output frequency to time t, reversing decelerates to 0 first.
+static void ramp (vfd_sim_t *vfd, uint64_t t)
+{
+    float to, rate, step, dt = t > vfd->updated ? (float)(t - vfd->updated) / 1000000.0f : 0.0f, freq = target(vfd);
+
+    while(dt > 0.0f && vfd->freq_out != freq) {
+        to = vfd->freq_out * freq < 0.0f ? 0.0f : freq;
+        rate = fabsf(to) > fabsf(vfd->freq_out) ? vfd->config.accel : vfd->config.decel;
+        if((step = fabsf(to - vfd->freq_out)) <= rate * dt) {
+            vfd->freq_out = to;
+            dt -= step / rate;
+        } else {
+            vfd->freq_out += to > vfd->freq_out ? rate * dt : -rate * dt;
+            dt = 0.0f;
+        }
+    }
+
+    vfd->updated = t;
+}
+
+static uint16_t units (float value, float units_per_unit)
+{
+    return (uint16_t)lroundf(fabsf(value) * units_per_unit);
+}
+
+static float amps (vfd_sim_t *vfd)
+{
+    return vfd->config.freq_max > 0.0f ? vfd->config.amps_max * fabsf(vfd->freq_out) / vfd->config.freq_max : 0.0f;
+}
+
+static void run (vfd_sim_t *vfd, int_fast8_t dir)
+{
+    vfd->dir = dir;
+    vfd->control_us = vfd->updated;
+}
+
+static void frequency (vfd_sim_t *vfd, float freq)
+{
+    vfd->freq_set = fminf(freq, vfd->config.freq_max);
+    vfd->frequency_us = vfd->updated;
+}
+
+/*
+ * Register maps, these follow the drivers in vfd/.
+ */
+
+// Sets *value to the content of a register, returns false if there is no such register.
+static bool read_register (vfd_sim_t *vfd, uint8_t function, uint16_t reg, uint16_t *value)
+{
+    bool ok = true;
+
+    switch(vfd->type) {
+
+        case VFDSim_HuanyangP2A:
+            switch(reg) {
+                case 0xB005: *value = units(vfd->config.freq_max, RPM_PER_HZ); break;  // max. RPM
+                case 0x700C: *value = units(vfd->freq_out, RPM_PER_HZ); break;         // output RPM
+                default: ok = false; break;
+            }
+            break;
+
+        case VFDSim_H100:
+            if(function == ModBus_ReadInputRegisters) switch(reg) {
+                case 0x0000: *value = units(vfd->freq_out, 10.0f); break;              // output frequency, 0.1 Hz
+                case 0x0001: *value = units(amps(vfd), 10.0f); break;                  // output current, 0.1 A
+                default: ok = false; break;
+            } else switch(reg) {
+                case 0x0005: *value = units(vfd->config.freq_max, 10.0f); break;       // PD05 max. frequency
+                case 0x000B: *value = units(vfd->config.freq_min, 10.0f); break;       // PD11 min. frequency
+                default: ok = false; break;
+            }
+            break;
+
+        case VFDSim_GS20:
+            switch(reg) {
+                case 0x0100: *value = units(vfd->config.freq_max, 100.0f); break;      // P01.00 max. frequency
+                case 0x010B: *value = units(vfd->config.freq_min, 100.0f); break;      // P01.11 min. frequency
+                case 0x0504: *value = 2; break;                                        // P05.04 motor poles
+                case 0x2100: *value = 0; break;                                        // error code
+                case 0x2101: *value = (vfd->dir ? 0x03 : 0x00) | (vfd->dir < 0 ? 0x18 : 0x00); break; // status
+                case 0x2102: *value = units(vfd->freq_set, 100.0f); break;             // frequency command
+                case 0x2103: *value = units(vfd->freq_out, 100.0f); break;             // output frequency
+                case 0x2104: *value = units(amps(vfd), 100.0f); break;                 // output current
+                case 0x2105: *value = units(DC_BUS_VOLTAGE, 10.0f); break;             // DC bus voltage
+                default: ok = false; break;
+            }
+            break;
+
+        case VFDSim_YL620:
+            switch(reg) {
+                case 0x0000: *value = units(vfd->config.freq_max, 100.0f); break;      // P00.00 main frequency
+                case 0x0308: *value = units(vfd->config.freq_min, 10.0f); break;       // P03.08 frequency lower limit
+                case 0x200A: *value = units(target(vfd), 10.0f); break;                // target frequency
+                case 0x200B: *value = units(vfd->freq_out, 10.0f); break;              // output frequency
+                case 0x200C: *value = units(amps(vfd), 10.0f); break;                  // output current
+                default: ok = false; break;
+            }
+            break;
+
+        case VFDSim_Nowforever:
+            switch(reg) {
+                case 0x0007: *value = units(vfd->config.freq_max, 100.0f); break;      // max. frequency
+                case 0x0008: *value = units(vfd->config.freq_min, 100.0f); break;      // min. frequency
+                case 0x0502: *value = units(vfd->freq_out, 100.0f); break;             // output frequency
+                default: ok = false; break;
+            }
+            break;
+
+        case VFDSim_MODVFD:
+            // RPM = value * $468 / $469
+            if((ok = reg == vfd_config.get_freq_reg && vfd_config.out_multiplier > 0.0f))
+                *value = units(vfd->freq_out * RPM_PER_HZ, vfd_config.out_divider / vfd_config.out_multiplier);
+            break;
+
+        default:
+            ok = false;
+            break;
+    }
+
+    return ok;
+}
+
+// Writes a register, returns an exception code, 0 if ok.
+static uint8_t write_register (vfd_sim_t *vfd, uint16_t reg, uint16_t value)
+{
+    uint8_t code = 0;
+
+    switch(vfd->type) {
+
+        case VFDSim_HuanyangP2A:
+            if(reg == 0x2000) switch(value) {
+                case 1: run(vfd, 1); break;
+                case 2: run(vfd, -1); break;
+                case 6: run(vfd, 0); break;
+                default: code = 3; break;
+            } else if(reg == 0x1000)
+                frequency(vfd, vfd->config.freq_max * (float)value / 10000.0f);        // 0.01% of max. frequency
+            else
+                code = 2;
+            break;
+
+        case VFDSim_H100:
+            if(reg == 0x0201)
+                frequency(vfd, (float)value / 10.0f);
+            else
+                code = 2;
+            break;
+
+        case VFDSim_GS20:
+        case VFDSim_YL620:
+            if(reg == 0x2000) switch(value) {
+                case 0x11: run(vfd, 0); break;
+                case 0x12: run(vfd, 1); break;
+                case 0x22: run(vfd, -1); break;
+                case 0x80: code = vfd->type == VFDSim_YL620 ? 0 : 3; break;             // YL620 reset all error flags
+                default: code = 3; break;
+            } else if(reg == 0x2001)
+                frequency(vfd, (float)value / (vfd->type == VFDSim_GS20 ? 100.0f : 10.0f));
+            else if(!(vfd->type == VFDSim_GS20 && reg == 0x2002))                      // GS20 fault reset
+                code = 2;
+            break;
+
+        case VFDSim_Nowforever:
+            if(reg == 0x0900) {
+                if(value & ~0x03)
+                    code = 3;
+                else
+                    run(vfd, value & 0x01 ? (value & 0x02 ? -1 : 1) : 0);
+            } else if(reg == 0x0901)
+                frequency(vfd, (float)value / 100.0f);
+            else
+                code = 2;
+            break;
+
+        case VFDSim_MODVFD:
+            if(reg == vfd_config.runstop_reg) {
+                if(value == vfd_config.run_cw_cmd)
+                    run(vfd, 1);
+                else if(value == vfd_config.run_ccw_cmd)
+                    run(vfd, -1);
+                else if(value == vfd_config.stop_cmd)
+                    run(vfd, 0);
+                else
+                    code = 3;
+            } else if(reg == vfd_config.set_freq_reg && vfd_config.in_multiplier > 0.0f) // value = RPM * $466 / $467
+                frequency(vfd, (float)value * vfd_config.in_divider / vfd_config.in_multiplier / RPM_PER_HZ);
+            else
+                code = 2;
+            break;
+
+        default:
+            code = 2;
+            break;
+    }
+
+    return code;
+}
+
+// H100 run commands are coils.
+static uint8_t write_coil (vfd_sim_t *vfd, uint16_t coil, uint16_t value)
+{
+    uint8_t code = 0;
+
+    if(value != 0xFF00)
+        code = 3;
+    else switch(coil) {
+        case 0x49: run(vfd, 1); break;
+        case 0x4A: run(vfd, -1); break;
+        case 0x4B: run(vfd, 0); break;
+        default: code = 2; break;
+    }
+
+    return code;
+}
+
+// YL620 P03.00 RS485 baud rate, applied after the response is sent.
+static uint32_t baud_code (vfd_sim_t *vfd, uint16_t reg, uint16_t value)
+{
+    static const uint32_t baud_rates[] = { 2400, 4800, 9600, 19200, 38400 };
+
+    return vfd->type == VFDSim_YL620 && reg == 0x0300 && value >= 1 && value <= 5 ? baud_rates[value - 1] : 0;
+}
+
+static uint_fast8_t exception (uint8_t *response, const uint8_t *request, uint8_t code)
+{
+    response[0] = request[0];
+    response[1] = request[1] | 0x80;
+    response[2] = code;
+
+    return 3;
+}
+
+/*
+ * Framing.
+ */
+
+// Huanyang v1: address, function, data length, data. Responses echo the request header.
+static uint_fast8_t huanyang_request (vfd_sim_t *vfd, const uint8_t *request, uint_fast8_t length, uint8_t *response, uint32_t *baud)
+{
+    static const uint32_t baud_rates[] = { 4800, 9600, 19200, 38400 };
+
+    uint16_t value = 0;
+    uint_fast8_t len = 0;
+
+    memcpy(response, request, length - 2);
+
+    switch(request[1]) {
+
+        case 0x01: // function read, PD number
+            if(request[2] == 3) {
+                switch(request[3]) {
+                    case 0x05: value = units(vfd->config.freq_max, 100.0f); break;                          // PD005 max. frequency
+                    case 0x0B: value = units(vfd->config.freq_min, 100.0f); break;                          // PD011 min. frequency
+                    case 0x0E: value = units(vfd->config.freq_max / vfd->config.accel, 10.0f); break;      // PD014 acceleration time
+                    case 0x0F: value = units(vfd->config.freq_max / vfd->config.decel, 10.0f); break;      // PD015 deceleration time
+                    case 0x8E: value = units(vfd->config.amps_max, 10.0f); break;                          // PD142 rated motor current
+                    case 0x90: value = units(50.0f, RPM_PER_HZ); break;                                    // PD144 RPM at 50 Hz
+                }
+                response[4] = value >> 8;
+                response[5] = value & 0xFF;
+                len = 6;
+            }
+            break;
+
+        case 0x02: // function write, PD number and value
+            if(request[2] == 3) {
+                if(request[3] == 0xA4 && request[4] == 0 && request[5] < sizeof(baud_rates) / sizeof(uint32_t))          // PD164 baud rate
+                    *baud = baud_rates[request[5]];
+                len = 6;
+            }
+            break;
+
+        case 0x03: // control write
+            if(request[2] == 1) {
+                switch(request[3]) {
+                    case 0x01: run(vfd, 1); break;
+                    case 0x08: run(vfd, 0); break;
+                    case 0x11: run(vfd, -1); break;
+                }
+                len = 4;
+            }
+            break;
+
+        case 0x04: // control status read, status index
+            if(request[2] == 3) {
+                switch(request[3]) {
+                    case 0: value = units(vfd->freq_set, 100.0f); break;
+                    case 1: value = units(vfd->freq_out, 100.0f); break;
+                    case 2: value = units(amps(vfd), 10.0f); break;
+                    case 3: value = units(vfd->freq_out, RPM_PER_HZ); break;
+                    case 4: value = units(DC_BUS_VOLTAGE, 10.0f); break;
+                    case 5: value = units(AC_VOLTAGE, 10.0f); break;
+                    case 7: value = TEMPERATURE; break;
+                }
+                response[4] = value >> 8;
+                response[5] = value & 0xFF;
+                len = 6;
+            }
+            break;
+
+        case 0x05: // frequency write, 0.01 Hz
+            if(request[2] == 2) {
+                frequency(vfd, (float)((request[3] << 8) | request[4]) / 100.0f);
+                len = 5;
+            }
+            break;
+    }
+
+    return len;
+}
+
+// ModBus RTU, the Huanyang P2A answers reads with an 8 byte frame holding the value in bytes 4 and 5.
+static uint_fast8_t modbus_request (vfd_sim_t *vfd, const uint8_t *request, uint_fast8_t length, uint8_t *response, uint32_t *baud)
+{
+    uint8_t code = 0;
+    uint16_t value, reg = (request[2] << 8) | request[3], n = (request[4] << 8) | request[5];
+    uint_fast8_t idx, len = 0;
+
+    switch(request[1]) {
+
+        case ModBus_ReadHoldingRegisters:
+        case ModBus_ReadInputRegisters:
+            if(n == 0 || n > 8)
+                code = 3;
+            else if(vfd->type == VFDSim_HuanyangP2A) {
+                if(read_register(vfd, request[1], reg, &value)) {
+                    memcpy(response, request, 2);
+                    response[2] = 0x04;
+                    response[3] = 0x00;
+                    response[4] = value >> 8;
+                    response[5] = value & 0xFF;
+                    len = 6;
+                } else
+                    code = 2;
+            } else {
+                memcpy(response, request, 2);
+                response[2] = n * 2;
+                for(idx = 0; idx < n && code == 0; idx++) {
+                    if(read_register(vfd, request[1], reg + idx, &value)) {
+                        response[3 + idx * 2] = value >> 8;
+                        response[4 + idx * 2] = value & 0xFF;
+                    } else
+                        code = 2;
+                }
+                len = 3 + n * 2;
+            }
+            break;
+
+        case ModBus_WriteCoil:
+            code = write_coil(vfd, reg, n);
+            len = 6;
+            break;
+
+        case ModBus_WriteRegister:
+            if((*baud = baud_code(vfd, reg, n)) == 0)
+                code = write_register(vfd, reg, n);
+            len = 6;
+            break;
+
+        case ModBus_WriteRegisters:
+            if(n == 0 || request[6] != n * 2 || length != 9 + n * 2)
+                code = 3;
+            else for(idx = 0; idx < n && code == 0; idx++)
+                code = write_register(vfd, reg + idx, (request[7 + idx * 2] << 8) | request[8 + idx * 2]);
+            len = 6;
+            break;
+    }
+
+    if(code)
+        len = exception(response, request, code);
+    else if(len == 6 && request[1] != ModBus_ReadHoldingRegisters && request[1] != ModBus_ReadInputRegisters)
+        memcpy(response, request, 6);
+
+    return len;
+}
+
+/*
+ * Bus.
+ */
+
+static uint32_t bus_device (const uint8_t *request, uint_fast8_t tx_length, uint8_t *response, uint_fast8_t *rx_length, uint32_t gap_us)
+{
+    uint16_t crc;
+    uint32_t baud = 0, round_trip;
+    uint_fast8_t idx, len;
+    vfd_sim_t *vfd = NULL;
+
+    *rx_length = 0;
+
+    for(idx = 0; idx < bus.n; idx++) {
+        if(bus.device[idx]->address == request[0])
+            vfd = bus.device[idx];
+    }
+
+    if(vfd == NULL)
+        return 0;
+
+    // Frames at another baud rate are garbage to the VFD, a request following the previous frame too closely is lost.
+    if(vfd->config.baud != mock_modbus_baud() || gap_us < silence_us(vfd) ||
+        mock_modbus_crc(request, tx_length - 2) != (request[tx_length - 2] | (request[tx_length - 1] << 8))) {
+        vfd->ignored++;
+        return 0;
+    }
+
+    vfd->requests++;
+    ramp(vfd, mock_time_us() + frame_us(tx_length));
+
+    if(vfd->exception.count && (vfd->exception.function == 0 || vfd->exception.function == request[1])) {
+        vfd->exception.count--;
+        vfd->exceptions++;
+        len = exception(response, request, vfd->exception.code);
+    } else if(!(models[vfd->type].functions & FN(request[1]))) {
+        vfd->exceptions++;
+        len = exception(response, request, 1);
+    } else if(vfd->type == VFDSim_Huanyang)
+        len = huanyang_request(vfd, request, tx_length, response, &baud);
+    else
+        len = modbus_request(vfd, request, tx_length, response, &baud);
+
+    if(len) {
+
+        crc = mock_modbus_crc(response, len);
+        response[len++] = crc & 0xFF;
+        response[len++] = crc >> 8;
+        *rx_length = len;
+
+        if(request[1] <= ModBus_WriteRegisters) {
+            round_trip = frame_us(tx_length) + vfd->config.turnaround_us + frame_us(len);
+            bus.round_trip[request[1]].n++;
+            bus.round_trip[request[1]].sum_us += round_trip;
+            bus.round_trip[request[1]].max_us = max(bus.round_trip[request[1]].max_us, round_trip);
+        }
+    }
+
+    if(baud)
+        vfd->config.baud = baud;
+
+    return vfd->config.turnaround_us;
+}
+
+void vfd_sim_init (vfd_sim_t *vfd, vfd_sim_type_t type, uint8_t address)
+{
+    memset(vfd, 0, sizeof(vfd_sim_t));
+
+    vfd->type = type;
+    vfd->address = address;
+    vfd->config.baud = 19200;       // $374 default
+    vfd->config.turnaround_us = models[type].turnaround_us;
+    vfd->config.silence_us = models[type].silence_us;
+    vfd->config.accel = vfd->config.decel = 100.0f;
+    vfd->config.freq_max = 400.0f;
+    vfd->config.amps_max = 10.0f;
+    vfd->updated = mock_time_us();
+}
+
+// Attaches a VFD to the bus, the first call installs the bus as the ModBus device of the core mock.
+bool vfd_sim_attach (vfd_sim_t *vfd)
+{
+    bool ok;
+
+    if((ok = bus.n < VFD_SIM_DEVICES)) {
+        if(bus.n == 0)
+            mock_modbus_device(bus_device);
+        bus.device[bus.n++] = vfd;
+    }
+
+    return ok;
+}
+
+// Answers the next count requests with the given function code, 0 for any, with an exception.
+void vfd_sim_inject (vfd_sim_t *vfd, uint8_t function, uint8_t code, uint32_t count)
+{
+    vfd->exception.function = function;
+    vfd->exception.code = code;
+    vfd->exception.count = count;
+}
+
+void vfd_sim_update (vfd_sim_t *vfd)
+{
+    ramp(vfd, mock_time_us());
+}
+
+bool vfd_sim_at_speed (vfd_sim_t *vfd)
+{
+    vfd_sim_update(vfd);
+
+    return vfd->freq_out == target(vfd);
+}
+
+const vfd_sim_round_trip_t *vfd_sim_round_trip (uint8_t function)
+{
+    return function <= ModBus_WriteRegisters ? &bus.round_trip[function] : NULL;
+}
+
+#endif // SPINDLE_HOST_TEST
@@ -0,0 +1,100 @@
+/*
+
+  test/sim/vfd_sim.h - simulated RS485 bus with behavioural VFD models
+
+  Part of grblHAL
+
+  Copyright (c) 2026 Terje Io
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+ * VFDs attached to the bus answer requests addressed to them from the ModBus transport of the core mock.
+ *
+ * Each model implements the register map and framing of a driver in vfd/, including the non-standard
+ * Huanyang v1 frames, and has a baud rate, a turnaround delay and a min. bus silence before a request.
+ * Requests sent at another baud rate or too early after the previous frame are not seen by the VFD.
+ * The output frequency ramps at the acceleration and deceleration rates towards the set frequency, also
+ * when reversing. Exceptions can be injected for a number of requests with a given function code.
+ *
+ * Per function code round trip times, from the start of a request to the end of the response, are
+ * recorded for all VFDs on the bus.
+ */
+
+#ifndef _VFD_SIM_H_
+#define _VFD_SIM_H_
+
+#include "mock.h"
+
+#define VFD_SIM_DEVICES 4
+
+typedef enum {
+    VFDSim_Huanyang = 0,
+    VFDSim_HuanyangP2A,
+    VFDSim_H100,
+    VFDSim_GS20,
+    VFDSim_YL620,
+    VFDSim_Nowforever,
+    VFDSim_MODVFD
+} vfd_sim_type_t;
+
+typedef struct {
+    uint32_t baud;              // baud rate the VFD is set to
+    uint32_t turnaround_us;     // from the end of a request to the first byte of the response
+    uint32_t silence_us;        // min. bus idle time before a request, 0 for 3.5 characters
+    float accel;                // Hz/s
+    float decel;                // Hz/s
+    float freq_min;             // Hz
+    float freq_max;             // Hz
+    float amps_max;             // output current at max. frequency, A
+} vfd_sim_config_t;
+
+typedef struct {
+    uint8_t function;           // function code to answer with an exception, 0 for any
+    uint8_t code;
+    uint32_t count;             // number of requests left to answer with the exception
+} vfd_sim_exception_t;
+
+typedef struct {
+    vfd_sim_type_t type;
+    uint8_t address;
+    vfd_sim_config_t config;
+    vfd_sim_exception_t exception;
+    int_fast8_t dir;            // 1 forward, -1 reverse, 0 stopped
+    float freq_set;             // Hz
+    float freq_out;             // Hz, negative when reversing
+    uint64_t updated;           // time of the last output frequency update
+    uint32_t requests;          // requests seen
+    uint32_t ignored;           // requests not seen, baud rate mismatch or bus silence too short
+    uint32_t exceptions;        // exception responses sent
+    uint64_t control_us;        // end of the last control command, 0 if none
+    uint64_t frequency_us;      // end of the last frequency command, 0 if none
+} vfd_sim_t;
+
+typedef struct {
+    uint32_t n;
+    uint64_t sum_us;
+    uint32_t max_us;
+} vfd_sim_round_trip_t;
+
+void vfd_sim_init (vfd_sim_t *vfd, vfd_sim_type_t type, uint8_t address);
+bool vfd_sim_attach (vfd_sim_t *vfd);
+void vfd_sim_inject (vfd_sim_t *vfd, uint8_t function, uint8_t code, uint32_t count);
+void vfd_sim_update (vfd_sim_t *vfd);
+bool vfd_sim_at_speed (vfd_sim_t *vfd);
+const vfd_sim_round_trip_t *vfd_sim_round_trip (uint8_t function);
+
+#endif // _VFD_SIM_H_
@@ -0,0 +1,65 @@
+/*
+
+  test/test.h - checks and test runner for the host tests
+
+  Part of grblHAL
+
+  Copyright (c) 2026 Terje Io
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _TEST_H_
+#define _TEST_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+static int failed = 0;
+
+#define CHECK(c) do { if(!(c)) { printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #c); failed++; } } while(0)
+
+// Runs a test in a child process so that it starts from power up, plugins can only be initialized once.
+static void test_run (const char *name, void (*test)(void))
+{
+    int status;
+    pid_t pid;
+
+    fflush(stdout);
+
+    if((pid = fork()) == 0) {
+        failed = 0;
+        test();
+        fflush(stdout);
+        _exit(failed ? 1 : 0);
+    }
+
+    if(pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status)) {
+        printf("%s failed\n", name);
+        failed++;
+    }
+}
+
+static int test_result (void)
+{
+    if(failed)
+        printf("%d test(s) failed\n", failed);
+
+    return failed ? 1 : 0;
+}
+
+#endif // _TEST_H_
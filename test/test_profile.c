@@ -0,0 +1,183 @@
+/*
+
+  test/test_profile.c - host tests for VFD profiles loaded from data/vfd_profiles.txt
+
+  Part of grblHAL
+
+  Copyright (c) 2026 Terje Io
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// SPINDLE_HOST_TEST is defined on the command line by test/CMakeLists.txt only.
+#if SPINDLE_HOST_TEST
+
+#include "test.h"
+#include "mock.h"
+#include "vfd/spindle.h"
+
+/*
+ * VFD with holding and input registers, the output frequency follows the set frequency at once.
+ */
+
+static struct {
+    uint16_t holding[0x3000];
+    uint16_t input[0x3000];
+    uint8_t last_function;
+} vfd;
+
+static uint32_t vfd_device (const uint8_t *request, uint_fast8_t tx_length, uint8_t *response, uint_fast8_t *rx_length, uint32_t gap_us)
+{
+    uint_fast8_t idx, len;
+    uint16_t reg = (request[2] << 8) | request[3], n = (request[4] << 8) | request[5], *regs = NULL;
+
+    vfd.last_function = request[1];
+
+    memcpy(response, request, 6);
+    len = 6;
+
+    switch(request[1]) {
+
+        case ModBus_ReadHoldingRegisters:
+        case ModBus_ReadInputRegisters:
+            regs = request[1] == ModBus_ReadHoldingRegisters ? vfd.holding : vfd.input;
+            response[2] = n * 2;
+            for(idx = 0; idx < n; idx++) {
+                response[3 + idx * 2] = regs[reg + idx] >> 8;
+                response[4 + idx * 2] = regs[reg + idx] & 0xFF;
+            }
+            len = 3 + n * 2;
+            break;
+
+        case ModBus_WriteRegister:
+            vfd.holding[reg] = n;
+            break;
+
+        case ModBus_WriteRegisters:
+            for(idx = 0; idx < n; idx++)
+                vfd.holding[reg + idx] = (request[7 + idx * 2] << 8) | request[8 + idx * 2];
+            break;
+    }
+
+    // Output frequency in both register types.
+    vfd.holding[0x2100] = vfd.input[0x2100] = vfd.holding[0x2000] == 0x12 ? vfd.holding[0x2001] : 0;
+
+    uint16_t crc = mock_modbus_crc(response, len);
+
+    response[len++] = crc & 0xFF;
+    response[len++] = crc >> 8;
+    *rx_length = len;
+
+    return 2000;
+}
+
+static spindle_id_t find_spindle (const char *name)
+{
+    spindle_id_t idx = spindle_get_count();
+
+    while(idx--) {
+        if(!strcmp(spindle_get_name(idx), name))
+            return idx;
+    }
+
+    return -1;
+}
+
+static void init (void)
+{
+    vfd.holding[0x0100] = 20000;    // max. frequency 200.00 Hz
+
+    mock_vfs_root("data");
+    mock_modbus_device(vfd_device);
+    mock_init(0);
+    mock_run(10);
+}
+
+// Valid profiles are added as spindles, the first three invalid are reported with line number and reason.
+static void test_load (void)
+{
+    spindle_id_t id;
+
+    init();
+
+    CHECK(spindle_get_count() == 5);
+    CHECK((id = find_spindle("Acme X1")) >= 0 && spindle_get_hal(id, SpindleHAL_Raw)->ref_id == 40);
+    CHECK((id = find_spindle("Acme X2")) >= 0 && spindle_get_hal(id, SpindleHAL_Raw)->ref_id == 48);
+    CHECK(find_spindle("Acme X3") == -1);
+
+    CHECK(strstr(mock_output(), "/vfd_profiles.txt line 19: unknown key or invalid value for speed, VFD profile Broken skipped") != NULL);
+    CHECK(strstr(mock_output(), "/vfd_profiles.txt line 21: frequency missing or invalid function code, VFD profile No frequency skipped") != NULL);
+    CHECK(strstr(mock_output(), "/vfd_profiles.txt line 36: max. number of profiles loaded, VFD profile Acme X3 skipped") != NULL);
+
+    mock_output_clear();
+    mock_report_options();
+    CHECK(strstr(mock_output(), "[PLUGIN:VFD profile vAcme X1]") != NULL);
+}
+
+// Register map, scaling and parameters are taken from the profile.
+static void test_run_x1 (void)
+{
+    spindle_ptrs_t *spindle;
+
+    init();
+
+    CHECK(spindle_select(find_spindle("Acme X1")));
+    CHECK((spindle = spindle_get(0)) && spindle->rpm_max == 12000.0f);
+
+    mock_spindle_set_state((spindle_state_t){ .on = On }, 6000.0f);
+    mock_run(200);
+
+    CHECK(vfd.holding[0x2000] == 0x12 && vfd.holding[0x2001] == 10000);
+    CHECK(vfd.last_function == ModBus_ReadHoldingRegisters);
+    CHECK(fabsf(vfd_get_telemetry(spindle->id)->rpm - 6000.0f) < 1.0f);
+
+    mock_spindle_set_state((spindle_state_t){0}, 0.0f);
+    mock_run(10);
+
+    CHECK(vfd.holding[0x2000] == 1);
+    CHECK(mock_alarm() == Alarm_None);
+}
+
+// Run and frequency are combined when write_multiple is set, telemetry is read from input registers.
+static void test_run_x2 (void)
+{
+    spindle_ptrs_t *spindle;
+
+    init();
+
+    CHECK(spindle_select(find_spindle("Acme X2")));
+    spindle = spindle_get(0);
+
+    mock_spindle_set_state((spindle_state_t){ .on = On }, 6000.0f);
+    mock_run(10);
+
+    CHECK(vfd.holding[0x2000] == 0x12 && vfd.holding[0x2001] == 10000);
+    CHECK(mock_modbus_stats()->frames == 1);
+
+    mock_run(200);
+    CHECK(vfd.last_function == ModBus_ReadInputRegisters);
+    CHECK(fabsf(vfd_get_telemetry(spindle->id)->rpm - 6000.0f) < 1.0f);
+}
+
+int main (void)
+{
+    test_run("load", test_load);
+    test_run("run_x1", test_run_x1);
+    test_run("run_x2", test_run_x2);
+
+    return test_result();
+}
+
+#endif // SPINDLE_HOST_TEST
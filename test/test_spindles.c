@@ -0,0 +1,249 @@
+/*
+
+  test/test_spindles.c - host tests for the non VFD spindles, spindle selection and the spindle offset
+
+  Part of grblHAL
+
+  Copyright (c) 2026 Terje Io
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// SPINDLE_HOST_TEST is defined on the command line by test/CMakeLists.txt only.
+#if SPINDLE_HOST_TEST
+
+#include "test.h"
+#include "mock.h"
+
+/*
+ * Spindles are registered in plugin init order:
+ *   0: PWM0 from the driver, laser capable
+ *   1: cloned PWM0
+ *   2: stepper, axis N_AXIS - 1
+ *   3: on/off, ports 0 (on) and 1 (dir)
+ *   4: PWM2, analog port 0 and ports 2 (on) and 3 (dir)
+ */
+
+#define SPINDLE_ID_PWM0     0
+#define SPINDLE_ID_CLONE    1
+#define SPINDLE_ID_STEPPER  2
+#define SPINDLE_ID_ONOFF    3
+#define SPINDLE_ID_PWM2     4
+
+static void init (spindle_id_t spindle_type)
+{
+    mock_init(spindle_type);
+    mock_run(10);
+}
+
+static spindle_ptrs_t *select_spindle (spindle_id_t id)
+{
+    spindle_ptrs_t *spindle;
+
+    CHECK(spindle_select(id));
+    CHECK((spindle = spindle_get(0)) && spindle->id == id);
+
+    return spindle;
+}
+
+static void test_register (void)
+{
+    static const char *names[] = { "PWM", "Cloned PWM spindle", "Stepper", "On/off spindle", "PWM2" };
+
+    spindle_id_t idx;
+
+    init(0);
+
+    CHECK(spindle_get_count() == sizeof(names) / sizeof(char *));
+    for(idx = 0; idx < spindle_get_count(); idx++)
+        CHECK(!strcmp(spindle_get_name(idx), names[idx]));
+
+    CHECK(mock_alarm() == Alarm_None);
+    CHECK(strstr(mock_output(), "failed") == NULL);
+}
+
+static void test_onoff (void)
+{
+    init(0);
+    select_spindle(SPINDLE_ID_ONOFF);
+
+    mock_spindle_set_state((spindle_state_t){ .on = On }, 1000.0f);
+    CHECK(mock_digital_out(0) && !mock_digital_out(1));
+
+    mock_spindle_set_state((spindle_state_t){ .on = On, .ccw = On }, 1000.0f);
+    CHECK(mock_digital_out(0) && mock_digital_out(1));
+
+    mock_spindle_set_state((spindle_state_t){0}, 0.0f);
+    CHECK(!mock_digital_out(0));
+    CHECK(!mock_digital_out(2) && !mock_digital_out(3));
+}
+
+static void test_pwm2 (void)
+{
+    spindle_ptrs_t *spindle;
+
+    init(0);
+    spindle = select_spindle(SPINDLE_ID_PWM2);
+
+    CHECK(spindle->cap.direction && spindle->rpm_max == 1000.0f);
+
+    mock_spindle_set_state((spindle_state_t){ .on = On, .ccw = On }, 500.0f);
+    CHECK(mock_digital_out(2) && mock_digital_out(3));
+    CHECK(mock_analog_out(0) == 500.0f);
+
+    spindle->update_rpm(spindle, 750.0f);
+    CHECK(mock_analog_out(0) == 750.0f);
+
+    mock_spindle_set_state((spindle_state_t){0}, 0.0f);
+    CHECK(!mock_digital_out(2) && mock_analog_out(0) == 0.0f);
+    CHECK(!mock_digital_out(0) && !mock_digital_out(1));
+}
+
+// The clone drives the PWM0 direction pin as its enable, PWM0 runs with the direction pin as enable when selected.
+static void test_clone (void)
+{
+    spindle_ptrs_t *pwm0, *spindle;
+
+    init(0);
+    pwm0 = spindle_get_hal(SPINDLE_ID_PWM0, SpindleHAL_Raw);
+    spindle = select_spindle(SPINDLE_ID_PWM0);
+
+    CHECK(!spindle->cap.direction);
+
+    mock_spindle_set_state((spindle_state_t){ .on = On }, 500.0f);
+    CHECK(!pwm0->get_state(pwm0).on && pwm0->get_state(pwm0).ccw);
+    CHECK(spindle->get_state(spindle).on);
+
+    spindle = select_spindle(SPINDLE_ID_CLONE);
+    CHECK(spindle->cap.cloned && !spindle->cap.laser && spindle->context.pwm);
+
+    mock_spindle_set_state((spindle_state_t){ .on = On, .ccw = On }, 500.0f);
+    CHECK(pwm0->get_state(pwm0).on && !pwm0->get_state(pwm0).ccw);
+}
+
+// The stepper ramps at the axis acceleration, the motor is only released for axis motion when stopped.
+static void test_stepper (void)
+{
+    spindle_ptrs_t *spindle;
+
+    init(0);
+
+    settings.spindle.at_speed_tolerance = 1.0f;
+    CHECK(settings_store_setting(Setting_StepperSpindle_Options, "1") == Status_OK);
+
+    spindle = select_spindle(SPINDLE_ID_STEPPER);
+    CHECK(spindle->rpm_max == settings.axis[N_AXIS - 1].max_rate);
+    CHECK(!mock_motor_claimed(N_AXIS - 1));
+
+    mock_spindle_set_state((spindle_state_t){ .on = On }, 1500.0f);
+    CHECK(mock_motor_claimed(N_AXIS - 1));
+    CHECK(!spindle->get_state(spindle).at_speed);
+
+    // 1500 RPM at 3000 RPM/s.
+    CHECK(mock_spindle_at_speed(2000));
+    CHECK(mock_time_us() >= 1000000 + 500000);
+    CHECK(spindle->get_data(SpindleData_RPM)->rpm == 1500.0f);
+
+    mock_spindle_set_state((spindle_state_t){0}, 0.0f);
+    CHECK(mock_motor_claimed(N_AXIS - 1));
+
+    mock_run(1000);
+    CHECK(!mock_motor_claimed(N_AXIS - 1));
+}
+
+// M104 Q<n> selects the spindle bound to spindle setting n, M104 P0 the default spindle.
+static void test_select_mcode (void)
+{
+    parser_block_t block = { .user_mcode = Spindle_Select, .words.q = On, .values.q = 1.0f };
+
+    init(0);
+
+    CHECK(settings_store_setting(Setting_SpindleEnableBase + 1, "4") == Status_OK);  // on/off spindle
+    CHECK(settings_store_setting(Setting_SpindleEnableBase + 1, "1") == Status_InvalidStatement);
+    CHECK(settings_store_setting(Setting_SpindleEnableBase + 1, "6") == Status_SettingValueOutOfRange);
+
+    CHECK(mock_user_mcode(&block) == Status_OK);
+    CHECK(spindle_get(0)->id == SPINDLE_ID_ONOFF);
+
+    block = (parser_block_t){ .user_mcode = Spindle_Select, .words.p = On, .values.p = 0.0f };
+    CHECK(mock_user_mcode(&block) == Status_OK);
+    CHECK(spindle_get(0)->id == SPINDLE_ID_PWM0);
+
+    block = (parser_block_t){ .user_mcode = Spindle_Select, .words.q = On, .values.q = 2.0f };
+    CHECK(mock_user_mcode(&block) == Status_GcodeValueOutOfRange);
+
+    block = (parser_block_t){ .user_mcode = Spindle_Select, .words.p = On, .words.q = On, .values.p = 0.0f, .values.q = 1.0f };
+    CHECK(mock_user_mcode(&block) == Status_GcodeValueOutOfRange);
+
+    mock_output_clear();
+    mock_report_options();
+    CHECK(strstr(mock_output(), "[SPINDLE:PWM]") != NULL);
+}
+
+// Tool numbers from the tool number start setting and up select the bound spindle.
+static void test_select_tool (void)
+{
+    init(0);
+
+    CHECK(settings_store_setting(Setting_SpindleEnableBase + 1, "5") == Status_OK);  // PWM2
+    CHECK(settings_store_setting(Setting_SpindleToolStartBase + 1, "10") == Status_OK);
+
+    mock_tool_select(12);
+    CHECK(spindle_get(0)->id == SPINDLE_ID_PWM2);
+
+    mock_tool_select(3);
+    CHECK(spindle_get(0)->id == SPINDLE_ID_PWM0);
+
+    mock_tool_select(10);
+    CHECK(spindle_get(0)->id == SPINDLE_ID_PWM2);
+}
+
+// Selecting a non default laser spindle moves by the offset, reselecting the default spindle moves back.
+static void test_offset (void)
+{
+    init(SPINDLE_ID_STEPPER);
+
+    CHECK(settings_store_setting(Setting_SpindleOffsetX, "10") == Status_OK);
+    CHECK(settings_store_setting(Setting_SpindleOffsetY, "-5") == Status_OK);
+    CHECK(settings_store_setting(Setting_SpindleOffsetOptions, "1") == Status_OK);
+
+    select_spindle(SPINDLE_ID_PWM0);
+    CHECK(sys.position[0] == 2000 && sys.position[1] == -1000);
+    CHECK(gc_state.g92_offset.coord.values[0] == 10.0f && gc_state.g92_offset.coord.values[1] == -5.0f);
+
+    select_spindle(SPINDLE_ID_STEPPER);
+    CHECK(sys.position[0] == 0 && sys.position[1] == 0);
+    CHECK(gc_state.g92_offset.coord.values[0] == 0.0f && gc_state.g92_offset.coord.values[1] == 0.0f);
+
+    // Not a laser spindle, no move.
+    select_spindle(SPINDLE_ID_ONOFF);
+    CHECK(sys.position[0] == 0 && sys.position[1] == 0);
+}
+
+int main (void)
+{
+    test_run("register", test_register);
+    test_run("onoff", test_onoff);
+    test_run("pwm2", test_pwm2);
+    test_run("clone", test_clone);
+    test_run("stepper", test_stepper);
+    test_run("select_mcode", test_select_mcode);
+    test_run("select_tool", test_select_tool);
+    test_run("offset", test_offset);
+
+    return test_result();
+}
+
+#endif // SPINDLE_HOST_TEST
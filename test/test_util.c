@@ -0,0 +1,201 @@
+/*
+
+  test/test_util.c - host tests for the VFD protocol engine helpers
+
+  Part of grblHAL
+
+  Copyright (c) 2026 Terje Io
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// SPINDLE_HOST_TEST is defined on the command line by test/CMakeLists.txt only.
+#if SPINDLE_HOST_TEST
+
+#include <math.h>
+
+#include "test.h"
+#include "vfd/util.h"
+
+#define CHECK_NEAR(a, b) CHECK(fabsf((float)(a) - (float)(b)) < 0.01f)
+
+static void test_factor (void)
+{
+    uint32_t freq;
+    vfd_factor_t set, get;
+
+    // 100 frequency register units per Hz, 60 RPM per Hz.
+    vfd_factor_set(&set, 100, 60 << VFD_RPM_FRAC_BITS);
+    vfd_factor_set(&get, 60 << VFD_RPM_FRAC_BITS, 100);
+
+    CHECK(vfd_factor_apply(&set, 24000 << VFD_RPM_FRAC_BITS) == 40000);
+    CHECK(vfd_factor_apply(&get, 40000) == 24000 << VFD_RPM_FRAC_BITS);
+    CHECK(vfd_factor_apply(&set, 0) == 0);
+
+    // Frequencies converted to RPM and back are unchanged.
+    for(freq = 0; freq <= 60000; freq++) {
+        if(vfd_factor_apply(&set, vfd_factor_apply(&get, freq)) != freq) {
+            CHECK(vfd_factor_apply(&set, vfd_factor_apply(&get, freq)) == freq);
+            break;
+        }
+    }
+
+    // Ratios > 1 reduce the shift.
+    vfd_factor_set(&get, 1 << VFD_RPM_FRAC_BITS, 1);
+    CHECK(get.shift < 32);
+    CHECK(vfd_factor_apply(&get, 1000) == 1000 << VFD_RPM_FRAC_BITS);
+
+    // Results are saturated.
+    CHECK(vfd_factor_apply(&get, 0xFFFFFFFF) == 0xFFFFFFFF);
+
+    // Unknown ratios result in 0.
+    vfd_factor_set(&set, 100, 0);
+    CHECK(set.mul == 0 && vfd_factor_apply(&set, 1000) == 0);
+    vfd_factor_set(&set, 0, 100);
+    CHECK(set.mul == 0 && vfd_factor_apply(&set, 1000) == 0);
+}
+
+static void test_ramp (void)
+{
+    vfd_ramp_t ramp = {0};
+
+    // No estimate before the first reading.
+    CHECK_NEAR(vfd_ramp_estimate(&ramp, 10000.0f, 500), 0.0f);
+
+    vfd_ramp_update(&ramp, 0.0f, 10000.0f, 9900.0f, 10100.0f, 1000);
+    CHECK_NEAR(ramp.accel, 0.0f);
+    CHECK_NEAR(vfd_ramp_estimate(&ramp, 10000.0f, 2000), 0.0f);
+
+    // Acceleration is learned from the first ramping interval.
+    vfd_ramp_update(&ramp, 2000.0f, 10000.0f, 9900.0f, 10100.0f, 2000);
+    CHECK_NEAR(ramp.accel, 2000.0f);
+    CHECK_NEAR(vfd_ramp_estimate(&ramp, 10000.0f, 3000), 4000.0f);
+    CHECK_NEAR(vfd_ramp_estimate(&ramp, 10000.0f, 10000), 10000.0f);
+
+    // Readings at speed do not change the rate, the deviation is filtered into the offset.
+    vfd_ramp_update(&ramp, 10050.0f, 10000.0f, 9900.0f, 10100.0f, 7000);
+    CHECK_NEAR(ramp.accel, 2000.0f);
+    CHECK_NEAR(ramp.offset, 50.0f * VFD_RPM_FILTER);
+    CHECK_NEAR(vfd_ramp_estimate(&ramp, 10000.0f, 8000), 10050.0f);
+
+    // Deceleration is learned when stopping, then averaged.
+    vfd_ramp_update(&ramp, 8000.0f, 0.0f, 0.0f, 0.0f, 8000);
+    CHECK_NEAR(ramp.decel, 2050.0f);
+    CHECK_NEAR(vfd_ramp_estimate(&ramp, 0.0f, 9000), 5950.0f);
+    CHECK_NEAR(vfd_ramp_estimate(&ramp, 0.0f, 20000), 0.0f);
+
+    vfd_ramp_update(&ramp, 6000.0f, 0.0f, 0.0f, 0.0f, 9000);
+    CHECK_NEAR(ramp.decel, 2050.0f + (2000.0f - 2050.0f) * VFD_RAMP_LEARN_RATE);
+    CHECK_NEAR(ramp.accel, 2000.0f);
+
+    // Readings moving away from the target are not learned from.
+    vfd_ramp_update(&ramp, 7000.0f, 0.0f, 0.0f, 0.0f, 10000);
+    CHECK_NEAR(ramp.accel, 2000.0f);
+}
+
+static void test_freq_changed (void)
+{
+    CHECK(vfd_freq_changed(0, 100, 10));
+    CHECK(vfd_freq_changed(100, 0, 10));
+    CHECK(!vfd_freq_changed(100, 100, 10));
+    CHECK(!vfd_freq_changed(100, 110, 10));
+    CHECK(!vfd_freq_changed(100, 90, 10));
+    CHECK(vfd_freq_changed(100, 111, 10));
+    CHECK(vfd_freq_changed(100, 89, 10));
+    CHECK(vfd_freq_changed(100, 101, 0));
+}
+
+static void test_parse_values (void)
+{
+    int32_t values[3];
+    char s1[] = "1, 2 ,3", s2[] = " 0x2000,010", s3[] = "-5 ", s4[] = "1,2", s5[] = "1", s6[] = "abc", s7[] = "0X1f", s8[] = "1;2";
+
+    CHECK(vfd_parse_values(s1, values, 3) && values[0] == 1 && values[1] == 2 && values[2] == 3);
+    CHECK(vfd_parse_values(s2, values, 2) && values[0] == 0x2000 && values[1] == 10);
+    CHECK(vfd_parse_values(s3, values, 1) && values[0] == -5);
+    CHECK(!vfd_parse_values(s4, values, 1));
+    CHECK(!vfd_parse_values(s5, values, 2));
+    CHECK(!vfd_parse_values(s6, values, 1));
+    CHECK(vfd_parse_values(s7, values, 1) && values[0] == 31);
+    CHECK(!vfd_parse_values(s8, values, 2));
+}
+
+static void test_register_value (void)
+{
+    uint32_t value;
+
+    // GS20 telemetry block response, 6 registers from 0x2100: fault, status, -, frequency, current and DC bus voltage.
+    static const uint8_t gs20[] = { 0x01, 0x03, 12, 0x00, 0x05, 0x00, 0x12, 0x00, 0x00, 0x0F, 0xA0, 0x00, 0xC8, 0x0C, 0x1C };
+
+    CHECK(vfd_register_value(gs20, 0, 1, false, &value) && value == 0x0005);
+    CHECK(vfd_register_value(gs20, 1, 1, false, &value) && value == 0x0012);
+    CHECK(vfd_register_value(gs20, 3, 1, false, &value) && value == 4000);
+    CHECK(vfd_register_value(gs20, 4, 1, false, &value) && value == 200);
+    CHECK(vfd_register_value(gs20, 5, 1, false, &value) && value == 3100);
+    CHECK(!vfd_register_value(gs20, 6, 1, false, &value));
+
+    // Truncated response, byte count for 2 registers only.
+    static const uint8_t gs20_short[] = { 0x01, 0x03, 4, 0x00, 0x05, 0x00, 0x12 };
+
+    CHECK(vfd_register_value(gs20_short, 1, 1, false, &value) && value == 0x0012);
+    CHECK(!vfd_register_value(gs20_short, 3, 1, false, &value));
+
+    // 32 bit values, frequency 1000.00 Hz followed by current 12.34 A.
+    static const uint8_t msw[] = { 0x01, 0x03, 8, 0x00, 0x01, 0x86, 0xA0, 0x00, 0x00, 0x04, 0xD2 };
+    static const uint8_t lsw[] = { 0x01, 0x03, 8, 0x86, 0xA0, 0x00, 0x01, 0x04, 0xD2, 0x00, 0x00 };
+
+    CHECK(vfd_register_value(msw, 0, 2, false, &value) && value == 100000);
+    CHECK(vfd_register_value(msw, 2, 2, false, &value) && value == 1234);
+    CHECK(vfd_register_value(lsw, 0, 2, true, &value) && value == 100000);
+    CHECK(vfd_register_value(lsw, 2, 2, true, &value) && value == 1234);
+    CHECK(vfd_register_value(msw, 1, 2, false, &value) && value == 0x86A00000);
+    CHECK(!vfd_register_value(msw, 3, 2, false, &value));
+}
+
+static void test_backoff (void)
+{
+    uint_fast8_t failures;
+    uint32_t backoff = 500;
+
+    // Retry delay, 100 ms doubled per consecutive failure up to 1000 ms.
+    static const uint32_t retry[] = { 100, 200, 400, 800, 1000, 1000 };
+
+    for(failures = 0; failures < sizeof(retry) / sizeof(retry[0]); failures++)
+        CHECK(vfd_backoff(100, failures, 1000) == retry[failures]);
+
+    // Health probe interval while the circuit breaker is open, doubled per probe up to 8000 ms.
+    static const uint32_t probe[] = { 1000, 2000, 4000, 8000, 8000 };
+
+    for(failures = 0; failures < sizeof(probe) / sizeof(probe[0]); failures++)
+        CHECK((backoff = vfd_backoff(backoff, 1, 8000)) == probe[failures]);
+
+    CHECK(vfd_backoff(100, 255, 1000) == 1000);
+    CHECK(vfd_backoff(0x90000000, 1, 0xFFFFFFFF) == 0xFFFFFFFF);
+    CHECK(vfd_backoff(2000, 0, 1000) == 1000);
+}
+
+int main (void)
+{
+    test_run("factor", test_factor);
+    test_run("ramp", test_ramp);
+    test_run("freq_changed", test_freq_changed);
+    test_run("parse_values", test_parse_values);
+    test_run("register_value", test_register_value);
+    test_run("backoff", test_backoff);
+
+    return test_result();
+}
+
+#endif // SPINDLE_HOST_TEST
@@ -0,0 +1,328 @@
+/*
+
+  test/test_vfd.c - host tests for the VFD plugin, run against the grblHAL core mock
+
+  Part of grblHAL
+
+  Copyright (c) 2026 Terje Io
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// SPINDLE_HOST_TEST is defined on the command line by test/CMakeLists.txt only.
+#if SPINDLE_HOST_TEST
+
+#include "test.h"
+#include "mock.h"
+#include "vfd/spindle.h"
+
+/*
+ * GS20 register map subset, output frequency ramps at 100 Hz/s.
+ */
+
+static struct {
+    bool online;
+    uint8_t exception;      // exception code returned for writes, 0 for none
+    uint16_t control;
+    uint16_t freq_set;      // 0.01 Hz
+    float freq_out;         // 0.01 Hz
+    uint64_t updated;
+    uint32_t writes;
+    uint8_t address;        // address of last request
+} gs20;
+
+static void gs20_reset (void)
+{
+    memset(&gs20, 0, sizeof(gs20));
+    gs20.online = true;
+    gs20.control = 0x11;
+}
+
+static void gs20_update (void)
+{
+    float target = gs20.control == 0x11 ? 0.0f : (float)gs20.freq_set, step = (float)(mock_time_us() - gs20.updated) / 100.0f;
+
+    gs20.freq_out = gs20.freq_out < target ? fminf(target, gs20.freq_out + step) : fmaxf(target, gs20.freq_out - step);
+    gs20.updated = mock_time_us();
+}
+
+static uint16_t gs20_read (uint16_t reg)
+{
+    switch(reg) {
+        case 0x0100: return 40000;     // max. frequency 400.00 Hz
+        case 0x010B: return 0;         // min. frequency
+        case 0x0504: return 2;         // motor poles
+        case 0x2103: return (uint16_t)lroundf(gs20.freq_out);
+        case 0x2104: return gs20.control == 0x11 ? 0 : 250;
+    }
+
+    return 0;
+}
+
+static bool gs20_write (uint16_t reg, uint16_t value)
+{
+    switch(reg) {
+        case 0x2000: gs20.control = value; break;
+        case 0x2001: gs20.freq_set = value; break;
+        case 0x2002: break;
+        default: return false;
+    }
+
+    gs20.writes++;
+
+    return true;
+}
+
+static uint_fast8_t exception (uint8_t *response, const uint8_t *request, uint8_t code)
+{
+    response[0] = request[0];
+    response[1] = request[1] | 0x80;
+    response[2] = code;
+
+    return 3;
+}
+
+static uint32_t gs20_device (const uint8_t *request, uint_fast8_t tx_length, uint8_t *response, uint_fast8_t *rx_length, uint32_t gap_us)
+{
+    uint_fast8_t idx, len = 0;
+    uint16_t reg = (request[2] << 8) | request[3], n = (request[4] << 8) | request[5];
+
+    gs20.address = request[0];
+
+    if(!gs20.online || request[0] != vfd_config.modbus_address[0])
+        return *rx_length = 0;
+
+    gs20_update();
+
+    switch(request[1]) {
+
+        case ModBus_ReadHoldingRegisters:
+            response[0] = request[0];
+            response[1] = request[1];
+            response[2] = n * 2;
+            for(idx = 0; idx < n; idx++) {
+                uint16_t value = gs20_read(reg + idx);
+                response[3 + idx * 2] = value >> 8;
+                response[4 + idx * 2] = value & 0xFF;
+            }
+            len = 3 + n * 2;
+            break;
+
+        case ModBus_WriteRegister:
+            if(gs20.exception)
+                len = exception(response, request, gs20.exception);
+            else if(!gs20_write(reg, n))
+                len = exception(response, request, 2);
+            else {
+                memcpy(response, request, 6);
+                len = 6;
+            }
+            break;
+
+        case ModBus_WriteRegisters:
+            if(gs20.exception)
+                len = exception(response, request, gs20.exception);
+            else {
+                for(idx = 0; idx < n; idx++)
+                    gs20_write(reg + idx, (request[7 + idx * 2] << 8) | request[8 + idx * 2]);
+                memcpy(response, request, 6);
+                len = 6;
+            }
+            break;
+
+        default:
+            len = exception(response, request, 1);
+            break;
+    }
+
+    uint16_t crc = mock_modbus_crc(response, len);
+
+    response[len++] = crc & 0xFF;
+    response[len++] = crc >> 8;
+    *rx_length = len;
+
+    return 5000;
+}
+
+static spindle_id_t find_spindle (const char *name)
+{
+    spindle_id_t idx = spindle_get_count();
+
+    while(idx--) {
+        if(!strcmp(spindle_get_name(idx), name))
+            return idx;
+    }
+
+    return -1;
+}
+
+// GS20 is spindle 3, the default spindle.
+static spindle_id_t gs20_select (void)
+{
+    spindle_id_t id;
+
+    gs20_reset();
+    mock_modbus_device(gs20_device);
+    mock_init(3);
+
+    settings.spindle.at_speed_tolerance = 5.0f;
+    hal.settings_changed(&settings, (settings_changed_flags_t){ .spindle = On });
+
+    CHECK((id = find_spindle("Durapulse GS20")) == 3);
+    CHECK(spindle_select(id));
+    mock_run(10);
+
+    return id;
+}
+
+// All drivers are registered and reported.
+static void test_drivers (void)
+{
+    static const char *plugins[] = {
+        "HUANYANG VFD", "HUANYANG P2A VFD", "Durapulse VFD GS20", "Yalang VFD YL620A", "MODVFD", "H-100 VFD", "Nowforever VFD"
+    };
+
+    uint_fast8_t idx;
+
+    mock_init(0);
+    mock_report_options();
+
+    CHECK(spindle_get_count() == 8);
+    for(idx = 0; idx < sizeof(plugins) / sizeof(char *); idx++)
+        CHECK(strstr(mock_output(), plugins[idx]) != NULL);
+}
+
+// Each driver sends requests addressed to the VFD on M3 and fails when there is no response.
+static spindle_id_t driver_id;
+
+static void test_driver_no_response (void)
+{
+    spindle_ptrs_t *spindle;
+
+    gs20_reset();
+    gs20.online = false;
+    mock_modbus_device(gs20_device);
+    mock_init(0);
+
+    CHECK(spindle_select(driver_id));
+    CHECK((spindle = spindle_get(0)) && spindle->type == SpindleType_VFD);
+
+    mock_spindle_set_state((spindle_state_t){ .on = On }, 12000.0f);
+    mock_run(2000);
+
+    CHECK(mock_modbus_stats()->frames > 0);
+    CHECK(gs20.address == 1);
+    CHECK(mock_modbus_stats()->timeouts > 0);
+    CHECK(mock_alarm() == Alarm_ModbusException);
+}
+
+static void test_gs20_run (void)
+{
+    spindle_id_t id = gs20_select();
+    spindle_ptrs_t *spindle = spindle_get(0);
+    vfd_telemetry_t *telemetry = vfd_get_telemetry(id);
+
+    // Max. frequency read from the VFD, 400 Hz at 60 RPM/Hz.
+    CHECK(spindle && spindle->id == id);
+    CHECK(spindle->rpm_max == 24000.0f);
+
+    mock_spindle_set_state((spindle_state_t){ .on = On }, 12000.0f);
+    mock_run(10);
+
+    // Run and frequency written by a single Write Multiple Registers command.
+    CHECK(gs20.control == 0x12 && gs20.freq_set == 20000);
+    CHECK(gs20.writes == 2 && mock_modbus_stats()->frames >= 4);
+
+    CHECK(!spindle->get_state(spindle).at_speed);
+    CHECK(mock_spindle_at_speed(5000));
+    CHECK(mock_time_us() > 2000000);
+    CHECK(telemetry && telemetry->updates > 0 && fabsf(telemetry->rpm - 12000.0f) < 600.0f);
+    CHECK(telemetry->amps == 2.5f);
+
+    // Speed change, the frequency only is written.
+    spindle->update_rpm(spindle, 6000.0f);
+    mock_run(10);
+    CHECK(gs20.freq_set == 10000 && gs20.control == 0x12);
+    CHECK(mock_spindle_at_speed(5000));
+
+    mock_spindle_set_state((spindle_state_t){ .ccw = On, .on = On }, 6000.0f);
+    mock_run(10);
+    CHECK(gs20.control == 0x22);
+
+    mock_spindle_set_state((spindle_state_t){0}, 0.0f);
+    mock_run(10);
+    CHECK(gs20.control == 0x11);
+    CHECK(!spindle->get_state(spindle).on);
+    CHECK(mock_alarm() == Alarm_None);
+
+    mock_output_clear();
+    CHECK(mock_command("$VFDINFO") == Status_OK);
+    CHECK(strstr(mock_output(), "[VFDINFO:") != NULL);
+
+    mock_output_clear();
+    CHECK(mock_command("$VFDSTATS") == Status_OK);
+    CHECK(strstr(mock_output(), "|control|") != NULL);
+    CHECK(mock_command("$VFDSTATS=X") == Status_InvalidStatement);
+}
+
+// An exception response to a command raises an alarm.
+static void test_gs20_exception (void)
+{
+    gs20_select();
+
+    gs20.exception = 4;
+    mock_spindle_set_state((spindle_state_t){ .on = On }, 12000.0f);
+    mock_run(500);
+
+    CHECK(mock_modbus_stats()->exceptions > 0);
+    CHECK(mock_alarm() == Alarm_ModbusException);
+}
+
+// The ModBus address setting is used for requests.
+static void test_gs20_address (void)
+{
+    gs20_select();
+
+    CHECK(settings_store_setting(Setting_VFD_ModbusAddress0, "5") == Status_OK);
+    CHECK(vfd_config.modbus_address[0] == 5);
+    CHECK(settings_store_setting(Setting_VFD_ModbusAddress0, "256") == Status_SettingValueOutOfRange);
+
+    CHECK(spindle_select(spindle_get(0)->id));
+    mock_spindle_set_state((spindle_state_t){ .on = On }, 12000.0f);
+    mock_run(100);
+
+    CHECK(gs20.address == 5 && gs20.control == 0x12);
+
+    // The setting is saved to NVS.
+    vfd_config.modbus_address[0] = 1;
+    mock_settings_load();
+    CHECK(vfd_config.modbus_address[0] == 5);
+}
+
+int main (void)
+{
+    test_run("drivers", test_drivers);
+
+    for(driver_id = 1; driver_id < 8; driver_id++)
+        test_run("driver_no_response", test_driver_no_response);
+
+    test_run("gs20_run", test_gs20_run);
+    test_run("gs20_exception", test_gs20_exception);
+    test_run("gs20_address", test_gs20_address);
+
+    return test_result();
+}
+
+#endif // SPINDLE_HOST_TEST
@@ -25,292 +25,56 @@
 
 #if SPINDLE_ENABLE & (1<<SPINDLE_H100)
 
-#include <math.h>
-#include <string.h>
-
 #include "spindle.h"
 
-static uint32_t modbus_address, freq_min = 0, freq_max = 0, exceptions = 0;
-static spindle_id_t spindle_id = -1;
-static spindle_ptrs_t *spindle_hal = NULL;
-static spindle_state_t spindle_state = {0};
-static spindle_data_t spindle_data = {0};
-static vfd_state_t vfd_state;
-static on_spindle_selected_ptr on_spindle_selected;
-static on_report_options_ptr on_report_options;
-static settings_changed_ptr settings_changed;
-static driver_reset_ptr driver_reset;
-
-static void rx_packet (modbus_message_t *msg);
-static void rx_exception (uint8_t code, void *context);
-
-static const modbus_callbacks_t callbacks = {
-    .retries = VFD_RETRIES,
-    .retry_delay = VFD_RETRY_DELAY,
-    .on_rx_packet = rx_packet,
-    .on_rx_exception = rx_exception
-};
-
-// Read min and max configured frequency from spindle
-static void get_rpm_range (void *data)
-{
-    modbus_message_t cmd = {
-        .context = (void *)VFD_GetMinRPM,
-        .adu[0] = modbus_address,
-        .adu[1] = ModBus_ReadHoldingRegisters,
-        .adu[2] = 0x00,
-        .adu[3] = 0x0B, // PD11
-        .adu[4] = 0x00,
-        .adu[5] = 0x01,
-        .tx_length = 8,
-        .rx_length = 7
-    };
-
-    if(modbus_send(&cmd, &callbacks, true)) {
-
-        cmd.context = (void *)VFD_GetMaxRPM;
-        cmd.adu[3] = 0x05; // PD05
-
-        modbus_send(&cmd, &callbacks, true);
-    }
-}
-
-static void set_rpm (float rpm, bool block)
-{
-    static uint8_t busy = 0;
-
-    if(busy && !block)
-        return;
-
-    if(rpm != spindle_data.rpm_programmed) {
-
-        uint16_t freq = (uint16_t)(rpm * 0.167f); // * 10.0f / 60.0f
-
-        freq = min(max(freq, freq_min), freq_max);
-
-        modbus_message_t rpm_cmd = {
-            .context = (void *)VFD_SetRPM,
-            .crc_check = false,
-            .adu[0] = modbus_address,
-            .adu[1] = ModBus_WriteRegister,
-            .adu[2] = 0x02,
-            .adu[3] = 0x01,
-            .adu[4] = freq >> 8,
-            .adu[5] = freq & 0xFF,
-            .tx_length = 8,
-            .rx_length = 8
-        };
-
-        busy++;
-        modbus_send(&rpm_cmd, &callbacks, block);
-        spindle_set_at_speed_range(spindle_hal, &spindle_data, rpm);
-        busy--;
-    }
-}
-
-static void spindleUpdateRPM (spindle_ptrs_t *spindle, float rpm)
-{
-    UNUSED(spindle);
-
-    set_rpm(rpm, false);
-}
-
-// Start or stop spindle
-static void spindleSetState (spindle_ptrs_t *spindle, spindle_state_t state, float rpm)
-{
-    UNUSED(spindle);
-
-    static bool busy = false;
-
-    if(busy)
-        return;
-
-    if(state.on && vfd_state != VFD_Ready)
-        get_rpm_range(NULL);
-
-    modbus_message_t mode_cmd = {
-        .context = (void *)VFD_SetStatus,
-        .crc_check = false,
-        .adu[0] = modbus_address,
-        .adu[1] = ModBus_WriteCoil,
-        .adu[2] = 0x00,
-        .adu[3] = (!state.on || rpm == 0.0f) ? 0x4B : (state.ccw ? 0x4A : 0x49),
-        .adu[4] = 0xFF,
-        .tx_length = 8,
-        .rx_length = 8
-    };
-
-    busy = true;
-
-    if(spindle_state.ccw != state.ccw)
-        spindle_data.rpm_programmed = -1.0f;
-
-    spindle_state.on = state.on;
-    spindle_state.ccw = state.ccw;
-
-    if(modbus_send(&mode_cmd, &callbacks, true))
-        set_rpm(rpm, true);
-
-    busy = false;
-}
-
-// Returns spindle state in a spindle_state_t variable
-static spindle_state_t spindleGetState (spindle_ptrs_t *spindle)
-{
-    UNUSED(spindle);
-
-    if(vfd_state != VFD_Ready)
-        return spindle_state;
-
-    modbus_message_t mode_cmd = {
-        .context = (void *)VFD_GetRPM,
-        .crc_check = false,
-        .adu[0] = modbus_address,
-        .adu[1] = ModBus_ReadInputRegisters,
-        .adu[2] = 0x00,
-        .adu[3] = 0x00,
-        .adu[4] = 0x00,
-        .adu[5] = 0x02,
-        .tx_length = 8,
-        .rx_length = 9
-    };
-
-    modbus_send(&mode_cmd, &callbacks, false);
-
-    spindle_state.at_speed = spindle->get_data(SpindleData_AtSpeed)->state_programmed.at_speed;
-
-    return spindle_state; // return previous state as we do not want to wait for the response
-}
-
-static spindle_data_t *spindleGetData (spindle_data_request_t request)
-{
-    return &spindle_data;
-}
-
-static float f2rpm (uint16_t f)
-{
-    return (float)f * 6.0f; // * 60.0f / 10.0f
-}
-
-static void rx_packet (modbus_message_t *msg)
-{
-    if(!(msg->adu[0] & 0x80)) {
-
-        switch((vfd_response_t)msg->context) {
-
-            case VFD_GetRPM:
-                exceptions = 0;
-                spindle_validate_at_speed(spindle_data, f2rpm((msg->adu[3] << 8) | msg->adu[4]));
-                break;
-
-            case VFD_GetMinRPM:
-                freq_min = (msg->adu[3] << 8) | msg->adu[4];
-                break;
-
-            case VFD_GetMaxRPM:
-                freq_max = (msg->adu[3] << 8) | msg->adu[4];
-                spindle_hal->cap.rpm_range_locked = On;
-                spindle_hal->rpm_min = f2rpm(freq_min);
-                spindle_hal->rpm_max = f2rpm(freq_max);
-                vfd_state = VFD_Ready;
-                break;
-
-            default:
-                break;
-        }
-    }
-}
-
-static void rx_exception (uint8_t code, void *context)
-{
-    if((vfd_response_t)context != VFD_GetRPM || ++exceptions == VFD_ASYNC_EXCEPTION_LEVEL) {
-        exceptions = 0;
-        vfd_failed(false);
-    }
-}
-
-static void onReportOptions (bool newopt)
-{
-    on_report_options(newopt);
-
-    if(!newopt)
-        report_plugin("H-100 VFD", "0.09");
-}
-
-static void onDriverReset (void)
-{
-    driver_reset();
-
-    if(spindle_hal)
-        task_add_delayed(get_rpm_range, NULL, 200);
-}
-
-static bool spindleConfig (spindle_ptrs_t *spindle)
-{
-    return modbus_isup().rtu;
-}
-
-static void onSpindleSelected (spindle_ptrs_t *spindle)
-{
-    if(spindle->id == spindle_id) {
-
-        spindle_data.rpm_programmed = -1.0f;
-        vfd_atspeed_configure((spindle_hal = spindle), &spindle_data);
-
-        modbus_set_silence(NULL);
-        modbus_address = vfd_get_modbus_address(spindle_id);
-
-        get_rpm_range(NULL);
-
-    } else
-        spindle_hal = NULL;
-
-    if(on_spindle_selected)
-        on_spindle_selected(spindle);
-}
-
-static void settingsChanged (settings_t *settings, settings_changed_flags_t changed)
-{
-    settings_changed(settings, changed);
-
-    if(changed.spindle)
-        spindle_get_hal(spindle_id, SpindleHAL_Configured)->at_speed_tolerance = vfd_atspeed_configure(spindle_hal, &spindle_data);
-}
-
 void vfd_h100_init (void)
 {
-    static const vfd_spindle_ptrs_t vfd = {
-        .spindle = {
-            .type = SpindleType_VFD,
-            .ref_id = SPINDLE_H100,
-            .cap = {
-                .variable = On,
-                .at_speed = On,
-                .direction = On,
-                .cmd_controlled = On
-            },
-            .config = spindleConfig,
-            .set_state = spindleSetState,
-            .get_state = spindleGetState,
-            .update_rpm = spindleUpdateRPM,
-            .get_data = spindleGetData,
-        }
+    // Min and max configured frequency, PD11 and PD05
+    // PD05 is read first, it validates cached parameters
+    static const vfd_param_read_t params[] = {
+        { .function = ModBus_ReadHoldingRegisters, .address = 0x0005, .n_regs = 1, .param = { VFD_Param_MaxFreq } },
+        { .function = ModBus_ReadHoldingRegisters, .address = 0x000B, .n_regs = 1, .param = { VFD_Param_MinFreq } }
     };
 
-    if((spindle_id = vfd_register(&vfd, "H-100")) != -1) {
-
-        on_spindle_selected = grbl.on_spindle_selected;
-        grbl.on_spindle_selected = onSpindleSelected;
-
-        settings_changed = hal.settings_changed;
-        hal.settings_changed = settingsChanged;
-
-        on_report_options = grbl.on_report_options;
-        grbl.on_report_options = onReportOptions;
+    static const vfd_driver_t driver = {
+        .name = "H-100",
+        .plugin = "H-100 VFD",
+        .version = "0.11",
+        .ref_id = SPINDLE_H100,
+        .protocol = VFD_Protocol_ModBus,
+        .control = {
+            .function = ModBus_WriteCoil,
+            .stop = 0x4B,
+            .cw = 0x49,
+            .ccw = 0x4A
+        },
+        .frequency = {
+            .function = ModBus_WriteRegister,
+            .address = 0x0201
+        },
+        .scaling = {
+            .source = VFD_Scaling_Fixed,
+            .units_per_hz = 10,
+            .rpm_per_hz = 60
+        },
+        // Output frequency (0.1 Hz)
+        .telemetry = {
+            .function = ModBus_ReadInputRegisters,
+            .address = 0x0000,
+            .n_regs = 2,
+            .freq = 0,
+            .amps = -1,
+            .status = -1,
+            .fault = -1,
+            .power = -1,
+            .voltage = -1,
+            .temp = -1
+        },
+        .n_params = sizeof(params) / sizeof(vfd_param_read_t),
+        .params = params
+    };
 
-        driver_reset = hal.driver_reset;
-        hal.driver_reset = onDriverReset;
-    }
+    vfd_register_driver(&driver);
 }
 
 #endif
@@ -25,276 +25,53 @@
 
 #if SPINDLE_ENABLE & (1<<SPINDLE_HUANYANG2)
 
-#include <math.h>
-#include <string.h>
-
 #include "spindle.h"
 
-static uint32_t modbus_address, rpm_max = 0, exceptions = 0;
-static spindle_id_t spindle_id = -1;
-static spindle_ptrs_t *spindle_hal = NULL;
-static spindle_state_t spindle_state = {0};
-static spindle_data_t spindle_data = {0};
-static vfd_state_t vfd_state;
-
-static on_report_options_ptr on_report_options;
-static on_spindle_selected_ptr on_spindle_selected;
-static settings_changed_ptr settings_changed;
-static driver_reset_ptr driver_reset;
-
-static void rx_exception (uint8_t code, void *context);
-static void rx_packet (modbus_message_t *msg);
-
-static const modbus_callbacks_t callbacks = {
-    .retries = VFD_RETRIES,
-    .retry_delay = VFD_RETRY_DELAY,
-    .on_rx_packet = rx_packet,
-    .on_rx_exception = rx_exception
-};
-
-// Read maximum configured RPM from spindle, value is used later for calculating current RPM
-// In the case of the original Huanyang protocol, the value is the configured RPM at 50Hz
-static void get_rpm_max (void *data)
-{
-    modbus_message_t cmd = {
-        .context = (void *)VFD_GetMaxRPM,
-        .adu[0] = modbus_address,
-        .adu[1] = ModBus_ReadHoldingRegisters,
-        .adu[2] = 0xB0,
-        .adu[3] = 0x05,
-        .adu[4] = 0x00,
-        .adu[5] = 0x02,
-        .tx_length = 8,
-        .rx_length = 8
-    };
-
-    modbus_set_silence(NULL);
-    modbus_send(&cmd, &callbacks, true);
-}
-
-static void set_rpm (float rpm, bool block)
-{
-    static uint8_t busy = 0;
-
-    if(busy && !block)
-        return;
-
-    if(rpm_max && rpm != spindle_data.rpm_programmed) {
-
-        uint16_t data = (uint32_t)(rpm) * 10000UL / rpm_max;
-
-        modbus_message_t rpm_cmd = {
-            .context = (void *)VFD_SetRPM,
-            .crc_check = false,
-            .adu[0] = modbus_address,
-            .adu[1] = ModBus_WriteRegister,
-            .adu[2] = 0x10,
-            .adu[4] = data >> 8,
-            .adu[5] = data & 0xFF,
-            .tx_length = 8,
-            .rx_length = 8
-        };
-
-        busy++;
-        modbus_send(&rpm_cmd, &callbacks, block);
-        spindle_set_at_speed_range(spindle_hal, &spindle_data, rpm);
-        busy--;
-    }
-}
-
-static void spindleUpdateRPM (spindle_ptrs_t *spindle, float rpm)
-{
-    UNUSED(spindle);
-
-    set_rpm(rpm, false);
-}
-
-// Start or stop spindle
-static void spindleSetState (spindle_ptrs_t *spindle, spindle_state_t state, float rpm)
-{
-    UNUSED(spindle);
-
-    static bool busy = false;
-
-    if(busy)
-        return;
-
-    if(state.on && vfd_state != VFD_Ready)
-        get_rpm_max(NULL);
-
-    modbus_message_t mode_cmd = {
-        .context = (void *)VFD_SetStatus,
-        .crc_check = false,
-        .adu[0] = modbus_address,
-        .adu[1] = ModBus_WriteRegister,
-        .adu[2] = 0x20,
-        .adu[5] = (!state.on || rpm == 0.0f) ? 6 : (state.ccw ? 2 : 1),
-        .tx_length = 8,
-        .rx_length = 8
-    };
-
-    busy = true;
-
-    if(spindle_state.ccw != state.ccw)
-        spindle_data.rpm_programmed = -1.0f;
-
-    spindle_state.on = spindle_data.state_programmed.on = state.on;
-    spindle_state.ccw = spindle_data.state_programmed.ccw = state.ccw;
-
-    if(modbus_send(&mode_cmd, &callbacks, true))
-        set_rpm(rpm, true);
-
-    busy = false;
-}
-
-// Returns spindle state in a spindle_state_t variable
-static spindle_state_t spindleGetState (spindle_ptrs_t *spindle)
-{
-    UNUSED(spindle);
-
-    if(vfd_state != VFD_Ready)
-        return spindle_state;
-
-    modbus_message_t mode_cmd = {
-        .context = (void *)VFD_GetRPM,
-        .crc_check = false,
-        .adu[0] = modbus_address,
-        .adu[1] = ModBus_ReadHoldingRegisters,
-        .adu[2] = 0x70,
-        .adu[3] = 0x0C,
-        .adu[4] = 0x00,
-        .adu[5] = 0x02,
-        .tx_length = 8,
-        .rx_length = 8
-    };
-
-    modbus_send(&mode_cmd, &callbacks, false); // TODO: add flag for not raising alarm?
-
-    spindle_state.at_speed = spindle->get_data(SpindleData_AtSpeed)->state_programmed.at_speed;
-
-    return spindle_state; // return previous state as we do not want to wait for the response
-}
-
-static void rx_packet (modbus_message_t *msg)
-{
-    if(!(msg->adu[0] & 0x80)) {
-
-        switch((vfd_response_t)msg->context) {
-
-            case VFD_GetRPM:
-                exceptions = 0;
-                spindle_validate_at_speed(spindle_data, (float)((msg->adu[4] << 8) | msg->adu[5]));
-                break;
-
-            case VFD_GetMaxRPM:
-                rpm_max = (msg->adu[4] << 8) | msg->adu[5];
-                //if(spindle_hal) {
-                //    spindle_hal->cap.rpm_range_locked = On;
-                //    spindle_hal->rpm_max = rpm_max50 = (float)((msg->adu[4] << 8) | msg->adu[5]);
-                //}
-                vfd_state = VFD_Ready;
-                break;
-
-            default:
-                break;
-        }
-    }
-}
-
-static bool spindleConfig (spindle_ptrs_t *spindle)
-{
-    return modbus_isup().rtu;
-}
-
-static spindle_data_t *spindleGetData (spindle_data_request_t request)
-{
-    return &spindle_data;
-}
-
-static void rx_exception (uint8_t code, void *context)
-{
-    if((vfd_response_t)context != VFD_GetRPM || ++exceptions == VFD_ASYNC_EXCEPTION_LEVEL) {
-        exceptions = 0;
-        vfd_failed(false);
-    }
-}
-
-static void onReportOptions (bool newopt)
-{
-    on_report_options(newopt);
-
-    if(!newopt)
-        report_plugin("HUANYANG P2A VFD", "0.16");
-}
-
-static void onDriverReset (void)
-{
-    driver_reset();
-
-    if(spindle_hal)
-        task_add_delayed(get_rpm_max, NULL, 50);
-}
-
-static void onSpindleSelected (spindle_ptrs_t *spindle)
-{
-    if(spindle->id == spindle_id) {
-
-        spindle_data.rpm_programmed = -1.0f;
-        vfd_atspeed_configure((spindle_hal = spindle), &spindle_data);
-
-        modbus_address = vfd_get_modbus_address(spindle_id);
-
-        get_rpm_max(NULL);
-
-    } else
-        spindle_hal = NULL;
-
-    if(on_spindle_selected)
-        on_spindle_selected(spindle);
-}
-
-static void settingsChanged (settings_t *settings, settings_changed_flags_t changed)
-{
-    settings_changed(settings, changed);
-
-    if(changed.spindle)
-        spindle_get_hal(spindle_id, SpindleHAL_Configured)->at_speed_tolerance = vfd_atspeed_configure(spindle_hal, &spindle_data);
-}
-
 void vfd_huanyang2_init (void)
 {
-    static const vfd_spindle_ptrs_t vfd = {
-        .spindle = {
-            .type = SpindleType_VFD,
-            .ref_id = SPINDLE_HUANYANG2,
-            .cap = {
-                .variable = On,
-                .at_speed = On,
-                .direction = On,
-                .cmd_controlled = On
-            },
-            .config = spindleConfig,
-            .set_state = spindleSetState,
-            .get_state = spindleGetState,
-            .update_rpm = spindleUpdateRPM,
-            .get_data = spindleGetData,
-        }
+    // Max RPM, used for calculating the frequency command which is in 0.01% of max
+    static const vfd_param_read_t params[] = {
+        { .function = ModBus_ReadHoldingRegisters, .address = 0xB005, .n_regs = 2, .param = { VFD_Param_MaxRPM } }
     };
 
-    if((spindle_id = vfd_register(&vfd, "Huanyang P2A")) != -1) {
-
-        on_spindle_selected = grbl.on_spindle_selected;
-        grbl.on_spindle_selected = onSpindleSelected;
-
-        settings_changed = hal.settings_changed;
-        hal.settings_changed = settingsChanged;
-
-        on_report_options = grbl.on_report_options;
-        grbl.on_report_options = onReportOptions;
+    static const vfd_driver_t driver = {
+        .name = "Huanyang P2A",
+        .plugin = "HUANYANG P2A VFD",
+        .version = "0.17",
+        .ref_id = SPINDLE_HUANYANG2,
+        .protocol = VFD_Protocol_HuanyangP2A,
+        .control = {
+            .function = ModBus_WriteRegister,
+            .address = 0x2000,
+            .stop = 6,
+            .cw = 1,
+            .ccw = 2
+        },
+        .frequency = {
+            .function = ModBus_WriteRegister,
+            .address = 0x1000
+        },
+        .scaling = {
+            .source = VFD_Scaling_MaxRPM
+        },
+        // Output RPM
+        .telemetry = {
+            .function = ModBus_ReadHoldingRegisters,
+            .address = 0x700C,
+            .n_regs = 2,
+            .freq = 0,
+            .amps = -1,
+            .status = -1,
+            .fault = -1,
+            .power = -1,
+            .voltage = -1,
+            .temp = -1
+        },
+        .n_params = sizeof(params) / sizeof(vfd_param_read_t),
+        .params = params
+    };
 
-        driver_reset = hal.driver_reset;
-        hal.driver_reset = onDriverReset;
-    }
+    vfd_register_driver(&driver);
 }
 
 #endif
@@ -0,0 +1,427 @@
+/*
+
+  vfd/profile.c - user defined VFD profiles loaded from the file system
+
+  Part of grblHAL
+
+  Copyright (c) 2026 Terje Io
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+ * Profiles are read once at startup from VFD_PROFILE_FILE and parsed into driver
+ * descriptors for the generic protocol engine in spindle.c, each is registered as
+ * a separate VFD spindle named by its section header. See README.md for the file format.
+ */
+
+#include "spindle/shared.h"
+
+#if VFD_ENABLE
+
+#include "spindle.h"
+#include "util.h"
+
+#if VFD_PROFILES
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "grbl/vfs.h"
+
+#ifndef VFD_PROFILE_FILE
+#define VFD_PROFILE_FILE "/vfd_profiles.txt"
+#endif
+
+#ifndef VFD_N_PROFILES
+#define VFD_N_PROFILES 2
+#endif
+
+#ifndef VFD_PROFILE_REF_ID
+#define VFD_PROFILE_REF_ID 40 // ref id of the first profile slot, the next slots are numbered upwards
+#endif
+
+#define PROFILE_REF_ID_MIN 32 // ref ids below this are used by the built-in spindles
+
+#define PROFILE_NAME_LENGTH 24
+#define PROFILE_LINE_LENGTH 80
+#define PROFILE_N_PARAMS 6
+#define PROFILE_N_WARNINGS 3
+#define PROFILE_WARNING_LENGTH 127
+
+typedef struct {
+    vfd_driver_t driver;
+    vfd_param_read_t params[PROFILE_N_PARAMS];
+    char name[PROFILE_NAME_LENGTH + 1];
+} vfd_profile_t;
+
+typedef struct {
+    vfs_file_t *file;
+    size_t len;
+    size_t pos;
+    uint_fast16_t line;     // number of the line last read
+    char buf[64];
+} profile_reader_t;
+
+static uint_fast8_t n_profiles = 0;
+static vfd_profile_t profiles[VFD_N_PROFILES];
+
+// Reads a line, returns false at end of file. Overlong lines are truncated.
+static bool read_line (profile_reader_t *reader, char *line, size_t size)
+{
+    char c;
+    bool ok = false;
+    size_t len = 0;
+
+    while(true) {
+
+        if(reader->pos == reader->len) {
+            reader->pos = 0;
+            if((reader->len = vfs_read(reader->buf, 1, sizeof(reader->buf), reader->file)) == 0)
+                break;
+        }
+
+        ok = true;
+
+        if((c = reader->buf[reader->pos++]) == '\n')
+            break;
+
+        if(c != '\r' && len < size - 1)
+            line[len++] = c;
+    }
+
+    line[len] = '\0';
+
+    if(ok)
+        reader->line++;
+
+    return ok;
+}
+
+static bool add_param (vfd_profile_t *profile, int32_t *values, vfd_param_t param)
+{
+    bool ok;
+
+    if((ok = profile->driver.n_params < PROFILE_N_PARAMS &&
+              (values[0] == ModBus_ReadHoldingRegisters || values[0] == ModBus_ReadInputRegisters))) {
+
+        vfd_param_read_t *read = &profile->params[profile->driver.n_params++];
+
+        read->function = (uint8_t)values[0];
+        read->address = (uint16_t)values[1];
+        read->n_regs = 1;
+        read->param[0] = param;
+        read->param[1] = VFD_Param_None;
+    }
+
+    return ok;
+}
+
+static bool parse_setting (vfd_profile_t *profile, char *key, char *value)
+{
+    uint_fast8_t idx;
+    int32_t values[2 + VFD_N_BAUDRATES];
+    bool ok = true;
+    vfd_driver_t *driver = &profile->driver;
+
+    if(!strcmp(key, "control") && (ok = vfd_parse_values(value, values, 2))) {
+        driver->control.function = (uint8_t)values[0];
+        driver->control.address = (uint16_t)values[1];
+    } else if(!strcmp(key, "stop") && (ok = vfd_parse_values(value, values, 1)))
+        driver->control.stop = (uint16_t)values[0];
+    else if(!strcmp(key, "cw") && (ok = vfd_parse_values(value, values, 1)))
+        driver->control.cw = (uint16_t)values[0];
+    else if(!strcmp(key, "ccw") && (ok = vfd_parse_values(value, values, 1)))
+        driver->control.ccw = (uint16_t)values[0];
+    else if(!strcmp(key, "frequency") && (ok = vfd_parse_values(value, values, 2))) {
+        driver->frequency.function = (uint8_t)values[0];
+        driver->frequency.address = (uint16_t)values[1];
+    } else if(!strcmp(key, "words") && (ok = vfd_parse_values(value, values, 1)))
+        driver->words = (uint8_t)values[0];
+    else if(!strcmp(key, "word_order")) {
+        if((ok = !strcmp(value, "lsw") || !strcmp(value, "msw")))
+            driver->lsw_first = !strcmp(value, "lsw");
+    } else if(!strcmp(key, "units_per_hz") && (ok = vfd_parse_values(value, values, 1)))
+        driver->scaling.units_per_hz = (uint16_t)values[0];
+    else if(!strcmp(key, "rpm_per_hz") && (ok = vfd_parse_values(value, values, 1))) {
+        driver->scaling.rpm_per_hz = (uint16_t)values[0];
+        driver->scaling.source = values[0] ? VFD_Scaling_Fixed : VFD_Scaling_RPMHz;
+    } else if(!strcmp(key, "telemetry") && (ok = vfd_parse_values(value, values, 3))) {
+        driver->telemetry.function = (uint8_t)values[0];
+        driver->telemetry.address = (uint16_t)values[1];
+        driver->telemetry.n_regs = (uint8_t)values[2];
+    } else if(!strcmp(key, "freq") && (ok = vfd_parse_values(value, values, 1)))
+        driver->telemetry.freq = (int8_t)values[0];
+    else if(!strcmp(key, "amps") && (ok = vfd_parse_values(value, values, 1)))
+        driver->telemetry.amps = (int8_t)values[0];
+    else if(!strcmp(key, "status") && (ok = vfd_parse_values(value, values, 1)))
+        driver->telemetry.status = (int8_t)values[0];
+    else if(!strcmp(key, "fault") && (ok = vfd_parse_values(value, values, 1)))
+        driver->telemetry.fault = (int8_t)values[0];
+    else if(!strcmp(key, "power") && (ok = vfd_parse_values(value, values, 1)))
+        driver->telemetry.power = (int8_t)values[0];
+    else if(!strcmp(key, "voltage") && (ok = vfd_parse_values(value, values, 1)))
+        driver->telemetry.voltage = (int8_t)values[0];
+    else if(!strcmp(key, "temp") && (ok = vfd_parse_values(value, values, 1)))
+        driver->telemetry.temp = (int8_t)values[0];
+    else if(!strcmp(key, "amps_scale") && (ok = vfd_parse_values(value, values, 1)))
+        driver->telemetry.amps_scale = (uint8_t)values[0];
+    else if(!strcmp(key, "power_scale") && (ok = vfd_parse_values(value, values, 1)))
+        driver->telemetry.power_scale = (uint16_t)values[0];
+    else if(!strcmp(key, "voltage_scale") && (ok = vfd_parse_values(value, values, 1)))
+        driver->telemetry.voltage_scale = (uint8_t)values[0];
+    else if(!strcmp(key, "temp_scale") && (ok = vfd_parse_values(value, values, 1)))
+        driver->telemetry.temp_scale = (uint8_t)values[0];
+    else if(!strcmp(key, "fault_reset") && (ok = vfd_parse_values(value, values, 3))) {
+        driver->fault_reset.function = (uint8_t)values[0];
+        driver->fault_reset.address = (uint16_t)values[1];
+        driver->fault_reset.command = (uint16_t)values[2];
+    } else if(!strcmp(key, "baud") && (ok = vfd_parse_values(value, values, 2 + VFD_N_BAUDRATES))) {
+        driver->baud.function = (uint8_t)values[0];
+        driver->baud.address = (uint16_t)values[1];
+        for(idx = 0; idx < VFD_N_BAUDRATES; idx++)
+            driver->baud.code[idx] = values[2 + idx] < 0 ? VFD_BaudUnsupported : (uint16_t)values[2 + idx];
+    } else if(!strcmp(key, "ref_id") && (ok = vfd_parse_values(value, values, 1))) {
+        if((ok = values[0] >= PROFILE_REF_ID_MIN && values[0] <= 255))
+            driver->ref_id = (uint8_t)values[0];
+    } else if(!strcmp(key, "crc_check") && (ok = vfd_parse_values(value, values, 1)))
+        driver->crc_check = values[0] != 0;
+    else if(!strcmp(key, "write_multiple") && (ok = vfd_parse_values(value, values, 1)))
+        driver->write_multiple = values[0] != 0;
+    else if(!strcmp(key, "min_freq") && (ok = vfd_parse_values(value, values, 2)))
+        ok = add_param(profile, values, VFD_Param_MinFreq);
+    else if(!strcmp(key, "max_freq") && (ok = vfd_parse_values(value, values, 2)))
+        ok = add_param(profile, values, VFD_Param_MaxFreq);
+    else if(!strcmp(key, "max_amps") && (ok = vfd_parse_values(value, values, 2)))
+        ok = add_param(profile, values, VFD_Param_MaxAmps);
+    else if(!strcmp(key, "poles") && (ok = vfd_parse_values(value, values, 2)))
+        ok = add_param(profile, values, VFD_Param_Poles);
+    else if(!strcmp(key, "accel_time") && (ok = vfd_parse_values(value, values, 2)))
+        ok = add_param(profile, values, VFD_Param_AccelTime);
+    else if(!strcmp(key, "decel_time") && (ok = vfd_parse_values(value, values, 2)))
+        ok = add_param(profile, values, VFD_Param_DecelTime);
+    else
+        ok = false;
+
+    return ok;
+}
+
+static bool offset_valid (int8_t offset, uint_fast8_t words, uint_fast8_t n_regs)
+{
+    return offset < 0 || offset + words <= n_regs;
+}
+
+// Spindles are selected by ref id, each profile must have its own.
+static bool ref_id_unique (vfd_profile_t *profile)
+{
+    uint_fast8_t idx = n_profiles;
+
+    while(idx) {
+        if(profiles[--idx].driver.ref_id == profile->driver.ref_id)
+            return false;
+    }
+
+    return true;
+}
+
+// Checks that the profile can be handled by the protocol engine, returns the reason if not.
+static const char *profile_check (vfd_profile_t *profile)
+{
+    vfd_driver_t *driver = &profile->driver;
+    uint_fast8_t words = driver->words == 2 ? 2 : 1;
+
+    if(!ref_id_unique(profile))
+        return "ref_id already used";
+
+    if(!(driver->words <= 1 || (driver->words == 2 && driver->frequency.function == ModBus_WriteRegisters && MODBUS_MAX_ADU_SIZE >= 13)))
+        return "words=2 requires frequency function code 16";
+
+    if(!(driver->control.function == ModBus_WriteRegister || driver->control.function == ModBus_WriteRegisters || driver->control.function == ModBus_WriteCoil))
+        return "control missing or invalid function code";
+
+    if(!(driver->frequency.function == ModBus_WriteRegister || driver->frequency.function == ModBus_WriteRegisters))
+        return "frequency missing or invalid function code";
+
+    if(!((driver->telemetry.function == ModBus_ReadHoldingRegisters || driver->telemetry.function == ModBus_ReadInputRegisters) &&
+          driver->telemetry.n_regs > 0 && driver->telemetry.n_regs <= (MODBUS_MAX_ADU_SIZE - 5) / 2))
+        return "telemetry missing, invalid function code or too many registers";
+
+    if(!(offset_valid(driver->telemetry.freq, words, driver->telemetry.n_regs) &&
+          offset_valid(driver->telemetry.amps, words, driver->telemetry.n_regs) &&
+           offset_valid(driver->telemetry.status, 1, driver->telemetry.n_regs) &&
+            offset_valid(driver->telemetry.fault, 1, driver->telemetry.n_regs) &&
+             offset_valid(driver->telemetry.power, 1, driver->telemetry.n_regs) &&
+              offset_valid(driver->telemetry.voltage, 1, driver->telemetry.n_regs) &&
+               offset_valid(driver->telemetry.temp, 1, driver->telemetry.n_regs)))
+        return "telemetry register offset outside block";
+
+    if(!(driver->telemetry.amps_scale > 0 && driver->telemetry.power_scale > 0 &&
+          driver->telemetry.voltage_scale > 0 && driver->telemetry.temp_scale > 0 && driver->scaling.units_per_hz > 0))
+        return "scale is 0";
+
+    if(!(driver->fault_reset.function == 0 || driver->fault_reset.function == ModBus_WriteRegister))
+        return "fault_reset requires function code 6";
+
+    if(!(driver->baud.function == 0 || driver->baud.function == ModBus_WriteRegister))
+        return "baud requires function code 6";
+
+    return NULL;
+}
+
+// Outputs a warning when startup is completed, only the first PROFILE_N_WARNINGS are kept.
+static void profile_warning (uint_fast16_t line, const char *name, const char *reason, const char *key)
+{
+    static uint_fast8_t n_warnings = 0;
+    static char warnings[PROFILE_N_WARNINGS][PROFILE_WARNING_LENGTH + 1];
+
+    if(n_warnings < PROFILE_N_WARNINGS) {
+
+        char *msg = warnings[n_warnings++];
+
+        strcpy(msg, VFD_PROFILE_FILE " line ");
+        strcat(msg, uitoa(line));
+        strcat(msg, ": ");
+        strncat(msg, reason, PROFILE_WARNING_LENGTH - strlen(msg));
+        if(key) {
+            strncat(msg, " ", PROFILE_WARNING_LENGTH - strlen(msg));
+            strncat(msg, key, PROFILE_WARNING_LENGTH - strlen(msg));
+        }
+        if(name) {
+            strncat(msg, ", VFD profile ", PROFILE_WARNING_LENGTH - strlen(msg));
+            strncat(msg, *name ? name : "without name", PROFILE_WARNING_LENGTH - strlen(msg));
+            strncat(msg, " skipped", PROFILE_WARNING_LENGTH - strlen(msg));
+        }
+
+        task_add_immediate(report_warning, msg);
+    }
+}
+
+static void profile_init (vfd_profile_t *profile, const char *name)
+{
+    memset(profile, 0, sizeof(vfd_profile_t));
+
+    strncpy(profile->name, name, PROFILE_NAME_LENGTH);
+
+    profile->driver.name = profile->name;
+    profile->driver.plugin = "VFD profile";
+    profile->driver.version = profile->name;
+    profile->driver.ref_id = VFD_PROFILE_REF_ID + n_profiles;
+    profile->driver.protocol = VFD_Protocol_ModBus;
+    profile->driver.params = profile->params;
+    profile->driver.scaling.source = VFD_Scaling_RPMHz;
+    profile->driver.scaling.units_per_hz = 100;
+    profile->driver.telemetry.freq = -1;
+    profile->driver.telemetry.amps = -1;
+    profile->driver.telemetry.status = -1;
+    profile->driver.telemetry.fault = -1;
+    profile->driver.telemetry.power = -1;
+    profile->driver.telemetry.voltage = -1;
+    profile->driver.telemetry.temp = -1;
+    profile->driver.telemetry.amps_scale = 10;
+    profile->driver.telemetry.power_scale = 100;
+    profile->driver.telemetry.voltage_scale = 10;
+    profile->driver.telemetry.temp_scale = 10;
+}
+
+// Keeps the profile being parsed if it is valid, a slot is reused otherwise.
+// line is the line number of the section header, error the reason already found if any.
+static void profile_done (vfd_profile_t *profile, uint_fast16_t line, const char *error, uint_fast16_t error_line, const char *key)
+{
+    if(profile) {
+        if(error)
+            profile_warning(error_line, profile->name, error, key);
+        else if(*profile->name == '\0')
+            profile_warning(line, profile->name, "section name missing", NULL);
+        else if((error = profile_check(profile)))
+            profile_warning(line, profile->name, error, NULL);
+        else
+            n_profiles++;
+    }
+}
+
+void vfd_profiles_init (void)
+{
+    char buf[PROFILE_LINE_LENGTH + 1], *line, *value, *comment, key[PROFILE_NAME_LENGTH + 1];
+    uint_fast8_t idx;
+    uint_fast16_t section = 0, error_line = 0;
+    const char *error = NULL;
+    vfd_profile_t *profile = NULL;
+    profile_reader_t reader = {0};
+
+    if((reader.file = vfs_open(VFD_PROFILE_FILE, "r")) == NULL)
+        return;
+
+    while(read_line(&reader, buf, sizeof(buf))) {
+
+        line = vfd_trim(buf);
+
+        if(*line == '\0' || *line == ';' || *line == '#')
+            continue;
+
+        if(*line == '[') {
+
+            profile_done(profile, section, error, error_line, key);
+            profile = NULL;
+            error = NULL;
+            section = reader.line;
+
+            if((value = strchr(line, ']')) == NULL)
+                profile_warning(reader.line, NULL, "] missing in section header", NULL);
+            else if(n_profiles == VFD_N_PROFILES) {
+                *value = '\0';
+                profile_warning(reader.line, vfd_trim(line + 1), "max. number of profiles loaded", NULL);
+            } else {
+                *value = '\0';
+                profile_init(profile = &profiles[n_profiles], vfd_trim(line + 1));
+            }
+
+        } else if(profile && error == NULL) {
+
+            if((value = strchr(line, '=')) == NULL) {
+                error = "= missing after";
+                error_line = reader.line;
+                strncpy(key, line, PROFILE_NAME_LENGTH);
+                key[PROFILE_NAME_LENGTH] = '\0';
+                continue;
+            }
+
+            *value++ = '\0';
+
+            if((comment = strpbrk(value, ";#")))
+                *comment = '\0';
+
+            line = vfd_trim(line);
+
+            // The first invalid setting is reported and the profile skipped.
+            if(!parse_setting(profile, line, vfd_trim(value))) {
+                error = "unknown key or invalid value for";
+                error_line = reader.line;
+                strncpy(key, line, PROFILE_NAME_LENGTH);
+                key[PROFILE_NAME_LENGTH] = '\0';
+            }
+        }
+    }
+
+    profile_done(profile, section, error, error_line, key);
+
+    vfs_close(reader.file);
+
+    for(idx = 0; idx < n_profiles; idx++)
+        vfd_register_driver(&profiles[idx].driver);
+}
+
+#endif // VFD_PROFILES
+
+#endif // VFD_ENABLE
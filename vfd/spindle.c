@@ -27,9 +27,12 @@
 #if VFD_ENABLE
 
 #include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "spindle.h"
+#include "util.h"
 
 #include "grbl/nvs_buffer.h"
 
@@ -41,359 +44,2564 @@
 #define VFD_ADDRESS 1
 #endif
 
-#ifndef VFD_QUERY_INTERVAL
-#define VFD_QUERY_INTERVAL 150 // ms
+#ifndef VFD_COMBINED_WRITE
+#define VFD_COMBINED_WRITE 1 // Combine run/direction and frequency commands when the registers are adjacent and the VFD supports it
 #endif
 
+#define MODBUS_ILLEGAL_FUNCTION 1 // ModBus exception code
+
+#ifndef VFD_POLL_INTERVAL_FAST
+#define VFD_POLL_INTERVAL_FAST 50 // ms, used when the spindle is ramping or not at speed
+#endif
+
+#ifndef VFD_POLL_INTERVAL_SLOW
+#define VFD_POLL_INTERVAL_SLOW 500 // ms, used when the spindle speed is stable
+#endif
+
+#ifndef VFD_POLL_STABLE_COUNT
+#define VFD_POLL_STABLE_COUNT 4 // number of consecutive stable readings before switching to the slow interval
+#endif
+
+#ifndef VFD_AMPS_POLL_RATIO
+#define VFD_AMPS_POLL_RATIO 4 // Huanyang v1: output current or another secondary status value is read instead of frequency every n polls
+#endif
+
+// RPM per Hz setting $461, used by GS20, YL620A and VFD profiles without a fixed value
+#define VFD_RPM_HZ_SETTING (VFD_PROFILES || (SPINDLE_ENABLE & ((1<<SPINDLE_GS20)|(1<<SPINDLE_YL620A))))
+
+#ifndef VFD_PARAMS_DELAY
+#define VFD_PARAMS_DELAY 200 // ms, delay before parameters are read from the VFD after a reset
+#endif
+
+#ifndef VFD_PARAM_CACHE
+#define VFD_PARAM_CACHE 1 // Cache parameters read from the VFD in NVS
+#endif
+
+#ifndef VFD_STATS
+#define VFD_STATS 1 // Collect bus statistics per VFD, output by $VFDSTATS
+#endif
+
+#ifndef VFD_ADAPTIVE_FEED_MIN
+#define VFD_ADAPTIVE_FEED_MIN 50 // %, lowest feed override set by adaptive feed
+#endif
+
+#ifndef VFD_ADAPTIVE_FEED_MAX
+#define VFD_ADAPTIVE_FEED_MAX 150 // %, highest feed override set by adaptive feed
+#endif
+
+#ifndef VFD_ADAPTIVE_FEED_STEP
+#define VFD_ADAPTIVE_FEED_STEP 5 // %, max feed override increase per load reading, decreases are up to twice as large
+#endif
+
+#ifndef VFD_ADAPTIVE_FEED_BAND
+#define VFD_ADAPTIVE_FEED_BAND 5 // %, no adjustment when the load is within this of the target
+#endif
+
+#ifndef VFD_STALL_RPM_DROP
+#define VFD_STALL_RPM_DROP 0.2f // fraction of programmed RPM the spindle speed may drop below it before it is considered stalled
+#endif
+
+#ifndef VFD_STALL_LOAD
+#define VFD_STALL_LOAD 120.0f // %, spindle load considered an overload
+#endif
+
+#ifndef VFD_STALL_TIME
+#define VFD_STALL_TIME 500 // ms, a stall or overload lasting this long triggers a feed hold
+#endif
+
+#ifndef VFD_RECOVERY_DELAY
+#define VFD_RECOVERY_DELAY 1000 // ms, delay before and between fault reset and reconnect attempts
+#endif
+
+#ifndef VFD_RECOVERY_ATTEMPTS
+#define VFD_RECOVERY_ATTEMPTS 3 // number of attempts before an alarm is raised
+#endif
+
+#ifndef VFD_RECOVERY_WINDOW
+#define VFD_RECOVERY_WINDOW 10000 // ms, attempts are accumulated for failures within this time after a recovery
+#endif
+
+#ifndef VFD_CAL_REQUESTS
+#define VFD_CAL_REQUESTS 20 // number of status requests that must be answered at each silence timeout during calibration
+#endif
+
+#ifndef VFD_SILENCE_MARGIN
+#define VFD_SILENCE_MARGIN 2 // ms, added to the smallest reliable silence timeout found by calibration
+#endif
+
+#ifndef VFD_RETRY_DELAY_MAX
+#define VFD_RETRY_DELAY_MAX 1000 // ms, upper limit of the retry delay when backing off
+#endif
+
+#ifndef VFD_BREAKER_THRESHOLD
+#define VFD_BREAKER_THRESHOLD 3 // consecutive requests without response that opens the circuit breaker
+#endif
+
+#ifndef VFD_BREAKER_PROBE_MIN
+#define VFD_BREAKER_PROBE_MIN 500 // ms, first health probe interval when the circuit breaker is open
+#endif
+
+#ifndef VFD_BREAKER_PROBE_MAX
+#define VFD_BREAKER_PROBE_MAX 8000 // ms, max. health probe interval
+#endif
+
+#ifndef VFD_LOAD_FILTER
+#define VFD_LOAD_FILTER 0.5f // weight of a new load reading for adaptive feed
+#endif
+
+// Value read by a status request or command written, passed as message context.
+typedef enum {
+    VFD_GetRPM = 1,
+    VFD_SetRPM,
+    VFD_SetStatus,
+    VFD_GetAmps,
+    VFD_GetPower,
+    VFD_GetBusVoltage,
+    VFD_GetTemperature
+} vfd_response_t;
+
+typedef enum {
+    VFD_Command_Control = 0,    // Run/stop and direction, sent before a queued frequency command
+    VFD_Command_Frequency,
+    VFD_Command_Telemetry,      // Status request, lowest priority - only sent when no other command is waiting
+    VFD_N_COMMANDS              // Must be last
+} vfd_command_type_t;
+
+typedef enum {
+    VFD_CommandIdle = 0, // Must be 0
+    VFD_CommandPending,
+    VFD_CommandFailed
+} vfd_command_status_t;
+
+typedef void (*vfd_poll_ptr)(void);
+
+// Spindle registered by vfd_register().
+typedef struct {
+    spindle_id_t id;
+    const vfd_spindle_ptrs_t *hal;
+} vfd_legacy_t;
+
+typedef struct {
+    modbus_message_t msg;
+    const modbus_callbacks_t *callbacks;
+    bool pending;
+} vfd_command_t;
+
+typedef struct {
+    uint32_t last;
+    float rpm;          // reading at last poll
+    uint_fast8_t stable;
+    uint_fast8_t amps;  // Huanyang v1 secondary status value poll counter
+    uint_fast8_t next;  // Huanyang v1 index of next secondary status value
+} vfd_poll_t;
+
+// Register map resolved from the driver descriptor and settings.
+typedef struct {
+    vfd_control_t control;
+    vfd_register_t frequency;
+    vfd_telemetry_block_t telemetry;
+} vfd_map_t;
+
+typedef struct {
+    vfd_factor_t set;   // frequency register units per fixed point RPM
+    vfd_factor_t get;   // fixed point RPM per output frequency register unit
+    uint32_t deadband;  // frequency register units, from vfd_config.deadband
+} vfd_scale_t;
+
+// Parameters read from the VFD.
+typedef struct {
+    uint16_t freq_min;
+    uint16_t freq_max;  // 0 if not known
+    float rpm_at_50hz;
+    float rpm_max;
+    float amps_max;
+    uint16_t poles;
+    float accel_time;   // s, 0 if not known
+    float decel_time;   // s, 0 if not known
+} vfd_params_t;
+
+#if VFD_STATS
+
+#define VFD_LATENCY_BINS 9
+
+typedef enum {
+    VFD_Request_Control = 0,    // Run/stop and direction, also combined run/direction and frequency writes
+    VFD_Request_Frequency,
+    VFD_Request_Telemetry,
+    VFD_Request_Params,
+    VFD_N_REQUESTS              // Must be last
+} vfd_request_t;
+
+// Bus statistics per request type, latencies are round trip times in ms.
+typedef struct {
+    uint32_t requests;
+    uint32_t responses;
+    uint32_t exceptions;                // exception responses
+    uint32_t timeouts;                  // no valid response after all retries
+    uint16_t latency_last;
+    uint16_t latency_max;
+    uint16_t latency[VFD_LATENCY_BINS]; // histogram, upper bounds of bins in latency_bins[]
+    bool pending;
+    uint32_t sent;                      // hal.get_elapsed_ticks() when the pending request was sent
+} vfd_stats_t;
+
+#endif
+
+typedef struct {
+    bool armed;         // spindle has been at speed since the programmed RPM last changed
+    float rpm;          // programmed RPM when armed
+    uint32_t updates;   // telemetry snapshot last checked
+    uint32_t since;     // time deviation was first seen, 0 if none
+} vfd_stall_t;
+
+typedef enum {
+    VFD_Recovery_Idle = 0,  // Must be 0
+    VFD_Recovery_Active,    // fault reset and reconnect attempts are scheduled
+    VFD_Recovery_Failed     // attempts exhausted or unrecoverable fault, failures raise alarms until reset
+} vfd_recovery_state_t;
+
+typedef struct {
+    volatile vfd_recovery_state_t state;
+    uint_fast8_t attempts;
+    uint32_t recovered;     // time of last recovery
+} vfd_recovery_t;
+
+typedef struct {
+    volatile uint8_t failures;      // consecutive requests without response
+    volatile bool open;             // blocking requests are not sent, status requests are health probes
+    volatile bool closed;           // set when the breaker closes, cleared by the poll engine
+    uint32_t backoff;               // ms, interval to next health probe
+    uint32_t next_probe;
+    modbus_callbacks_t callbacks;   // pipeline callbacks with the current retry policy applied
+} vfd_breaker_t;
+
 typedef struct {
     spindle_id_t id;
-    vfd_spindle_ptrs_t hal;
+    vfd_spindle_ptrs_t hal;         // get_load is NULL if the driver does not read the rated current
+    vfd_poll_ptr send_poll;         // send status request(s), called by the poll engine when a poll is due
+    const vfd_driver_t *driver;
+    spindle_ptrs_t *spindle;        // when selected
+    spindle_data_t data;
+    uint8_t modbus_address;
+    volatile bool ready;
+    vfd_map_t map;
+    vfd_scale_t scale;
+    bool combine;                   // run/direction and frequency commands may be combined, cleared if the VFD rejects them
+    uint32_t freq;                  // frequency last written in register units, valid if data.rpm_programmed >= 0
+    vfd_params_t params;
+    uint32_t fingerprint;           // raw value(s) of the first parameter read
+    vfd_ramp_t ramp;
+    vfd_stall_t stall;
+    vfd_recovery_t recovery;
+    vfd_breaker_t breaker;
+    spindle_data_t estimate;        // returned for SpindleData_RPM requests
+    vfd_poll_t poll;
+    vfd_telemetry_t telemetry;
+    vfd_command_t command[VFD_N_COMMANDS];
+    volatile uint8_t in_flight;     // bitmap of commands on the bus, by vfd_command_type_t
+    volatile bool kick;
+    volatile vfd_command_status_t status;
+#if VFD_STATS
+    vfd_stats_t stats[VFD_N_REQUESTS];
+#endif
 } vfd_spindle_t;
 
 static uint8_t n_spindle = 0;
 static bool spindle_changed = false;
-static vfd_spindle_t vfd_spindle = {0}, vfd_spindles[N_SPINDLE];
+static vfd_spindle_t *vfd_spindle = NULL, vfd_spindles[N_SPINDLE];
+static uint8_t n_legacy = 0;
+static vfd_legacy_t *legacy_spindle = NULL, legacy_spindles[N_SPINDLE];
 static nvs_address_t nvs_address = 0;
 
-static on_spindle_select_ptr on_spindle_select;
 static on_spindle_selected_ptr on_spindle_selected;
 static on_realtime_report_ptr on_realtime_report = NULL;
+static on_execute_realtime_ptr on_execute_realtime, on_execute_delay;
+static on_report_options_ptr on_report_options;
+static settings_changed_ptr settings_changed;
+static driver_reset_ptr driver_reset;
 
 vfd_settings_t vfd_config;
 
-static void vfd_realtime_report (stream_write_ptr stream_write, report_tracking_flags_t report)
-{
-    static float load = -1.0f;
-    static uint32_t last_request;
+/*
+ * Bus statistics.
+ *
+ * Requests, responses, exception responses and timeouts are counted per VFD and request type
+ * along with a histogram of round trip latencies. Latency is measured from the request is queued
+ * until the response is received and includes any retries made by the ModBus driver.
+ */
 
-    if(on_realtime_report)
-        on_realtime_report(stream_write, report);
+#if VFD_STATS
 
-    if(vfd_spindle.hal.vfd.get_load) {
+static const uint16_t latency_bins[VFD_LATENCY_BINS - 1] = { 2, 5, 10, 20, 50, 100, 200, 500 };
 
-        uint32_t ms = hal.get_elapsed_ticks();
+static void stats_sent (vfd_spindle_t *vfd, vfd_request_t type)
+{
+    vfd_stats_t *stats = &vfd->stats[type];
 
-        if((ms = hal.get_elapsed_ticks()) - last_request >= VFD_QUERY_INTERVAL) {
-            float new_load = vfd_spindle.hal.vfd.get_load();
-            if(load != new_load || spindle_changed || report.all) {
-                load = new_load;
-                spindle_changed = false;
-                stream_write("|Sl:");
-                stream_write(ftoa(load, 1));
-            }
-        }
+    stats->requests++;
+
+    // Latency of overlapping requests is measured from the first one sent.
+    if(!stats->pending) {
+        stats->pending = true;
+        stats->sent = hal.get_elapsed_ticks();
     }
 }
 
-#ifdef GRBL_ESP32
-static void esp32_spindle_off (spindle_ptrs_t *spindle)
+static void stats_received (vfd_spindle_t *vfd, vfd_request_t type, bool exception)
 {
-    spindle_get_hal(spindle->id, SpindleHAL_Active)->set_state(spindle, (spindle_state_t){0}, 0.0f);
-}
-#endif
+    vfd_stats_t *stats = &vfd->stats[type];
 
-spindle_id_t vfd_register (const vfd_spindle_ptrs_t *vfd, const char *name)
-{
-    spindle_id_t spindle_id = -1;
+    if(exception)
+        stats->exceptions++;
+    else
+        stats->responses++;
 
-    if(n_spindle < N_SPINDLE && (spindle_id = spindle_register(&vfd->spindle, name)) != -1) {
+    if(stats->pending) {
 
-        vfd_spindles[n_spindle].id = spindle_id;
-        memcpy(&vfd_spindles[n_spindle++].hal, vfd, sizeof(vfd_spindle_ptrs_t));
-#ifdef GRBL_ESP32
-        spindle_get_hal(spindle_id, SpindleHAL_Configured)->esp32_off = esp32_spindle_off;
-#endif
-        if(vfd->vfd.get_load && on_realtime_report == NULL) {
-            on_realtime_report = grbl.on_realtime_report;
-            grbl.on_realtime_report = vfd_realtime_report;
-        }
-    }
+        uint_fast8_t bin = 0;
+        uint32_t ms = hal.get_elapsed_ticks() - stats->sent;
 
-    return spindle_id;
+        stats->pending = false;
+        stats->latency_last = (uint16_t)min(ms, 0xFFFF);
+        if(stats->latency_last > stats->latency_max)
+            stats->latency_max = stats->latency_last;
+
+        while(bin < VFD_LATENCY_BINS - 1 && ms >= latency_bins[bin])
+            bin++;
+
+        if(stats->latency[bin] < 0xFFFF)
+            stats->latency[bin]++;
+    }
 }
 
-#if N_SYS_SPINDLE > 1
+// Code is the ModBus exception code, 0 if no valid response was received.
+static void stats_failed (vfd_spindle_t *vfd, vfd_request_t type, uint8_t code)
+{
+    if(code)
+        stats_received(vfd, type, true);
+    else {
+        vfd->stats[type].timeouts++;
+        vfd->stats[type].pending = false;
+    }
+}
 
-static spindle_num_t get_spindle_num (spindle_id_t spindle_id)
+// Requests pending are lost when the ModBus queue is flushed.
+static void stats_flush (vfd_spindle_t *vfd)
 {
-    uint_fast8_t idx = N_SYS_SPINDLE;
-    spindle_ptrs_t *spindle;
+    uint_fast8_t idx = VFD_N_REQUESTS;
 
     do {
-        if((spindle = spindle_get(--idx)) && spindle->id == spindle_id)
-            return idx;
+        vfd->stats[--idx].pending = false;
     } while(idx);
-
-    return -1;
 }
 
-uint32_t vfd_get_modbus_address (spindle_id_t spindle_id)
+// Outputs |VFD:<requests>,<failed requests>,<status poll latency> in the real time report.
+static void stats_report (stream_write_ptr stream_write, vfd_spindle_t *vfd)
 {
-    uint_fast8_t idx = N_SPINDLE;
-    uint32_t modbus_address = VFD_ADDRESS;
-    spindle_num_t spindle_num;
+    uint32_t requests = 0, failed = 0;
+    uint_fast8_t idx = VFD_N_REQUESTS;
 
     do {
-        if(vfd_spindles[--idx].id == spindle_id && (spindle_num = get_spindle_num(spindle_id)) != -1)
-            modbus_address = vfd_config.modbus_address[spindle_num];
+        idx--;
+        requests += vfd->stats[idx].requests;
+        failed += vfd->stats[idx].exceptions + vfd->stats[idx].timeouts;
     } while(idx);
 
-    return modbus_address;
+    stream_write("|VFD:");
+    stream_write(uitoa(requests));
+    stream_write(",");
+    stream_write(uitoa(failed));
+    stream_write(",");
+    stream_write(uitoa(vfd->stats[VFD_Request_Telemetry].latency_last));
 }
 
-#elif N_SPINDLE > 1
+#else
 
-uint32_t vfd_get_modbus_address (spindle_id_t spindle_id)
+#define stats_sent(vfd, type) ((void)0)
+#define stats_received(vfd, type, exception) ((void)0)
+#define stats_failed(vfd, type, code) ((void)0)
+#define stats_flush(vfd) ((void)0)
+
+#endif // VFD_STATS
+
+// Statistics request type of pipeline commands, a combined command is counted as a control command.
+#define pipeline_request(commands) ((commands) & (1 << VFD_Command_Control) ? VFD_Request_Control : \
+                                     ((commands) & (1 << VFD_Command_Frequency) ? VFD_Request_Frequency : VFD_Request_Telemetry))
+
+/*
+ * Retry policy and circuit breaker.
+ *
+ * Each request without response doubles the retry delay of the following requests, up to VFD_RETRY_DELAY_MAX
+ * plus random jitter, and halves the number of retries so that the time spent on a request does not grow.
+ * After VFD_BREAKER_THRESHOLD consecutive requests without response the breaker opens: blocking requests,
+ * such as parameter reads, are no longer sent, other requests are sent without retries and status requests
+ * are replaced by health probes at exponentially increasing intervals. Spindle state is served from the last
+ * telemetry snapshot meanwhile. Any response, also an exception response, closes the breaker and parameters
+ * are read again if required.
+ * Health probes are too far apart to detect a lost VFD in time while a cycle is running, if the breaker opens
+ * during a cycle recovery is started or an alarm raised at once instead of waiting for failed status requests.
+ */
+
+static void read_params_delayed (void *data);
+static void engine_failed (void);
+
+// Returns a pseudo random value from 0 to range - 1.
+static uint32_t jitter (uint32_t range)
 {
-    int8_t binding_id = spindle_select_get_binding(spindle_id);
+    static uint32_t seed = 0;
 
-    return binding_id >= 0 ? vfd_config.modbus_address[(uint32_t)binding_id] : VFD_ADDRESS;
+    seed = seed * 1664525UL + 1013904223UL + hal.get_elapsed_ticks();
+
+    return range ? (seed >> 16) % range : 0;
 }
 
-#else
+// May be called from interrupt context.
+static void breaker_success (vfd_spindle_t *vfd)
+{
+    vfd->breaker.failures = 0;
 
-uint32_t vfd_get_modbus_address (spindle_id_t spindle_id)
+    if(vfd->breaker.open) {
+        vfd->breaker.open = false;
+        vfd->breaker.closed = true;
+    }
+}
+
+// Only timeouts count as failures, an exception response shows that the VFD is alive.
+// May be called from interrupt context.
+static void breaker_failed (vfd_spindle_t *vfd, uint8_t code)
 {
-    return vfd_config.modbus_address;
+    if(code)
+        breaker_success(vfd);
+    else if(vfd->breaker.failures < 255 && ++vfd->breaker.failures >= VFD_BREAKER_THRESHOLD && !vfd->breaker.open) {
+        vfd->breaker.open = true;
+        vfd->breaker.backoff = VFD_BREAKER_PROBE_MIN;
+        vfd->breaker.next_probe = hal.get_elapsed_ticks() + VFD_BREAKER_PROBE_MIN;
+        // Spindle state is no longer known, do not keep cutting on stale readings.
+        if(vfd == vfd_spindle && state_get() == STATE_CYCLE)
+            engine_failed();
+    }
 }
 
-#endif
+static void retry_policy (vfd_spindle_t *vfd, modbus_callbacks_t *callbacks)
+{
+    uint_fast8_t failures = min(vfd->breaker.failures, VFD_BREAKER_THRESHOLD);
+
+    if(vfd->breaker.open)
+        callbacks->retries = 0;
+    else if(failures) {
+        if(callbacks->retries)
+            callbacks->retries = max(callbacks->retries >> failures, 1);
+        callbacks->retry_delay = vfd_backoff(callbacks->retry_delay, failures, VFD_RETRY_DELAY_MAX);
+        callbacks->retry_delay += jitter(callbacks->retry_delay / 4);
+    }
+}
 
-#if N_SPINDLE_SELECTABLE > 1
+// Returns true if a status request may be sent, while the breaker is open only when a health probe is due.
+static bool breaker_poll (vfd_spindle_t *vfd)
+{
+    uint32_t ms;
 
-static bool is_vfd_spindle (const setting_detail_t *setting, uint_fast16_t offset)
+    if(!vfd->breaker.open)
+        return true;
+
+    if((int32_t)((ms = hal.get_elapsed_ticks()) - vfd->breaker.next_probe) < 0)
+        return false;
+
+    vfd->breaker.backoff = vfd_backoff(vfd->breaker.backoff, 1, VFD_BREAKER_PROBE_MAX);
+    vfd->breaker.next_probe = ms + vfd->breaker.backoff + jitter(vfd->breaker.backoff / 4);
+
+    return true;
+}
+
+// Sends a blocking request with the retry policy applied, not sent while the breaker is open unless it is a health probe.
+static bool send_blocking (vfd_spindle_t *vfd, modbus_message_t *msg, const modbus_callbacks_t *callbacks, bool health_probe)
 {
-    uint_fast8_t idx = n_spindle;
-    spindle_ptrs_t *spindle = NULL;
+    bool ok = false;
+    modbus_callbacks_t policy;
 
-    if(setting->id == Setting_VFD_ModbusAddress)
-        spindle = spindle_get_hal(vfd_spindles[0].id, SpindleHAL_Raw);
-    else if(idx > 0) do {
-        if(spindle_select_get_binding(vfd_spindles[--idx].id) == (setting->id - Setting_VFD_ModbusAddress0))
-            spindle = spindle_get_hal(vfd_spindles[idx].id, SpindleHAL_Raw);
-    } while(idx && spindle == NULL);
+    if(!vfd->breaker.open || health_probe) {
 
-    return spindle && spindle->type == SpindleType_VFD;
+        memcpy(&policy, callbacks, sizeof(modbus_callbacks_t));
+        retry_policy(vfd, &policy);
+
+        if((ok = modbus_send(msg, &policy, true)))
+            breaker_success(vfd);
+    }
+
+    return ok;
 }
 
-#endif
+/*
+ * Poll scheduler.
+ *
+ * The active VFD is polled from the foreground process by the poll engine, the driver poll function
+ * sends the status request(s) and updates the telemetry snapshot from the response(s).
+ * Consumers such as get_state, load reporting and at-speed checking only read the snapshot.
+ *
+ * The VFD is polled at the fast interval while commands are pending, the spindle is ramping
+ * or not at speed and at the slow interval when VFD_POLL_STABLE_COUNT consecutive readings
+ * has been at speed and within 1% of each other. A stopped spindle is not polled.
+ */
+
+// Returns current poll interval in ms, 0 if the spindle is stopped.
+static uint32_t get_poll_interval (vfd_spindle_t *vfd, spindle_data_t *data)
+{
+    if(vfd->status == VFD_CommandPending)
+        return vfd_config.poll_fast;
 
-#if SPINDLE_ENABLE & (1<<SPINDLE_MODVFD)
+    if(!data->state_programmed.on)
+        return data->rpm < 1.0f ? 0 : vfd_config.poll_fast;
 
-#if N_SPINDLE == 1
+    return vfd->poll.stable < VFD_POLL_STABLE_COUNT ? vfd_config.poll_fast : vfd_config.poll_slow;
+}
 
-static bool is_modvfd_selected (const setting_detail_t *setting, uint_fast16_t offset)
+// Returns true if a poll is due.
+static bool poll_due (vfd_spindle_t *vfd, spindle_data_t *data)
 {
-    return true;
+    bool due;
+    uint32_t ms = hal.get_elapsed_ticks(), interval = get_poll_interval(vfd, data);
+
+    if((due = interval && ms - vfd->poll.last >= interval)) {
+
+        if(data->state_programmed.on && data->state_programmed.at_speed && fabsf(data->rpm - vfd->poll.rpm) <= data->rpm * 0.01f) {
+            if(vfd->poll.stable < VFD_POLL_STABLE_COUNT)
+                vfd->poll.stable++;
+        } else
+            vfd->poll.stable = 0;
+
+        vfd->poll.rpm = data->rpm;
+        vfd->poll.last = ms;
+    }
+
+    return due;
 }
 
-#else
+/*
+ * Adaptive feed.
+ *
+ * When a target load is set the feed override is adjusted from the filtered spindle load while
+ * a cycle is running and the spindle is at speed. The override is raised by up to VFD_ADAPTIVE_FEED_STEP
+ * per load reading when the load is below the target and lowered by up to twice as much when above,
+ * within VFD_ADAPTIVE_FEED_MIN - VFD_ADAPTIVE_FEED_MAX. The adjustment is held while the spindle is
+ * not at speed, e.g. when slowed down by the load, and the net adjustment is stepped back once per
+ * load reading when the cycle ends, the spindle is stopped or changed. Overrides made by the operator are kept.
+ */
 
-static bool is_modvfd_selected (const setting_detail_t *setting, uint_fast16_t offset)
+typedef struct {
+    float load;             // filtered load in %
+    bool filtered;          // load holds a filtered value
+    int_fast16_t offset;    // net feed override change made, in %
+    uint32_t updates;       // telemetry snapshot used for the last adjustment
+    uint32_t stepped;       // time of the last step back
+} vfd_adaptive_t;
+
+static vfd_adaptive_t adaptive = {0};
+
+static void adaptive_override (int_fast16_t change)
 {
-    bool ok = false;
-    uint_fast8_t idx = n_spindle;
+    adaptive.offset += change;
 
-    if(idx > 0) do {
-        if(spindle_select_get_binding(vfd_spindles[--idx].id) >= 0)
-            ok = !strcmp(spindle_get_name(vfd_spindles[idx].id), "MODVFD");
-    } while(idx && !ok);
+    for(; change > 0; change--)
+        enqueue_feed_override(CMD_OVERRIDE_FEED_FINE_PLUS);
 
-    return ok;
+    for(; change < 0; change++)
+        enqueue_feed_override(CMD_OVERRIDE_FEED_FINE_MINUS);
 }
 
-#endif
+static void adaptive_feed (vfd_spindle_t *vfd, spindle_data_t *data)
+{
+    sys_state_t state = state_get();
+    bool active = vfd && data && vfd_config.adaptive_load && vfd->hal.vfd.get_load &&
+                   state == STATE_CYCLE && data->state_programmed.on;
 
-#endif // SPINDLE_MODVFD
+    if(active && data->state_programmed.at_speed) {
 
-#if SPINDLE_ENABLE & ((1<<SPINDLE_GS20)|(1<<SPINDLE_YL620A))
+        if(vfd->telemetry.updates != adaptive.updates) {
 
-#if N_SPINDLE == 1
+            int_fast16_t change, feed = sys.override.feed_rate;
+            float load = vfd->hal.vfd.get_load(), target = (float)vfd_config.adaptive_load;
+
+            adaptive.load = adaptive.filtered ? adaptive.load + (load - adaptive.load) * VFD_LOAD_FILTER : load;
+            adaptive.filtered = true;
+            adaptive.updates = vfd->telemetry.updates;
+
+            if(fabsf(target - adaptive.load) > (float)VFD_ADAPTIVE_FEED_BAND) {
+
+                change = (int_fast16_t)lroundf((float)feed * (target / max(adaptive.load, 1.0f) - 1.0f));
+                change = max(min(change, VFD_ADAPTIVE_FEED_STEP), -2 * VFD_ADAPTIVE_FEED_STEP);
+
+                if(change > 0)
+                    change = max(min(change, VFD_ADAPTIVE_FEED_MAX - feed), 0);
+                else
+                    change = min(max(change, VFD_ADAPTIVE_FEED_MIN - feed), 0);
+
+                if(change)
+                    adaptive_override(change);
+            }
+        }
+    } else if(!active) {
+
+        uint32_t ms = hal.get_elapsed_ticks(), updates = vfd ? vfd->telemetry.updates : 0;
+
+        adaptive.filtered = false;
+
+        // One step per load reading, per slow poll interval when the spindle is no longer polled.
+        if(adaptive.offset && state != STATE_HOLD &&
+            (updates != adaptive.updates || ms - adaptive.stepped >= vfd_config.poll_slow)) {
+            adaptive.stepped = ms;
+            adaptive_override(max(min(-adaptive.offset, 2 * VFD_ADAPTIVE_FEED_STEP), -2 * VFD_ADAPTIVE_FEED_STEP));
+        }
+
+        adaptive.updates = updates;
+    }
+}
+
+/*
+ * Stall detection.
+ *
+ * Once the spindle has reached speed a reading more than VFD_STALL_RPM_DROP below the programmed RPM
+ * or a load above VFD_STALL_LOAD is considered a stall or overload. If it lasts for VFD_STALL_TIME
+ * while a cycle is running a feed hold is issued, the job can then be resumed with cycle start
+ * once the cause has been cleared. Detection is rearmed when the spindle is at speed again.
+ */
+
+static void stall_check (vfd_spindle_t *vfd, spindle_data_t *data)
+{
+    vfd_stall_t *stall = &vfd->stall;
+
+    if(!(vfd_config.options.stall_hold && data->state_programmed.on) || stall->rpm != data->rpm_programmed) {
+        stall->armed = false;
+        stall->since = 0;
+        stall->rpm = data->rpm_programmed;
+    }
+
+    if(!stall->armed) {
+        stall->armed = vfd_config.options.stall_hold && data->state_programmed.on && data->state_programmed.at_speed && vfd->status != VFD_CommandPending;
+        stall->updates = vfd->telemetry.updates;
+    } else if(stall->updates != vfd->telemetry.updates) {
+
+        stall->updates = vfd->telemetry.updates;
+
+        if(data->rpm < data->rpm_programmed * (1.0f - VFD_STALL_RPM_DROP) ||
+            (vfd->hal.vfd.get_load && vfd->hal.vfd.get_load() > VFD_STALL_LOAD)) {
+
+            uint32_t ms = hal.get_elapsed_ticks();
+
+            if(stall->since == 0)
+                stall->since = ms;
+            else if(ms - stall->since >= VFD_STALL_TIME && state_get() == STATE_CYCLE) {
+                stall->armed = false;
+                stall->since = 0;
+                grbl.enqueue_realtime_command(CMD_FEED_HOLD);
+                report_message(data->rpm < data->rpm_programmed * (1.0f - VFD_STALL_RPM_DROP)
+                                ? "Spindle stall detected, feed hold issued"
+                                : "Spindle overload detected, feed hold issued", Message_Warning);
+            }
+        } else
+            stall->since = 0;
+    }
+}
+
+static void vfd_poll (void)
+{
+    spindle_data_t *data = vfd_spindle ? &vfd_spindle->data : NULL;
+
+    if(data && vfd_spindle->breaker.closed) {
+        vfd_spindle->breaker.closed = false;
+        if(vfd_spindle->driver->n_params && !vfd_spindle->ready)
+            task_add_immediate(read_params_delayed, vfd_spindle);
+    }
+
+    if(data && poll_due(vfd_spindle, data) && breaker_poll(vfd_spindle))
+        vfd_spindle->send_poll();
+
+    if(data)
+        stall_check(vfd_spindle, data);
+
+    adaptive_feed(vfd_spindle, data);
+}
+
+static void vfd_execute_realtime (uint_fast16_t state)
+{
+    vfd_poll();
+
+    on_execute_realtime(state);
+}
+
+static void vfd_execute_delay (uint_fast16_t state)
+{
+    vfd_poll();
+
+    on_execute_delay(state);
+}
+
+// Load is reported when a new telemetry snapshot is available.
+static void vfd_realtime_report (stream_write_ptr stream_write, report_tracking_flags_t report)
+{
+    static float load = -1.0f;
+    static uint32_t updates = 0;
+
+    if(on_realtime_report)
+        on_realtime_report(stream_write, report);
+
+    if(legacy_spindle && legacy_spindle->hal->vfd.get_load) {
+
+        float new_load = legacy_spindle->hal->vfd.get_load();
+        if(load != new_load || spindle_changed || report.all) {
+            load = new_load;
+            spindle_changed = false;
+            stream_write("|Sl:");
+            stream_write(ftoa(load, 1));
+        }
+
+    } else if(vfd_spindle && vfd_spindle->hal.vfd.get_load) {
+
+        if(vfd_spindle->telemetry.updates != updates || spindle_changed || report.all) {
+            float new_load = vfd_spindle->hal.vfd.get_load();
+            updates = vfd_spindle->telemetry.updates;
+            if(load != new_load || spindle_changed || report.all) {
+                load = new_load;
+                spindle_changed = false;
+                stream_write("|Sl:");
+                stream_write(ftoa(load, 1));
+            }
+        }
+    }
+
+#if VFD_STATS
+    if(vfd_spindle && vfd_config.options.report_stats)
+        stats_report(stream_write, vfd_spindle);
+#endif
+}
+
+#ifdef GRBL_ESP32
+static void esp32_spindle_off (spindle_ptrs_t *spindle)
+{
+    spindle_get_hal(spindle->id, SpindleHAL_Active)->set_state(spindle, (spindle_state_t){0}, 0.0f);
+}
+#endif
+
+static void realtime_report_attach (void)
+{
+    if(on_realtime_report == NULL) {
+        on_realtime_report = grbl.on_realtime_report;
+        grbl.on_realtime_report = vfd_realtime_report;
+    }
+}
+
+static spindle_id_t add_spindle (const vfd_spindle_ptrs_t *vfd, vfd_poll_ptr send_poll, const char *name, const vfd_driver_t *driver)
+{
+    spindle_id_t spindle_id = -1;
+
+    if(n_spindle < N_SPINDLE) {
+
+        memcpy(&vfd_spindles[n_spindle].hal, vfd, sizeof(vfd_spindle_ptrs_t));
+        vfd_spindles[n_spindle].send_poll = send_poll;
+        vfd_spindles[n_spindle].driver = driver;
+
+        if((spindle_id = spindle_register(&vfd_spindles[n_spindle].hal.spindle, name)) != -1) {
+
+            vfd_spindles[n_spindle++].id = spindle_id;
+#ifdef GRBL_ESP32
+            spindle_get_hal(spindle_id, SpindleHAL_Configured)->esp32_off = esp32_spindle_off;
+#endif
+            if(vfd->vfd.get_load || VFD_STATS)
+                realtime_report_attach();
+        }
+    }
+
+    return spindle_id;
+}
+
+// Deprecated, registers a VFD spindle that handles the protocol itself. The spindle is not handled
+// by the protocol engine, vfd must point to a persistent structure.
+spindle_id_t vfd_register (const vfd_spindle_ptrs_t *vfd, const char *name)
+{
+    spindle_id_t spindle_id = -1;
+
+    if(n_spindle + n_legacy < N_SPINDLE && (spindle_id = spindle_register(&vfd->spindle, name)) != -1) {
+
+        legacy_spindles[n_legacy].id = spindle_id;
+        legacy_spindles[n_legacy++].hal = vfd;
+#ifdef GRBL_ESP32
+        spindle_get_hal(spindle_id, SpindleHAL_Configured)->esp32_off = esp32_spindle_off;
+#endif
+        if(vfd->vfd.get_load)
+            realtime_report_attach();
+    }
+
+    return spindle_id;
+}
+
+static vfd_legacy_t *get_legacy (spindle_id_t spindle_id)
+{
+    uint_fast8_t idx = n_legacy;
+
+    vfd_legacy_t *spindle = NULL;
+
+    if(n_legacy) do {
+        if(legacy_spindles[--idx].id == spindle_id)
+            spindle = &legacy_spindles[idx];
+    } while(idx && spindle == NULL);
+
+    return spindle;
+}
+
+// Deprecated, returns the pointers of the active VFD spindle, NULL if none.
+const vfd_ptrs_t *vfd_get_active (void)
+{
+    return legacy_spindle ? &legacy_spindle->hal->vfd : (vfd_spindle ? &vfd_spindle->hal.vfd : NULL);
+}
+
+#if N_SYS_SPINDLE > 1
+
+static bool is_vfd_id (spindle_id_t spindle_id)
+{
+    uint_fast8_t idx = n_spindle;
+
+    if(idx) do {
+        if(vfd_spindles[--idx].id == spindle_id)
+            return true;
+    } while(idx);
+
+    return get_legacy(spindle_id) != NULL;
+}
+
+static spindle_num_t get_spindle_num (spindle_id_t spindle_id)
+{
+    uint_fast8_t idx = N_SYS_SPINDLE;
+    spindle_ptrs_t *spindle;
+
+    do {
+        if((spindle = spindle_get(--idx)) && spindle->id == spindle_id)
+            return idx;
+    } while(idx);
+
+    return -1;
+}
+
+uint32_t vfd_get_modbus_address (spindle_id_t spindle_id)
+{
+    uint32_t modbus_address = VFD_ADDRESS;
+    spindle_num_t spindle_num;
+
+    if(is_vfd_id(spindle_id) && (spindle_num = get_spindle_num(spindle_id)) != -1)
+        modbus_address = vfd_config.modbus_address[spindle_num];
+
+    return modbus_address;
+}
+
+#elif N_SPINDLE > 1
+
+uint32_t vfd_get_modbus_address (spindle_id_t spindle_id)
+{
+    int8_t binding_id = spindle_select_get_binding(spindle_id);
+
+    return binding_id >= 0 ? vfd_config.modbus_address[(uint32_t)binding_id] : VFD_ADDRESS;
+}
+
+#else
+
+uint32_t vfd_get_modbus_address (spindle_id_t spindle_id)
+{
+    return vfd_config.modbus_address;
+}
+
+#endif
+
+#if N_SPINDLE_SELECTABLE > 1
+
+static bool is_vfd_spindle (const setting_detail_t *setting, uint_fast16_t offset)
+{
+    uint_fast8_t idx = n_spindle;
+    spindle_ptrs_t *spindle = NULL;
+
+    if(setting->id == Setting_VFD_ModbusAddress)
+        spindle = spindle_get_hal(n_spindle ? vfd_spindles[0].id : legacy_spindles[0].id, SpindleHAL_Raw);
+    else {
+        if(idx > 0) do {
+            if(spindle_select_get_binding(vfd_spindles[--idx].id) == (setting->id - Setting_VFD_ModbusAddress0))
+                spindle = spindle_get_hal(vfd_spindles[idx].id, SpindleHAL_Raw);
+        } while(idx && spindle == NULL);
+        if(spindle == NULL && (idx = n_legacy)) do {
+            if(spindle_select_get_binding(legacy_spindles[--idx].id) == (setting->id - Setting_VFD_ModbusAddress0))
+                spindle = spindle_get_hal(legacy_spindles[idx].id, SpindleHAL_Raw);
+        } while(idx && spindle == NULL);
+    }
+
+    return spindle && spindle->type == SpindleType_VFD;
+}
+
+#endif
+
+#if SPINDLE_ENABLE & (1<<SPINDLE_MODVFD)
+
+#if N_SPINDLE == 1
+
+static bool is_modvfd_selected (const setting_detail_t *setting, uint_fast16_t offset)
+{
+    return true;
+}
+
+#else
+
+static bool is_modvfd_selected (const setting_detail_t *setting, uint_fast16_t offset)
+{
+    bool ok = false;
+    uint_fast8_t idx = n_spindle;
+
+    if(idx > 0) do {
+        if(spindle_select_get_binding(vfd_spindles[--idx].id) >= 0)
+            ok = vfd_spindles[idx].driver->user_defined;
+    } while(idx && !ok);
+
+    return ok;
+}
+
+#endif
+
+#endif // SPINDLE_MODVFD
+
+#if VFD_RPM_HZ_SETTING
+
+#if N_SPINDLE == 1
+
+static bool is_ysgl_selected (const setting_detail_t *setting, uint_fast16_t offset)
+{
+    return true;
+}
+
+#else
+
+static bool is_ysgl_selected (const setting_detail_t *setting, uint_fast16_t offset)
+{
+    bool ok = false;
+    uint_fast8_t idx = n_spindle;
+
+    if(idx > 0) do {
+        if(spindle_select_get_binding(vfd_spindles[--idx].id) >= 0)
+            ok = vfd_spindles[idx].driver->scaling.source == VFD_Scaling_RPMHz;
+    } while(idx && !ok);
+
+    return ok;
+}
+
+#endif
+
+#endif // VFD_RPM_HZ_SETTING
+
+PROGMEM static const setting_group_detail_t vfd_groups [] = {
+    { Group_Root, Group_VFD, "VFD" }
+};
+
+PROGMEM static const setting_detail_t vfd_settings[] = {
+#if N_SPINDLE_SELECTABLE > 1
+     { Setting_VFD_ModbusAddress, Group_VFD, "", NULL, Format_Int8, "##0", NULL, "255", Setting_NonCore, &vfd_config.modbus_address[0], NULL, is_vfd_spindle, { .hidden = On } },
+     { Setting_VFD_ModbusAddress0, Group_VFD, "Spindle 1 ModBus address", NULL, Format_Int8, "##0", NULL, "255", Setting_NonCore, &vfd_config.modbus_address[0], NULL, is_vfd_spindle },
+     { Setting_VFD_ModbusAddress1, Group_VFD, "Spindle 2 ModBus address", NULL, Format_Int8, "##0", NULL, "255", Setting_NonCore, &vfd_config.modbus_address[1], NULL, is_vfd_spindle },
+  #if N_SPINDLE_SELECTABLE > 2
+     { Setting_VFD_ModbusAddress2, Group_VFD, "Spindle 3 ModBus address", NULL, Format_Int8, "##0", NULL, "255", Setting_NonCore, &vfd_config.modbus_address[2], NULL, is_vfd_spindle },
+  #endif
+  #if N_SPINDLE_SELECTABLE > 3
+     { Setting_VFD_ModbusAddress3, Group_VFD, "Spindle 4 ModBus address", NULL, Format_Int8, "##0", NULL, "255", Setting_NonCore, &vfd_config.modbus_address[3], NULL, is_vfd_spindle },
+  #endif
+#else
+     { Setting_VFD_ModbusAddress, Group_VFD, "VFD spindle ModBus address", NULL, Format_Int8, "##0", NULL, "255", Setting_NonCore, &vfd_config.modbus_address, NULL, NULL },
+#endif
+#if VFD_RPM_HZ_SETTING
+     { Setting_VFD_RPM_Hz, Group_VFD, "RPM per Hz", "", Format_Int16, "###0", "1", "3000", Setting_NonCore, &vfd_config.vfd_rpm_hz, NULL, is_ysgl_selected },
+#endif
+#if SPINDLE_ENABLE & (1<<SPINDLE_MODVFD)
+     { Setting_VFD_10, Group_VFD, "Run/Stop Register (decimal)", NULL, Format_Int16, "####0", NULL, "65535", Setting_NonCore, &vfd_config.runstop_reg, NULL, is_modvfd_selected },
+     { Setting_VFD_11, Group_VFD, "Set Frequency Register (decimal)", "", Format_Int16, "####0", NULL, "65535", Setting_NonCore, &vfd_config.set_freq_reg, NULL, is_modvfd_selected },
+     { Setting_VFD_12, Group_VFD, "Get Frequency Register (decimal)", NULL, Format_Int16, "####0", NULL, "65535", Setting_NonCore, &vfd_config.get_freq_reg, NULL, is_modvfd_selected },
+     { Setting_VFD_13, Group_VFD, "Run CW Command (decimal)", "", Format_Int16, "####0", NULL, "65535", Setting_NonCore, &vfd_config.run_cw_cmd, NULL, is_modvfd_selected },
+     { Setting_VFD_14, Group_VFD, "Run CCW Command (decimal)", NULL, Format_Int16, "####0", NULL, "65535", Setting_NonCore, &vfd_config.run_ccw_cmd, NULL, is_modvfd_selected },
+     { Setting_VFD_15, Group_VFD, "Stop Command (decimal)", "", Format_Int16, "####0", NULL, "65535", Setting_NonCore, &vfd_config.stop_cmd, NULL, is_modvfd_selected },
+     { Setting_VFD_16, Group_VFD, "RPM input Multiplier", "", Format_Decimal, "########0", NULL, NULL, Setting_NonCore, &vfd_config.in_multiplier, NULL, is_modvfd_selected },
+     { Setting_VFD_17, Group_VFD, "RPM input Divider", "", Format_Decimal, "########0", NULL, NULL, Setting_NonCore, &vfd_config.in_divider, NULL, is_modvfd_selected },
+     { Setting_VFD_18, Group_VFD, "RPM output Multiplier", "", Format_Decimal, "########0", NULL, NULL, Setting_NonCore, &vfd_config.out_multiplier, NULL, is_modvfd_selected },
+     { Setting_VFD_19, Group_VFD, "RPM output Divider", "", Format_Decimal, "########0", NULL, NULL, Setting_NonCore, &vfd_config.out_divider, NULL, is_modvfd_selected },
+#endif
+     { Setting_VFD_PollIntervalFast, Group_VFD, "Poll interval, ramping", "ms", Format_Int16, "###0", "10", "1000", Setting_NonCore, &vfd_config.poll_fast, NULL, NULL },
+     { Setting_VFD_PollIntervalSlow, Group_VFD, "Poll interval, stable", "ms", Format_Int16, "###0", "10", "5000", Setting_NonCore, &vfd_config.poll_slow, NULL, NULL },
+     { Setting_VFD_Options, Group_VFD, "VFD options", NULL, Format_Bitfield, "Bus statistics in real time report,Predictive at speed,Feed hold on stall,Automatic fault recovery,RPM/Hz from motor poles,MODVFD Write Multiple Registers", NULL, NULL, Setting_NonCore, &vfd_config.options.value, NULL, NULL },
+     { Setting_VFD_AdaptiveLoad, Group_VFD, "Adaptive feed target load", "%", Format_Int8, "##0", NULL, "100", Setting_NonCore, &vfd_config.adaptive_load, NULL, NULL },
+     { Setting_VFD_Deadband, Group_VFD, "Spindle speed deadband", "RPM", Format_Int16, "####0", NULL, "1000", Setting_NonCore, &vfd_config.deadband, NULL, NULL },
+};
+
+PROGMEM static const setting_descr_t vfd_settings_descr[] = {
+#if N_SPINDLE_SELECTABLE > 1
+    { Setting_VFD_ModbusAddress0, "Spindle 1 (default spindle) VFD ModBus address" },
+    { Setting_VFD_ModbusAddress1, "Spindle 2 ModBus address" },
+  #if N_SPINDLE_SELECTABLE > 2
+    { Setting_VFD_ModbusAddress2, "Spindle 3 ModBus address" },
+  #endif
+  #if N_SPINDLE_SELECTABLE > 3
+    { Setting_VFD_ModbusAddress3, "Spindle 4 ModBus address" },
+  #endif
+#else
+    { Setting_VFD_ModbusAddress, "VFD ModBus address" },
+#endif
+#if VFD_RPM_HZ_SETTING
+    { Setting_VFD_RPM_Hz, "RPM/Hz value for GS20, YL620A and VFD profiles" },
+#endif
+#if SPINDLE_ENABLE & (1<<SPINDLE_MODVFD)
+    { Setting_VFD_10, "MODVFD Register for Run/stop" },
+    { Setting_VFD_11, "MODVFD Set Frequency Register" },
+    { Setting_VFD_12, "MODVFD Get Frequency Register" },
+    { Setting_VFD_13, "MODVFD Command word for CW" },
+    { Setting_VFD_14, "MODVFD Command word for CCW" },
+    { Setting_VFD_15, "MODVFD Command word for stop" },
+    { Setting_VFD_16, "MODVFD RPM value multiplier for programming RPM" },
+    { Setting_VFD_17, "MODVFD RPM value divider for programming RPM" },
+    { Setting_VFD_18, "MODVFD RPM value multiplier for reading RPM" },
+    { Setting_VFD_19, "MODVFD RPM value divider for reading RPM" },
+#endif
+    { Setting_VFD_PollIntervalFast, "Interval between VFD status requests while the spindle is accelerating, decelerating or not at speed." },
+    { Setting_VFD_PollIntervalSlow, "Interval between VFD status requests when the spindle speed is stable." },
+    { Setting_VFD_Options, "Bus statistics in real time report: adds |VFD:<requests>,<failed requests>,<status poll round trip time in ms> for the active VFD.\\n"
+                          "Predictive at speed: signal at speed between polls when the spindle speed estimated from the VFD ramp rate is within tolerance.\\n"
+                          "Feed hold on stall: issue a feed hold when the spindle speed drops well below the programmed speed or the spindle is overloaded while a cycle is running.\\n"
+                          "Automatic fault recovery: reset recoverable VFD faults and reconnect after communication errors instead of raising an alarm, a running cycle is held until resumed.\\n"
+                          "RPM/Hz from motor poles: use the number of motor poles read from the VFD instead of $461 for VFDs that report it.\\n"
+                          "MODVFD Write Multiple Registers: write run/direction and frequency in one command when the frequency register follows the run/stop register, requires a VFD that supports function code 16." },
+    { Setting_VFD_AdaptiveLoad, "Spindle load to maintain by adjusting the feed override while a cycle is running, set to 0 to disable.\\n"
+                                "Requires a VFD that reports output current and rated motor current." },
+    { Setting_VFD_Deadband, "Spindle speed changes smaller than this are not sent to the VFD, set to 0 to send all changes that alter the programmed frequency.\\n"
+                            "Should be less than the at speed tolerance." },
+};
+
+static void configure_drivers (void);
+#if VFD_PARAM_CACHE
+static void cache_clear (void);
+#endif
+static void silence_clear (void);
+
+// Settings up to out_divider have the layout of earlier versions, later settings are appended.
+#define VFD_SETTINGS_V1_SIZE offsetof(vfd_settings_t, poll_fast)
+
+static void vfd_settings_save (void)
+{
+    hal.nvs.memcpy_to_nvs(nvs_address, (uint8_t *)&vfd_config, sizeof(vfd_settings_t), true);
+
+    configure_drivers();
+}
+
+static void settings_appended_restore (void)
+{
+    vfd_config.poll_fast = VFD_POLL_INTERVAL_FAST;
+    vfd_config.poll_slow = VFD_POLL_INTERVAL_SLOW;
+    vfd_config.options.value = 0;
+    vfd_config.adaptive_load = 0;
+    vfd_config.deadband = 0;
+}
+
+static void vfd_settings_restore (void)
+{
+#if N_SPINDLE > 1 || N_SYS_SPINDLE > 1
+    uint_fast8_t idx = VFD_N_ADRESSES;
+    do {
+        idx--;
+        vfd_config.modbus_address[idx] = VFD_ADDRESS + idx;
+    } while(idx);
+#else
+    vfd_config.modbus_address = VFD_ADDRESS;
+#endif
+//MODVFD settings below are defaulted to values for GS20 VFD
+    vfd_config.vfd_rpm_hz = 60;
+    vfd_config.runstop_reg = 8192; //0x2000
+    vfd_config.set_freq_reg = 8193; //0x2001
+    vfd_config.get_freq_reg = 8451; //0x2103
+    vfd_config.run_cw_cmd = 18; //0x12
+    vfd_config.run_ccw_cmd = 34; //0x22
+    vfd_config.stop_cmd = 1; //0x02
+    vfd_config.in_multiplier = 50;
+    vfd_config.in_divider = 60;
+    vfd_config.out_multiplier = 60;
+    vfd_config.out_divider = 100;
+
+    settings_appended_restore();
+
+#if VFD_PARAM_CACHE
+    cache_clear();
+#endif
+    silence_clear();
+
+    hal.nvs.memcpy_to_nvs(nvs_address, (uint8_t *)&vfd_config, sizeof(vfd_settings_t), true);
+}
+
+// Settings stored by an earlier version are kept and the appended settings are set to default values.
+static void vfd_settings_load (void)
+{
+    if((hal.nvs.memcpy_from_nvs((uint8_t *)&vfd_config, nvs_address, sizeof(vfd_settings_t), true) != NVS_TransferResult_OK)) {
+
+        if(hal.nvs.memcpy_from_nvs((uint8_t *)&vfd_config, nvs_address, VFD_SETTINGS_V1_SIZE, true) == NVS_TransferResult_OK) {
+            settings_appended_restore();
+            hal.nvs.memcpy_to_nvs(nvs_address, (uint8_t *)&vfd_config, sizeof(vfd_settings_t), true);
+        } else
+            vfd_settings_restore();
+    }
+}
+
+static vfd_spindle_t *get_spindle (spindle_id_t spindle_id)
+{
+    uint_fast8_t idx = n_spindle;
+
+    vfd_spindle_t *spindle = NULL;
+
+    if(n_spindle) do {
+        if(vfd_spindles[--idx].id == spindle_id)
+            spindle = &vfd_spindles[idx];
+    } while(idx && spindle == NULL);
+
+    return spindle;
+}
+
+/*
+ * Command pipeline.
+ *
+ * Run/direction, frequency and status requests are queued per VFD and sent without waiting for the response.
+ * Only one request per VFD is on the bus at a time, the next is sent from the response handler of
+ * the previous one. Requests are sent in priority order: control commands first, then frequency commands
+ * and status requests last. A run/stop or frequency change thus waits for at most one frame in flight
+ * and never for queued status polls.
+ * Responses are forwarded to the driver callbacks with the driver context restored.
+ *
+ * Each command type has a single slot acting as a mailbox: a command queued while another of the same
+ * type is waiting replaces it. Frequent RPM updates, e.g. from G96 or overrides, thus never queue up
+ * or get lost, the latest value is sent as soon as the bus is free. Likewise a status request is
+ * superseded by a newer one and never duplicated.
+ *
+ * Sending is deferred to the next foreground task run so that a run/direction command and the following
+ * frequency command can be combined into one Write Multiple Registers command when the VFD supports it
+ * and the register layout allows it, see combine_commands(). If the VFD responds to a combined command
+ * with an illegal function exception the commands are sent separately from then on.
+ */
+
+// Commands affecting spindle state, status requests do not change the command status.
+#define PIPELINE_COMMANDS ((1 << VFD_Command_Control)|(1 << VFD_Command_Frequency))
+
+static void pipeline_rx_packet (modbus_message_t *msg);
+static void pipeline_rx_exception (uint8_t code, void *context);
+static void pipeline_requeue (vfd_spindle_t *vfd);
+
+static const modbus_callbacks_t pipeline_callbacks = {
+    .retries = VFD_RETRIES,
+    .retry_delay = VFD_RETRY_DELAY,
+    .on_rx_packet = pipeline_rx_packet,
+    .on_rx_exception = pipeline_rx_exception
+};
+
+#if VFD_COMBINED_WRITE && MODBUS_MAX_ADU_SIZE >= 13
+
+// Gets register address and value from a single register write command,
+// either Write Single Register (0x06) or Write Multiple Registers (0x10) with one register.
+static bool get_register_write (modbus_message_t *msg, uint16_t *reg, uint16_t *value)
+{
+    bool ok;
+
+    if((ok = msg->adu[1] == ModBus_WriteRegister && msg->tx_length == 8))
+        *value = (msg->adu[4] << 8) | msg->adu[5];
+    else if((ok = msg->adu[1] == ModBus_WriteRegisters && msg->tx_length == 11 && msg->adu[4] == 0 && msg->adu[5] == 1 && msg->adu[6] == 2))
+        *value = (msg->adu[7] << 8) | msg->adu[8];
+
+    if(ok)
+        *reg = (msg->adu[2] << 8) | msg->adu[3];
+
+    return ok;
+}
+
+#endif
+
+// Combines pending control and frequency commands into a single Write Multiple Registers (0x10) command
+// if the VFD frequency register follows directly after the control register.
+static bool combine_commands (vfd_spindle_t *vfd, modbus_message_t *msg)
+{
+#if VFD_COMBINED_WRITE && MODBUS_MAX_ADU_SIZE >= 13
+
+    uint16_t control_reg, control, freq_reg, freq;
+    modbus_message_t *control_cmd = &vfd->command[VFD_Command_Control].msg,
+                     *freq_cmd = &vfd->command[VFD_Command_Frequency].msg;
+
+    if(vfd->combine && vfd->command[VFD_Command_Control].pending && vfd->command[VFD_Command_Frequency].pending &&
+        control_cmd->adu[0] == freq_cmd->adu[0] &&
+         get_register_write(control_cmd, &control_reg, &control) &&
+          get_register_write(freq_cmd, &freq_reg, &freq) && freq_reg == control_reg + 1) {
+
+        msg->crc_check = control_cmd->crc_check;
+        msg->adu[0] = control_cmd->adu[0];
+        msg->adu[1] = ModBus_WriteRegisters;
+        msg->adu[2] = control_reg >> 8;
+        msg->adu[3] = control_reg & 0xFF;
+        msg->adu[4] = 0x00;
+        msg->adu[5] = 0x02;
+        msg->adu[6] = 0x04;
+        msg->adu[7] = control >> 8;
+        msg->adu[8] = control & 0xFF;
+        msg->adu[9] = freq >> 8;
+        msg->adu[10] = freq & 0xFF;
+        msg->tx_length = 13;
+        msg->rx_length = 8;
+
+        return true;
+    }
+#endif
+
+    return false;
+}
+
+static void pipeline_send (void *data)
+{
+    vfd_spindle_t *vfd = (vfd_spindle_t *)data;
+    vfd_command_type_t type = VFD_N_COMMANDS, next = VFD_N_COMMANDS;
+
+    vfd->kick = false;
+
+    if(vfd->in_flight)
+        return;
+
+    do {
+        if(vfd->command[--type].pending)
+            next = type;
+    } while(type);
+
+    if(next != VFD_N_COMMANDS) {
+
+        uint8_t commands;
+        modbus_message_t msg;
+
+        if(combine_commands(vfd, &msg))
+            commands = (1 << VFD_Command_Control)|(1 << VFD_Command_Frequency);
+        else {
+            commands = 1 << next;
+            memcpy(&msg, &vfd->command[next].msg, sizeof(modbus_message_t));
+        }
+
+        msg.context = vfd;
+
+        type = VFD_N_COMMANDS;
+        do {
+            if(commands & (1 << --type))
+                vfd->command[type].pending = false;
+        } while(type);
+
+        vfd->in_flight = commands;
+
+        memcpy(&vfd->breaker.callbacks, &pipeline_callbacks, sizeof(modbus_callbacks_t));
+        retry_policy(vfd, &vfd->breaker.callbacks);
+
+        if(!modbus_send(&msg, &vfd->breaker.callbacks, false)) {
+            // ModBus queue is full, try again later.
+            pipeline_requeue(vfd);
+            task_add_delayed(pipeline_send, vfd, 5);
+        } else
+            stats_sent(vfd, pipeline_request(commands));
+    }
+
+    if(vfd->status == VFD_CommandPending && !(vfd->in_flight & PIPELINE_COMMANDS) &&
+        !vfd->command[VFD_Command_Control].pending && !vfd->command[VFD_Command_Frequency].pending)
+        vfd->status = VFD_CommandIdle;
+}
+
+static void pipeline_rx_packet (modbus_message_t *msg)
+{
+    vfd_spindle_t *vfd = (vfd_spindle_t *)msg->context;
+    vfd_command_type_t type;
+    uint8_t commands = vfd->in_flight;
+
+    vfd->in_flight = 0;
+
+    breaker_success(vfd);
+
+    if(commands)
+        stats_received(vfd, pipeline_request(commands), false);
+
+    // A combined command is acknowledged to the driver as separate control and frequency commands.
+    for(type = VFD_Command_Control; type < VFD_N_COMMANDS; type++) {
+        if((commands & (1 << type)) && vfd->command[type].callbacks->on_rx_packet) {
+            msg->context = vfd->command[type].msg.context;
+            vfd->command[type].callbacks->on_rx_packet(msg);
+        }
+    }
+
+    pipeline_send(vfd);
+}
+
+static void pipeline_rx_exception (uint8_t code, void *context)
+{
+    vfd_spindle_t *vfd = (vfd_spindle_t *)context;
+    vfd_command_type_t type = VFD_Command_Control;
+    uint8_t commands = vfd->in_flight;
+
+    vfd->in_flight = 0;
+
+    breaker_failed(vfd, code);
+
+    if(code == MODBUS_ILLEGAL_FUNCTION && commands == PIPELINE_COMMANDS) {
+        // Write Multiple Registers is not supported by the VFD, resend the combined commands separately.
+        stats_failed(vfd, pipeline_request(commands), code);
+        vfd->combine = false;
+        vfd->in_flight = commands;
+        pipeline_requeue(vfd);
+        pipeline_send(vfd);
+        return;
+    }
+
+    if(commands & PIPELINE_COMMANDS)
+        vfd->status = VFD_CommandFailed;
+
+    if(commands) {
+
+        stats_failed(vfd, pipeline_request(commands), code);
+
+        while(!(commands & (1 << type)))
+            type++;
+
+        if(vfd->command[type].callbacks->on_rx_exception)
+            vfd->command[type].callbacks->on_rx_exception(code, vfd->command[type].msg.context);
+    }
+
+    pipeline_send(vfd);
+}
+
+// Marks commands in flight as pending again unless replaced by a newer one.
+static void pipeline_requeue (vfd_spindle_t *vfd)
+{
+    vfd_command_type_t type = VFD_N_COMMANDS;
+
+    do {
+        if(vfd->in_flight & (1 << --type))
+            vfd->command[type].pending = true;
+    } while(type);
+
+    vfd->in_flight = 0;
+}
+
+// Restarts commands lost by a ModBus queue flush.
+static void pipeline_restart (vfd_spindle_t *vfd)
+{
+    pipeline_requeue(vfd);
+    pipeline_send(vfd);
+}
+
+static bool queue_command (vfd_spindle_t *vfd, vfd_command_type_t type, modbus_message_t *msg, const modbus_callbacks_t *callbacks)
+{
+    memcpy(&vfd->command[type].msg, msg, sizeof(modbus_message_t));
+    vfd->command[type].callbacks = callbacks;
+    vfd->command[type].pending = true;
+
+    if(type != VFD_Command_Telemetry) {
+        vfd->status = VFD_CommandPending;
+        vfd->poll.stable = 0;
+    }
+
+    if(!vfd->kick && !(vfd->kick = task_add_immediate(pipeline_send, vfd)))
+        pipeline_send(vfd);
+
+    return true;
+}
+
+static void read_registers (modbus_message_t *msg, uint32_t modbus_address, uint8_t function, uint16_t address, uint8_t n_regs)
+{
+    memset(msg, 0, sizeof(modbus_message_t));
+
+    msg->adu[0] = modbus_address;
+    msg->adu[1] = function;
+    msg->adu[2] = address >> 8;
+    msg->adu[3] = address & 0xFF;
+    msg->adu[4] = 0x00;
+    msg->adu[5] = n_regs;
+    msg->tx_length = 8;
+    msg->rx_length = 5 + n_regs * 2;
+}
+
+vfd_telemetry_t *vfd_get_telemetry (spindle_id_t spindle_id)
+{
+    vfd_spindle_t *vfd = get_spindle(spindle_id);
+
+    return vfd ? &vfd->telemetry : NULL;
+}
+
+static void telemetry_updated (vfd_spindle_t *vfd)
+{
+    uint32_t ms = hal.get_elapsed_ticks();
+
+    if(vfd->telemetry.updates && vfd->telemetry.power > 0.0f)
+        vfd->telemetry.energy += vfd->telemetry.power * (float)(ms - vfd->telemetry.timestamp) / 3600000.0f;
+
+    vfd->telemetry.timestamp = ms;
+    vfd->telemetry.updates++;
+    vfd->telemetry.exceptions = 0;
+
+    spindle_validate_at_speed(vfd->data, vfd->telemetry.rpm);
+}
+
+static bool telemetry_failed (vfd_spindle_t *vfd)
+{
+    bool failed;
+
+    if((failed = ++vfd->telemetry.exceptions == VFD_ASYNC_EXCEPTION_LEVEL))
+        vfd->telemetry.exceptions = 0;
+
+    return failed;
+}
+
+// Returns age of telemetry data in ms, UINT32_MAX if no data has been received.
+uint32_t vfd_telemetry_age (const vfd_telemetry_t *telemetry)
+{
+    return telemetry->updates ? hal.get_elapsed_ticks() - telemetry->timestamp : UINT32_MAX;
+}
+
+// Fixed point scaling, see util.c.
+
+static inline uint32_t rpm_to_freq (vfd_spindle_t *vfd, float rpm)
+{
+    return vfd_factor_apply(&vfd->scale.set, rpm > 0.0f ? (uint32_t)(rpm * (float)(1 << VFD_RPM_FRAC_BITS) + 0.5f) : 0);
+}
+
+static inline float freq_to_rpm (vfd_spindle_t *vfd, uint32_t freq)
+{
+    return (float)vfd_factor_apply(&vfd->scale.get, freq) / (float)(1 << VFD_RPM_FRAC_BITS);
+}
+
+/*
+ * Ramp model.
+ *
+ * VFDs ramp the output frequency linearly, the spindle RPM between polls is estimated from the last
+ * reading and the acceleration or deceleration rate towards the programmed RPM. Rates are derived from
+ * the VFD acceleration and deceleration times if read from the VFD and are learned from consecutive
+ * readings taken while ramping. Each reading restarts the estimate so errors in the model are
+ * corrected at the next poll.
+ *
+ * At speed the deviation of readings from the programmed RPM, e.g. from frequency resolution or slip
+ * compensation, is low pass filtered and added to the estimate. The estimate is returned for
+ * SpindleData_RPM requests without any bus traffic and can thus be used at the planner update rate.
+ *
+ * With the predictive at speed option enabled the estimate is used to signal at speed between
+ * polls, motion can then start as soon as the spindle is estimated to be up to speed.
+ */
+
+static inline float ramp_target (vfd_spindle_t *vfd)
+{
+    return vfd->data.state_programmed.on && vfd->data.rpm_programmed > 0.0f ? vfd->data.rpm_programmed : 0.0f;
+}
+
+// Called with a new RPM reading.
+static void ramp_update (vfd_spindle_t *vfd, float rpm)
+{
+    vfd_ramp_update(&vfd->ramp, rpm, ramp_target(vfd), vfd->data.rpm_low_limit, vfd->data.rpm_high_limit, hal.get_elapsed_ticks());
+}
+
+// Returns estimated RPM, the last reading if no reading has been taken or the ramp rate is not known.
+static float ramp_estimate (vfd_spindle_t *vfd)
+{
+    return vfd_ramp_estimate(&vfd->ramp, ramp_target(vfd), hal.get_elapsed_ticks());
+}
+
+// Rates are set from VFD parameters only until learned.
+static void ramp_configure (vfd_spindle_t *vfd)
+{
+    float rpm_max = freq_to_rpm(vfd, vfd->params.freq_max);
+
+    if(rpm_max > 0.0f) {
+        if(vfd->ramp.accel == 0.0f && vfd->params.accel_time > 0.0f)
+            vfd->ramp.accel = rpm_max / vfd->params.accel_time;
+        if(vfd->ramp.decel == 0.0f && vfd->params.decel_time > 0.0f)
+            vfd->ramp.decel = rpm_max / vfd->params.decel_time;
+    }
+}
+
+// Returns spindle state in a spindle_state_t variable, from the latest data received.
+// Spindle is not reported at speed while commands are pending.
+static spindle_state_t vfd_get_state (spindle_ptrs_t *spindle)
+{
+    vfd_spindle_t *vfd = get_spindle(spindle->id);
+    spindle_state_t state = {0};
+    spindle_data_t *data = spindle->get_data(SpindleData_AtSpeed);
+
+    state.on = data->state_programmed.on;
+    state.ccw = data->state_programmed.ccw;
+    state.at_speed = data->state_programmed.at_speed && !(vfd && vfd->status == VFD_CommandPending);
+
+    if(!state.at_speed && state.on && data->at_speed_enabled && vfd_config.options.at_speed_predict &&
+        vfd && vfd->status != VFD_CommandPending) {
+        float rpm = ramp_estimate(vfd);
+        state.at_speed = rpm >= data->rpm_low_limit && rpm <= data->rpm_high_limit;
+    }
+
+    return state;
+}
+
+/*
+ * Protocol engine.
+ *
+ * Handles VFDs described by a vfd_driver_t descriptor. The register map and scaling are resolved
+ * from the descriptor, settings and parameters read from the VFD when the spindle is selected
+ * and when any of these changes. Commands, polls and responses then only use the resolved values.
+ *
+ * Parameters are read with blocking requests on selection, after a reset and on a spindle on
+ * command if not yet read. Drives without parameters to read are ready when the first run/stop
+ * command is acknowledged. The VFD is not polled until ready.
+ */
+
+static void command_rx_packet (modbus_message_t *msg);
+static void command_rx_exception (uint8_t code, void *context);
+static void telemetry_rx_packet (modbus_message_t *msg);
+static void telemetry_rx_exception (uint8_t code, void *context);
+static void param_rx_packet (modbus_message_t *msg);
+static void param_rx_exception (uint8_t code, void *context);
+static void probe_rx_exception (uint8_t code, void *context);
+static void recovery_start (vfd_spindle_t *vfd);
+
+static const modbus_callbacks_t command_callbacks = {
+    .retries = VFD_RETRIES,
+    .retry_delay = VFD_RETRY_DELAY,
+    .on_rx_packet = command_rx_packet,
+    .on_rx_exception = command_rx_exception
+};
+
+static const modbus_callbacks_t telemetry_callbacks = {
+    .retries = VFD_RETRIES,
+    .retry_delay = VFD_RETRY_DELAY,
+    .on_rx_packet = telemetry_rx_packet,
+    .on_rx_exception = telemetry_rx_exception
+};
+
+static const modbus_callbacks_t probe_callbacks = {
+    .retries = VFD_RETRIES,
+    .retry_delay = VFD_RETRY_DELAY,
+    .on_rx_exception = probe_rx_exception
+};
+
+static const modbus_callbacks_t param_callbacks = {
+    .retries = VFD_RETRIES,
+    .retry_delay = VFD_RETRY_DELAY,
+    .on_rx_packet = param_rx_packet,
+    .on_rx_exception = param_rx_exception
+};
+
+// Builds a Huanyang v1 request with a single value, length is the number of data bytes:
+// 1 for run/stop commands, 2 for frequency commands and 3 for reads.
+static void huanyang_request (modbus_message_t *msg, uint32_t modbus_address, uint8_t function, uint8_t length, uint16_t value)
+{
+    memset(msg, 0, sizeof(modbus_message_t));
+
+    msg->adu[0] = modbus_address;
+    msg->adu[1] = function;
+    msg->adu[2] = length;
+
+    if(length == 2) {
+        msg->adu[3] = value >> 8;
+        msg->adu[4] = value & 0xFF;
+    } else
+        msg->adu[3] = value & 0xFF;
+
+    msg->tx_length = length + 5;
+    msg->rx_length = length == 3 ? 8 : 6;
+}
+
+static void write_register (modbus_message_t *msg, uint32_t modbus_address, uint8_t function, uint16_t address, uint16_t value)
+{
+    memset(msg, 0, sizeof(modbus_message_t));
+
+    msg->adu[0] = modbus_address;
+    msg->adu[1] = function;
+
+    switch(function) {
+
+        case ModBus_WriteCoil:
+            msg->adu[2] = value >> 8;
+            msg->adu[3] = value & 0xFF;
+            msg->adu[4] = 0xFF;
+            msg->adu[5] = 0x00;
+            msg->tx_length = 8;
+            break;
+
+        case ModBus_WriteRegisters:
+            msg->adu[2] = address >> 8;
+            msg->adu[3] = address & 0xFF;
+            msg->adu[4] = 0x00;
+            msg->adu[5] = 0x01;
+            msg->adu[6] = 0x02;
+            msg->adu[7] = value >> 8;
+            msg->adu[8] = value & 0xFF;
+            msg->tx_length = 11;
+            break;
+
+        default:
+            msg->adu[2] = address >> 8;
+            msg->adu[3] = address & 0xFF;
+            msg->adu[4] = value >> 8;
+            msg->adu[5] = value & 0xFF;
+            msg->tx_length = 8;
+            break;
+    }
+
+    msg->rx_length = 8;
+}
+
+#if MODBUS_MAX_ADU_SIZE >= 13
+
+// Writes a 32 bit value to two consecutive registers with Write Multiple Registers (0x10).
+static void write_register32 (modbus_message_t *msg, uint32_t modbus_address, uint16_t address, uint32_t value, bool lsw_first)
+{
+    uint16_t first = lsw_first ? value & 0xFFFF : value >> 16,
+             second = lsw_first ? value >> 16 : value & 0xFFFF;
+
+    memset(msg, 0, sizeof(modbus_message_t));
+
+    msg->adu[0] = modbus_address;
+    msg->adu[1] = ModBus_WriteRegisters;
+    msg->adu[2] = address >> 8;
+    msg->adu[3] = address & 0xFF;
+    msg->adu[4] = 0x00;
+    msg->adu[5] = 0x02;
+    msg->adu[6] = 0x04;
+    msg->adu[7] = first >> 8;
+    msg->adu[8] = first & 0xFF;
+    msg->adu[9] = second >> 8;
+    msg->adu[10] = second & 0xFF;
+    msg->tx_length = 13;
+    msg->rx_length = 8;
+}
+
+#endif
+
+// Number of registers holding a frequency or current value.
+static inline uint_fast8_t value_words (vfd_spindle_t *vfd)
+{
+    return vfd->driver->words == 2 ? 2 : 1;
+}
+
+static void read_request (vfd_spindle_t *vfd, modbus_message_t *msg, uint8_t function, uint16_t address, uint8_t n_regs)
+{
+    if(vfd->driver->protocol == VFD_Protocol_Huanyang)
+        huanyang_request(msg, vfd->modbus_address, function, 3, address);
+    else {
+        read_registers(msg, vfd->modbus_address, function, address, n_regs);
+        if(vfd->driver->protocol == VFD_Protocol_HuanyangP2A)
+            msg->rx_length = 8;
+    }
+}
+
+// Gets value of register n from a read response, a 32 bit value is read from registers n and n + 1 when words is 2.
+static bool response_value (vfd_spindle_t *vfd, modbus_message_t *msg, uint_fast8_t n, uint_fast8_t words, uint32_t *value)
+{
+    bool ok;
+
+    if(vfd->driver->protocol != VFD_Protocol_ModBus) {
+        if((ok = n == 0))
+            *value = (msg->adu[4] << 8) | msg->adu[5];
+    } else
+        ok = vfd_register_value(msg->adu, n, words, vfd->driver->lsw_first, value);
+
+    return ok;
+}
+
+// Resolves the register map and scaling.
+static void vfd_configure (vfd_spindle_t *vfd)
+{
+    const vfd_driver_t *driver = vfd->driver;
+    uint32_t rpm_per_hz = driver->scaling.rpm_per_hz, per_hz = 1; // RPM per Hz is rpm_per_hz / per_hz
+
+    vfd->map.control = driver->control;
+    vfd->map.frequency = driver->frequency;
+    vfd->map.telemetry = driver->telemetry;
+
+    if(driver->user_defined) {
+
+        vfd->map.control.address = vfd_config.runstop_reg;
+        vfd->map.control.stop = vfd_config.stop_cmd;
+        vfd->map.control.cw = vfd_config.run_cw_cmd;
+        vfd->map.control.ccw = vfd_config.run_ccw_cmd;
+        vfd->map.frequency.address = vfd_config.set_freq_reg;
+        vfd->map.telemetry.address = vfd_config.get_freq_reg;
+        // Multipliers and dividers are float settings, resolved to 0.001.
+        vfd_factor_set(&vfd->scale.set, vfd_config.in_multiplier > 0.0f ? (uint64_t)lroundf(vfd_config.in_multiplier * 1000.0f) : 0,
+                                     vfd_config.in_divider > 0.0f ? (uint64_t)lroundf(vfd_config.in_divider * 1000.0f) << VFD_RPM_FRAC_BITS : 0);
+        vfd_factor_set(&vfd->scale.get, vfd_config.out_multiplier > 0.0f ? (uint64_t)lroundf(vfd_config.out_multiplier * 1000.0f) << VFD_RPM_FRAC_BITS : 0,
+                                     vfd_config.out_divider > 0.0f ? (uint64_t)lroundf(vfd_config.out_divider * 1000.0f) : 0);
+
+    } else if(driver->scaling.source == VFD_Scaling_MaxRPM) {
+
+        vfd_factor_set(&vfd->scale.set, 10000, (uint64_t)vfd->params.rpm_max << VFD_RPM_FRAC_BITS);
+        vfd_factor_set(&vfd->scale.get, 1 << VFD_RPM_FRAC_BITS, 1);
+
+    } else {
+
+        if(driver->scaling.source == VFD_Scaling_RPMHz) {
+            if(vfd->params.poles && vfd_config.options.poles_scaling) {
+                rpm_per_hz = 120;
+                per_hz = vfd->params.poles;
+            } else
+                rpm_per_hz = vfd_config.vfd_rpm_hz;
+        } else if(driver->scaling.source == VFD_Scaling_RPMAt50Hz && vfd->params.rpm_at_50hz > 0.0f) {
+            rpm_per_hz = (uint32_t)vfd->params.rpm_at_50hz;
+            per_hz = 50;
+        }
+
+        vfd_factor_set(&vfd->scale.set, (uint64_t)driver->scaling.units_per_hz * per_hz, (uint64_t)rpm_per_hz << VFD_RPM_FRAC_BITS);
+        vfd_factor_set(&vfd->scale.get, (uint64_t)rpm_per_hz << VFD_RPM_FRAC_BITS, (uint64_t)driver->scaling.units_per_hz * per_hz);
+    }
+
+    vfd->scale.deadband = rpm_to_freq(vfd, (float)vfd_config.deadband);
+
+    ramp_configure(vfd);
+
+    if(vfd->spindle && vfd->params.freq_max) {
+        vfd->spindle->cap.rpm_range_locked = On;
+        vfd->spindle->rpm_min = freq_to_rpm(vfd, vfd->params.freq_min);
+        vfd->spindle->rpm_max = freq_to_rpm(vfd, vfd->params.freq_max);
+    }
+}
+
+// Combining is enabled on selection and settings changes, a VFD rejecting it keeps it disabled until then.
+static void combine_enable (vfd_spindle_t *vfd)
+{
+    vfd->combine = vfd->driver->write_multiple || (vfd->driver->user_defined && vfd_config.options.write_multiple);
+}
+
+static void configure_drivers (void)
+{
+    uint_fast8_t idx = n_spindle;
+
+    if(idx) do {
+        combine_enable(&vfd_spindles[--idx]);
+        vfd_configure(&vfd_spindles[idx]);
+    } while(idx);
+}
+
+/*
+ * Calibrated inter-frame silence.
+ *
+ * Silence timeouts found by $VFDCAL are stored in NVS keyed by driver and ModBus address like cached
+ * parameters and are used instead of the driver values when the spindle is selected.
+ */
+
+typedef struct {
+    uint16_t driver_id;         // hash of the driver name, 0 if the entry is not used
+    uint8_t modbus_address;
+    modbus_silence_timeout_t silence;
+} vfd_silence_cal_t;
+
+static bool silence_loaded = false;
+static nvs_address_t silence_address = 0;
+static vfd_silence_cal_t silence_cal[VFD_N_ADRESSES];
+
+// ModBus inter-frame silence of 3.5 characters, 1.75 ms above 19200 baud. Used for calibration of drivers without silence timeouts.
+static const modbus_silence_timeout_t silence_default = {
+    .b2400   = 16,
+    .b4800   = 8,
+    .b9600   = 4,
+    .b19200  = 2,
+    .b38400  = 2,
+    .b115200 = 2
+};
+
+static uint16_t get_driver_id (const vfd_driver_t *driver)
+{
+    uint16_t hash = 5381;
+    const char *name = driver->name;
+
+    while(*name)
+        hash = ((hash << 5) + hash) ^ (uint8_t)*name++;
+
+    return hash ? hash : 1;
+}
+
+static void silence_save (void)
+{
+    if(silence_address)
+        hal.nvs.memcpy_to_nvs(silence_address, (uint8_t *)silence_cal, sizeof(silence_cal), true);
+}
+
+// The ModBus driver may point to a calibrated entry, it is switched to the driver value before the entry is cleared.
+static void silence_clear (void)
+{
+    if(vfd_spindle)
+        modbus_set_silence(vfd_spindle->driver->silence);
+
+    memset(silence_cal, 0, sizeof(silence_cal));
+    silence_loaded = true;
+    silence_save();
+}
+
+// Calibration data is loaded on first use as NVS is not available until settings are loaded.
+static bool silence_load (void)
+{
+    if(silence_address && !silence_loaded) {
+        if(hal.nvs.memcpy_from_nvs((uint8_t *)silence_cal, silence_address, sizeof(silence_cal), true) == NVS_TransferResult_OK)
+            silence_loaded = true;
+        else
+            silence_clear();
+    }
+
+    return silence_loaded;
+}
+
+static vfd_silence_cal_t *silence_entry (vfd_spindle_t *vfd)
+{
+    uint16_t driver_id = get_driver_id(vfd->driver);
+    uint_fast8_t idx = VFD_N_ADRESSES;
+    vfd_silence_cal_t *entry = NULL;
+
+    if(silence_load()) do {
+        idx--;
+        if(silence_cal[idx].driver_id == driver_id && silence_cal[idx].modbus_address == vfd->modbus_address)
+            entry = &silence_cal[idx];
+    } while(idx && entry == NULL);
+
+    return entry;
+}
+
+// Returns the calibrated silence timeouts if available, the driver timeouts otherwise.
+static const modbus_silence_timeout_t *silence_get (vfd_spindle_t *vfd)
+{
+    vfd_silence_cal_t *entry = silence_entry(vfd);
+
+    return entry ? &entry->silence : vfd->driver->silence;
+}
+
+static void silence_put (vfd_spindle_t *vfd, const modbus_silence_timeout_t *silence)
+{
+    vfd_silence_cal_t *entry;
+
+    if(silence_load()) {
+
+        // Unused entries are at the start, the oldest entry is replaced when all are in use.
+        if((entry = silence_entry(vfd)) == NULL) {
+            memmove(&silence_cal[0], &silence_cal[1], sizeof(vfd_silence_cal_t) * (VFD_N_ADRESSES - 1));
+            entry = &silence_cal[VFD_N_ADRESSES - 1];
+        }
+
+        entry->driver_id = get_driver_id(vfd->driver);
+        entry->modbus_address = vfd->modbus_address;
+        memcpy(&entry->silence, silence, sizeof(modbus_silence_timeout_t));
+
+        silence_save();
+    }
+}
+
+/*
+ * Parameter cache.
+ *
+ * Parameters of drivers reading more than one parameter are cached in NVS, keyed by driver and
+ * ModBus address. The first parameter is always read from the VFD and acts as a fingerprint,
+ * if it matches the cached value the remaining parameters are taken from the cache. A swapped
+ * or reconfigured VFD is detected by a mismatch and all parameters are read again.
+ */
+
+#if VFD_PARAM_CACHE
+
+typedef struct {
+    uint16_t driver_id;         // hash of the driver name, 0 if the entry is not used
+    uint8_t modbus_address;
+    uint32_t fingerprint;
+    vfd_params_t params;
+} vfd_param_cache_t;
+
+static bool cache_loaded = false;
+static nvs_address_t cache_address = 0;
+static vfd_param_cache_t param_cache[VFD_N_ADRESSES];
+
+static void cache_save (void)
+{
+    if(cache_address)
+        hal.nvs.memcpy_to_nvs(cache_address, (uint8_t *)param_cache, sizeof(param_cache), true);
+}
+
+static void cache_clear (void)
+{
+    memset(param_cache, 0, sizeof(param_cache));
+    cache_loaded = true;
+    cache_save();
+}
+
+// The cache is loaded on first use as NVS is not available until settings are loaded.
+static bool cache_load (void)
+{
+    if(cache_address && !cache_loaded) {
+        if(hal.nvs.memcpy_from_nvs((uint8_t *)param_cache, cache_address, sizeof(param_cache), true) == NVS_TransferResult_OK)
+            cache_loaded = true;
+        else
+            cache_clear();
+    }
+
+    return cache_loaded;
+}
+
+static vfd_param_cache_t *cache_entry (vfd_spindle_t *vfd, uint16_t driver_id)
+{
+    uint_fast8_t idx = VFD_N_ADRESSES;
+    vfd_param_cache_t *entry = NULL;
+
+    do {
+        idx--;
+        if(param_cache[idx].driver_id == driver_id && param_cache[idx].modbus_address == vfd->modbus_address)
+            entry = &param_cache[idx];
+    } while(idx && entry == NULL);
+
+    return entry;
+}
+
+// Restores parameters from the cache if the fingerprint matches.
+static bool cache_get (vfd_spindle_t *vfd)
+{
+    bool ok = false;
+    vfd_param_cache_t *entry;
+
+    if(cache_load() && (entry = cache_entry(vfd, get_driver_id(vfd->driver))) && entry->fingerprint == vfd->fingerprint) {
+        memcpy(&vfd->params, &entry->params, sizeof(vfd_params_t));
+        ok = true;
+    }
+
+    return ok;
+}
+
+static void cache_put (vfd_spindle_t *vfd)
+{
+    uint16_t driver_id = get_driver_id(vfd->driver);
+    vfd_param_cache_t *entry;
+
+    if(cache_load()) {
+
+        // Unused entries are at the start, the oldest entry is replaced when all are in use.
+        if((entry = cache_entry(vfd, driver_id)) == NULL) {
+            memmove(&param_cache[0], &param_cache[1], sizeof(vfd_param_cache_t) * (VFD_N_ADRESSES - 1));
+            entry = &param_cache[VFD_N_ADRESSES - 1];
+        }
+
+        entry->driver_id = driver_id;
+        entry->modbus_address = vfd->modbus_address;
+        entry->fingerprint = vfd->fingerprint;
+        memcpy(&entry->params, &vfd->params, sizeof(vfd_params_t));
+
+        cache_save();
+    }
+}
+
+#else
+
+#define cache_get(vfd) false
+#define cache_put(vfd) ((void)0)
+
+#endif // VFD_PARAM_CACHE
+
+// Reads parameters from the VFD, blocking.
+// The VFD is ready when all non-optional parameters are read and it has responded to at least one request.
+// Parameters are only cached when the fingerprint is read and no non-optional read failed.
+static void read_params (vfd_spindle_t *vfd)
+{
+    bool ok = true, read_ok, responded = false, fingerprint = false, cached = false;
+    uint_fast8_t idx = 0;
+    modbus_message_t msg;
+    const vfd_param_read_t *read;
+
+    // Parameters read earlier are kept until the VFD responds again.
+    if(vfd->breaker.open) {
+        vfd->ready = false;
+        return;
+    }
+
+    memset(&vfd->params, 0, sizeof(vfd_params_t));
+    vfd->fingerprint = 0;
+
+    while(ok && !cached && idx < vfd->driver->n_params) {
+
+        read = &vfd->driver->params[idx++];
+        read_request(vfd, &msg, read->function, read->address, read->n_regs);
+        msg.context = (void *)read;
+        stats_sent(vfd, VFD_Request_Params);
+
+        read_ok = send_blocking(vfd, &msg, &param_callbacks, false);
+        ok = read_ok || read->optional;
+        // An exception response to an unsupported optional parameter also shows that the VFD is alive,
+        // only requests without response are counted as breaker failures.
+        responded |= read_ok || vfd->breaker.failures == 0;
+
+        if(idx == 1 && (fingerprint = read_ok) && vfd->driver->n_params > 1)
+            cached = cache_get(vfd);
+    }
+
+    if(ok && fingerprint && !cached && vfd->driver->n_params > 1)
+        cache_put(vfd);
+
+    // Motor poles are often left at the factory default, warn if they do not agree with $461.
+    if(!cached && vfd->params.poles && vfd->driver->scaling.source == VFD_Scaling_RPMHz &&
+        vfd->params.poles * vfd_config.vfd_rpm_hz != 120)
+        task_add_immediate(report_warning, vfd_config.options.poles_scaling
+                                            ? "VFD motor poles do not match $461, RPM/Hz is set from motor poles"
+                                            : "VFD motor poles do not match $461, $461 is used");
+
+    vfd->ready = ok && responded;
+
+    vfd_configure(vfd);
+}
+
+static void read_params_delayed (void *data)
+{
+    if(data == vfd_spindle)
+        read_params(vfd_spindle);
+}
+
+static void param_rx_packet (modbus_message_t *msg)
+{
+    uint32_t value;
+    uint_fast8_t idx;
+    const vfd_param_read_t *read = (const vfd_param_read_t *)msg->context;
+
+    if(vfd_spindle)
+        stats_received(vfd_spindle, VFD_Request_Params, false);
+
+    if(vfd_spindle && !(msg->adu[0] & 0x80)) for(idx = 0; idx < 2; idx++) {
+
+        if(read->param[idx] == VFD_Param_None || !response_value(vfd_spindle, msg, idx, 1, &value))
+            continue;
+
+        // Raw value(s) of the first parameter read validates cached parameters.
+        if(read == vfd_spindle->driver->params)
+            vfd_spindle->fingerprint = (vfd_spindle->fingerprint << 16) | value;
+
+        if(read->units_per_hz && (read->param[idx] == VFD_Param_MinFreq || read->param[idx] == VFD_Param_MaxFreq))
+            value = value * vfd_spindle->driver->scaling.units_per_hz / read->units_per_hz;
+
+        switch(read->param[idx]) {
+
+            case VFD_Param_MinFreq:
+                vfd_spindle->params.freq_min = value;
+                break;
+
+            case VFD_Param_MaxFreq:
+                vfd_spindle->params.freq_max = value;
+                break;
+
+            case VFD_Param_RPMAt50Hz:
+                vfd_spindle->params.rpm_at_50hz = (float)value;
+                break;
+
+            case VFD_Param_MaxRPM:
+                vfd_spindle->params.rpm_max = (float)value;
+                break;
+
+            case VFD_Param_MaxAmps:
+                vfd_spindle->params.amps_max = (float)value / 10.0f;
+                break;
+
+            case VFD_Param_Poles:
+                if(value >= 2 && value <= 48 && !(value & 1))
+                    vfd_spindle->params.poles = value;
+                break;
+
+            case VFD_Param_AccelTime:
+                vfd_spindle->params.accel_time = (float)value / 10.0f;
+                break;
+
+            case VFD_Param_DecelTime:
+                vfd_spindle->params.decel_time = (float)value / 10.0f;
+                break;
+
+            default:
+                break;
+        }
+    }
+}
+
+static void param_rx_exception (uint8_t code, void *context)
+{
+    if(vfd_spindle) {
+        stats_failed(vfd_spindle, VFD_Request_Params, code);
+        breaker_failed(vfd_spindle, code);
+    }
+
+    if(!((const vfd_param_read_t *)context)->optional)
+        engine_failed();
+}
+
+static void probe_rx_exception (uint8_t code, void *context)
+{
+    if(vfd_spindle)
+        breaker_failed(vfd_spindle, code);
+}
+
+static void command_rx_packet (modbus_message_t *msg)
+{
+    if(!(msg->adu[0] & 0x80) && (vfd_response_t)msg->context == VFD_SetStatus &&
+         vfd_spindle && vfd_spindle->driver->n_params == 0)
+        vfd_spindle->ready = true;
+}
+
+static void command_rx_exception (uint8_t code, void *context)
+{
+    engine_failed();
+}
+
+// Returns the offset of a telemetry value in the block, -1 if not available.
+static int8_t telemetry_offset (vfd_telemetry_block_t *block, vfd_response_t response)
+{
+    switch(response) {
+
+        case VFD_GetAmps:
+            return block->amps;
+
+        case VFD_GetPower:
+            return block->power;
+
+        case VFD_GetBusVoltage:
+            return block->voltage;
+
+        case VFD_GetTemperature:
+            return block->temp;
+
+        default:
+            return block->freq;
+    }
+}
+
+static void vfd_poll_telemetry (void)
+{
+    modbus_message_t msg;
+    vfd_spindle_t *vfd = vfd_spindle;
+    vfd_telemetry_block_t *block = &vfd->map.telemetry;
+
+    // Status requests are health probes while the circuit breaker is open, also when the VFD is not ready.
+    if(!vfd->ready && !vfd->breaker.open)
+        return;
+
+    if(vfd->driver->protocol == VFD_Protocol_Huanyang) {
+
+        // A single status value is returned per request so secondary values in turn replace
+        // the frequency request on every VFD_AMPS_POLL_RATIO poll, output current every other time.
+        static const vfd_response_t secondary[] = { VFD_GetAmps, VFD_GetBusVoltage, VFD_GetAmps, VFD_GetTemperature, VFD_GetPower };
+
+        int8_t index = -1;
+        vfd_response_t response = VFD_GetRPM;
+        uint_fast8_t n = sizeof(secondary) / sizeof(vfd_response_t);
+
+        if(++vfd->poll.amps >= VFD_AMPS_POLL_RATIO) {
+            vfd->poll.amps = 0;
+            do {
+                response = secondary[vfd->poll.next];
+                vfd->poll.next = (vfd->poll.next + 1) % (sizeof(secondary) / sizeof(vfd_response_t));
+            } while((index = telemetry_offset(block, response)) < 0 && --n);
+        }
+
+        if(index < 0)
+            index = telemetry_offset(block, response = VFD_GetRPM);
+
+        read_request(vfd, &msg, block->function, index, 1);
+        msg.context = (void *)response;
+    } else {
+        read_request(vfd, &msg, block->function, block->address, block->n_regs);
+        msg.context = (void *)VFD_GetRPM;
+    }
+
+    queue_command(vfd, VFD_Command_Telemetry, &msg, &telemetry_callbacks);
+}
+
+static void telemetry_rx_packet (modbus_message_t *msg)
+{
+    uint32_t value;
+    vfd_spindle_t *vfd = vfd_spindle;
+
+    if(vfd == NULL || (msg->adu[0] & 0x80))
+        return;
+
+    vfd_telemetry_block_t *block = &vfd->map.telemetry;
+
+    if(vfd->driver->protocol == VFD_Protocol_Huanyang) {
+        if(response_value(vfd, msg, 0, 1, &value)) switch((vfd_response_t)msg->context) {
+
+            case VFD_GetAmps:
+                vfd->telemetry.amps = (float)value / (float)block->amps_scale;
+                break;
+
+            case VFD_GetPower:
+                vfd->telemetry.power = (float)value / (float)block->power_scale;
+                break;
+
+            case VFD_GetBusVoltage:
+                vfd->telemetry.voltage = (float)value / (float)block->voltage_scale;
+                break;
+
+            case VFD_GetTemperature:
+                vfd->telemetry.temperature = (float)(int16_t)value / (float)block->temp_scale;
+                break;
+
+            default:
+                ramp_update(vfd, vfd->telemetry.rpm = freq_to_rpm(vfd, value));
+                break;
+        }
+    } else {
+        uint_fast8_t words = value_words(vfd);
+
+        if(block->amps >= 0 && response_value(vfd, msg, block->amps, words, &value))
+            vfd->telemetry.amps = (float)value / (float)block->amps_scale;
+        if(block->freq >= 0 && response_value(vfd, msg, block->freq, words, &value))
+            ramp_update(vfd, vfd->telemetry.rpm = freq_to_rpm(vfd, value));
+        if(block->status >= 0 && response_value(vfd, msg, block->status, 1, &value))
+            vfd->telemetry.status = (uint16_t)value;
+        if(block->fault >= 0 && response_value(vfd, msg, block->fault, 1, &value)) {
+            bool fault = value && value != vfd->telemetry.fault;
+            vfd->telemetry.fault = (uint16_t)value;
+            if(fault && vfd_config.options.fault_reset)
+                recovery_start(vfd);
+        }
+        if(block->power >= 0 && response_value(vfd, msg, block->power, 1, &value))
+            vfd->telemetry.power = (float)value / (float)block->power_scale;
+        if(block->voltage >= 0 && response_value(vfd, msg, block->voltage, 1, &value))
+            vfd->telemetry.voltage = (float)value / (float)block->voltage_scale;
+        if(block->temp >= 0 && response_value(vfd, msg, block->temp, 1, &value))
+            vfd->telemetry.temperature = (float)(int16_t)value / (float)block->temp_scale;
+    }
+
+    telemetry_updated(vfd);
+}
+
+static void telemetry_rx_exception (uint8_t code, void *context)
+{
+    if(vfd_spindle == NULL)
+        vfd_failed(false);
+    else if(telemetry_failed(vfd_spindle))
+        engine_failed();
+}
+
+static void control_request (vfd_spindle_t *vfd, modbus_message_t *msg, uint16_t command)
+{
+    if(vfd->driver->protocol == VFD_Protocol_Huanyang)
+        huanyang_request(msg, vfd->modbus_address, vfd->map.control.function, 1, command);
+    else
+        write_register(msg, vfd->modbus_address, vfd->map.control.function, vfd->map.control.address, command);
+
+    msg->context = (void *)VFD_SetStatus;
+    msg->crc_check = vfd->driver->crc_check;
+}
+
+static void frequency_request (vfd_spindle_t *vfd, modbus_message_t *msg, uint32_t freq)
+{
+    if(vfd->driver->protocol == VFD_Protocol_Huanyang)
+        huanyang_request(msg, vfd->modbus_address, vfd->map.frequency.function, 2, freq);
+#if MODBUS_MAX_ADU_SIZE >= 13
+    else if(value_words(vfd) == 2)
+        write_register32(msg, vfd->modbus_address, vfd->map.frequency.address, freq, vfd->driver->lsw_first);
+#endif
+    else
+        write_register(msg, vfd->modbus_address, vfd->map.frequency.function, vfd->map.frequency.address, freq);
+
+    msg->context = (void *)VFD_SetRPM;
+    msg->crc_check = vfd->driver->crc_check;
+}
+
+// Returns true if the frequency differs from the last written by more than the deadband,
+// starting from or changing to 0 is always written.
+static bool freq_changed (vfd_spindle_t *vfd, uint32_t freq)
+{
+    return vfd->data.rpm_programmed < 0.0f || vfd_freq_changed(vfd->freq, freq, vfd->scale.deadband);
+}
+
+// The RPM is quantized to frequency register units, the VFD is only written to when the quantized value changes.
+static void set_rpm (vfd_spindle_t *vfd, spindle_ptrs_t *spindle, float rpm)
+{
+    if(vfd->scale.set.mul && rpm != vfd->data.rpm_programmed) {
+
+        modbus_message_t msg;
+        uint32_t freq = rpm_to_freq(vfd, rpm);
+
+        if(vfd->params.freq_max)
+            freq = min(max(freq, vfd->params.freq_min), vfd->params.freq_max);
+        else if(freq > 0xFFFF && value_words(vfd) == 1)
+            freq = 0xFFFF;
+
+        if(freq_changed(vfd, freq)) {
+            frequency_request(vfd, &msg, freq);
+            queue_command(vfd, VFD_Command_Frequency, &msg, &command_callbacks);
+            vfd->freq = freq;
+        }
+
+        spindle_set_at_speed_range(spindle, &vfd->data, rpm);
+    }
+}
+
+static void vfd_update_rpm (spindle_ptrs_t *spindle, float rpm)
+{
+    vfd_spindle_t *vfd;
+
+    if((vfd = get_spindle(spindle->id)))
+        set_rpm(vfd, spindle, rpm);
+}
+
+// Start or stop spindle
+static void vfd_set_state (spindle_ptrs_t *spindle, spindle_state_t state, float rpm)
+{
+    vfd_spindle_t *vfd;
+    modbus_message_t msg;
+
+    if((vfd = get_spindle(spindle->id)) == NULL)
+        return;
+
+    if(state.on && !vfd->ready && vfd->driver->n_params && vfd == vfd_spindle)
+        read_params(vfd);
+
+    control_request(vfd, &msg, !state.on || rpm == 0.0f ? vfd->map.control.stop : (state.ccw ? vfd->map.control.ccw : vfd->map.control.cw));
+
+    if(vfd->data.state_programmed.ccw != state.ccw)
+        vfd->data.rpm_programmed = -1.0f;
+
+    vfd->data.state_programmed.on = state.on;
+    vfd->data.state_programmed.ccw = state.ccw;
+
+    if(queue_command(vfd, VFD_Command_Control, &msg, &command_callbacks))
+        set_rpm(vfd, spindle, rpm);
+}
+
+/*
+ * Fault recovery.
+ *
+ * When enabled a failed command, VFD_ASYNC_EXCEPTION_LEVEL consecutive failed polls or a new fault code
+ * reported by the VFD starts recovery instead of raising an alarm. A feed hold is issued if a cycle is
+ * running and after VFD_RECOVERY_DELAY the fault is reset if the driver supports it. When the VFD responds
+ * parameters are read again and the programmed spindle state is restored, the job can then be resumed
+ * with cycle start. Fault codes listed by the driver as unrecoverable and VFD_RECOVERY_ATTEMPTS failed
+ * attempts raise an alarm.
+ */
+
+// Sends a blocking status request, returns true if the VFD responds.
+static bool probe (vfd_spindle_t *vfd, const modbus_callbacks_t *callbacks)
+{
+    modbus_message_t msg;
+
+    if(vfd->driver->protocol == VFD_Protocol_Huanyang)
+        read_request(vfd, &msg, vfd->map.telemetry.function, vfd->map.telemetry.freq, 1);
+    else
+        read_request(vfd, &msg, vfd->map.telemetry.function, vfd->map.telemetry.address, vfd->map.telemetry.n_regs);
+
+    msg.crc_check = vfd->driver->crc_check;
+
+    return send_blocking(vfd, &msg, callbacks, true);
+}
+
+static bool fault_fatal (vfd_spindle_t *vfd, uint16_t fault)
+{
+    uint_fast8_t idx = vfd->driver->n_fatal_faults;
+
+    while(idx) {
+        if(vfd->driver->fatal_faults[--idx] == fault)
+            return true;
+    }
+
+    return false;
+}
 
-static bool is_ysgl_selected (const setting_detail_t *setting, uint_fast16_t offset)
+static void recover (void *data)
 {
-    return true;
+    bool ok;
+    modbus_message_t msg;
+    vfd_spindle_t *vfd = (vfd_spindle_t *)data;
+    const vfd_driver_t *driver = vfd->driver;
+
+    if(vfd != vfd_spindle || vfd->recovery.state != VFD_Recovery_Active)
+        return;
+
+    // The fault reset command also checks that the VFD responds, a status request is used if not supported.
+    if(driver->fault_reset.function) {
+        write_register(&msg, vfd->modbus_address, driver->fault_reset.function, driver->fault_reset.address, driver->fault_reset.command);
+        msg.crc_check = driver->crc_check;
+        ok = send_blocking(vfd, &msg, &probe_callbacks, true);
+    } else
+        ok = probe(vfd, &probe_callbacks);
+
+    if(ok && driver->n_params) {
+        read_params(vfd);
+        ok = vfd->ready;
+    } else
+        vfd->ready = ok;
+
+    if(ok) {
+
+        spindle_state_t state = vfd->data.state_programmed;
+        float rpm = max(vfd->data.rpm_programmed, 0.0f);
+
+        vfd->recovery.state = VFD_Recovery_Idle;
+        vfd->recovery.recovered = hal.get_elapsed_ticks();
+        vfd->telemetry.exceptions = 0;
+        vfd->telemetry.fault = 0;
+        vfd->data.rpm_programmed = -1.0f;
+
+        vfd_set_state(vfd->spindle, state, rpm);
+
+        report_message("VFD spindle recovered", Message_Info);
+
+    } else if(++vfd->recovery.attempts < VFD_RECOVERY_ATTEMPTS)
+        task_add_delayed(recover, vfd, VFD_RECOVERY_DELAY);
+    else {
+        vfd->recovery.state = VFD_Recovery_Failed;
+        vfd_failed(false);
+    }
 }
 
-#else
-
-static bool is_ysgl_selected (const setting_detail_t *setting, uint_fast16_t offset)
+// May be called from interrupt context.
+static void recovery_start (vfd_spindle_t *vfd)
 {
-    bool ok = false;
-    uint_fast8_t idx = n_spindle;
+    if(vfd->recovery.state != VFD_Recovery_Idle)
+        return;
 
-    if(idx > 0) do {
-        if(spindle_select_get_binding(vfd_spindles[--idx].id) >= 0)
-            ok = !strcmp(spindle_get_name(vfd_spindles[idx].id), "Yalang YS620") || !strcmp(spindle_get_name(vfd_spindles[idx].id), "Durapulse GS20");
-    } while(idx && !ok);
+    if(vfd->telemetry.fault && fault_fatal(vfd, vfd->telemetry.fault)) {
+        vfd->recovery.state = VFD_Recovery_Failed;
+        vfd_failed(false);
+        return;
+    }
 
-    return ok;
+    if(hal.get_elapsed_ticks() - vfd->recovery.recovered > VFD_RECOVERY_WINDOW)
+        vfd->recovery.attempts = 0;
+
+    vfd->recovery.state = VFD_Recovery_Active;
+    vfd->ready = false;
+
+    if(state_get() == STATE_CYCLE)
+        grbl.enqueue_realtime_command(CMD_FEED_HOLD);
+
+    task_add_delayed(recover, vfd, VFD_RECOVERY_DELAY);
 }
 
-#endif
+// Starts recovery if enabled, raises an alarm otherwise.
+static void engine_failed (void)
+{
+    if(vfd_spindle && vfd_config.options.fault_reset && vfd_spindle->recovery.state != VFD_Recovery_Failed)
+        recovery_start(vfd_spindle);
+    else
+        vfd_failed(false);
+}
 
-#endif // SPINDLE_GS20|SPINDLE_YL620A
+// The core does not tell which spindle data is requested for, return data for the active VFD.
+// SpindleData_RPM requests returns the RPM estimated by the ramp model, others the latest readings.
+static spindle_data_t *vfd_get_data (spindle_data_request_t request)
+{
+    vfd_spindle_t *vfd = vfd_spindle ? vfd_spindle : &vfd_spindles[0];
 
-PROGMEM static const setting_group_detail_t vfd_groups [] = {
-    { Group_Root, Group_VFD, "VFD" }
-};
+    if(request == SpindleData_RPM) {
+        memcpy(&vfd->estimate, &vfd->data, sizeof(spindle_data_t));
+        vfd->estimate.rpm = ramp_estimate(vfd);
 
-PROGMEM static const setting_detail_t vfd_settings[] = {
-#if N_SPINDLE_SELECTABLE > 1
-     { Setting_VFD_ModbusAddress, Group_VFD, "", NULL, Format_Int8, "##0", NULL, "255", Setting_NonCore, &vfd_config.modbus_address[0], NULL, is_vfd_spindle, { .hidden = On } },
-     { Setting_VFD_ModbusAddress0, Group_VFD, "Spindle 1 ModBus address", NULL, Format_Int8, "##0", NULL, "255", Setting_NonCore, &vfd_config.modbus_address[0], NULL, is_vfd_spindle },
-     { Setting_VFD_ModbusAddress1, Group_VFD, "Spindle 2 ModBus address", NULL, Format_Int8, "##0", NULL, "255", Setting_NonCore, &vfd_config.modbus_address[1], NULL, is_vfd_spindle },
-  #if N_SPINDLE_SELECTABLE > 2
-     { Setting_VFD_ModbusAddress2, Group_VFD, "Spindle 3 ModBus address", NULL, Format_Int8, "##0", NULL, "255", Setting_NonCore, &vfd_config.modbus_address[2], NULL, is_vfd_spindle },
-  #endif
-  #if N_SPINDLE_SELECTABLE > 3
-     { Setting_VFD_ModbusAddress3, Group_VFD, "Spindle 4 ModBus address", NULL, Format_Int8, "##0", NULL, "255", Setting_NonCore, &vfd_config.modbus_address[3], NULL, is_vfd_spindle },
-  #endif
-#else
-     { Setting_VFD_ModbusAddress, Group_VFD, "VFD spindle ModBus address", NULL, Format_Int8, "##0", NULL, "255", Setting_NonCore, &vfd_config.modbus_address, NULL, NULL },
-#endif
-#if SPINDLE_ENABLE & ((1<<SPINDLE_GS20)|(1<<SPINDLE_YL620A))
-     { Setting_VFD_RPM_Hz, Group_VFD, "RPM per Hz", "", Format_Int16, "###0", "1", "3000", Setting_NonCore, &vfd_config.vfd_rpm_hz, NULL, is_ysgl_selected },
-#endif
-#if SPINDLE_ENABLE & (1<<SPINDLE_MODVFD)
-     { Setting_VFD_10, Group_VFD, "Run/Stop Register (decimal)", NULL, Format_Int16, "####0", NULL, "65535", Setting_NonCore, &vfd_config.runstop_reg, NULL, is_modvfd_selected },
-     { Setting_VFD_11, Group_VFD, "Set Frequency Register (decimal)", "", Format_Int16, "####0", NULL, "65535", Setting_NonCore, &vfd_config.set_freq_reg, NULL, is_modvfd_selected },
-     { Setting_VFD_12, Group_VFD, "Get Frequency Register (decimal)", NULL, Format_Int16, "####0", NULL, "65535", Setting_NonCore, &vfd_config.get_freq_reg, NULL, is_modvfd_selected },
-     { Setting_VFD_13, Group_VFD, "Run CW Command (decimal)", "", Format_Int16, "####0", NULL, "65535", Setting_NonCore, &vfd_config.run_cw_cmd, NULL, is_modvfd_selected },
-     { Setting_VFD_14, Group_VFD, "Run CCW Command (decimal)", NULL, Format_Int16, "####0", NULL, "65535", Setting_NonCore, &vfd_config.run_ccw_cmd, NULL, is_modvfd_selected },
-     { Setting_VFD_15, Group_VFD, "Stop Command (decimal)", "", Format_Int16, "####0", NULL, "65535", Setting_NonCore, &vfd_config.stop_cmd, NULL, is_modvfd_selected },
-     { Setting_VFD_16, Group_VFD, "RPM input Multiplier", "", Format_Decimal, "########0", NULL, NULL, Setting_NonCore, &vfd_config.in_multiplier, NULL, is_modvfd_selected },
-     { Setting_VFD_17, Group_VFD, "RPM input Divider", "", Format_Decimal, "########0", NULL, NULL, Setting_NonCore, &vfd_config.in_divider, NULL, is_modvfd_selected },
-     { Setting_VFD_18, Group_VFD, "RPM output Multiplier", "", Format_Decimal, "########0", NULL, NULL, Setting_NonCore, &vfd_config.out_multiplier, NULL, is_modvfd_selected },
-     { Setting_VFD_19, Group_VFD, "RPM output Divider", "", Format_Decimal, "########0", NULL, NULL, Setting_NonCore, &vfd_config.out_divider, NULL, is_modvfd_selected },
-#endif
-};
+        return &vfd->estimate;
+    }
 
-PROGMEM static const setting_descr_t vfd_settings_descr[] = {
-#if N_SPINDLE_SELECTABLE > 1
-    { Setting_VFD_ModbusAddress0, "Spindle 1 (default spindle) VFD ModBus address" },
-    { Setting_VFD_ModbusAddress1, "Spindle 2 ModBus address" },
-  #if N_SPINDLE_SELECTABLE > 2
-    { Setting_VFD_ModbusAddress2, "Spindle 3 ModBus address" },
-  #endif
-  #if N_SPINDLE_SELECTABLE > 3
-    { Setting_VFD_ModbusAddress3, "Spindle 4 ModBus address" },
-  #endif
-#else
-    { Setting_VFD_ModbusAddress, "VFD ModBus address" },
-#endif
-#if SPINDLE_ENABLE & ((1<<SPINDLE_GS20)|(1<<SPINDLE_YL620A))
-    { Setting_VFD_RPM_Hz, "RPM/Hz value for GS20 and YL620A" },
-#endif
-#if SPINDLE_ENABLE & (1<<SPINDLE_MODVFD)
-    { Setting_VFD_10, "MODVFD Register for Run/stop" },
-    { Setting_VFD_11, "MODVFD Set Frequency Register" },
-    { Setting_VFD_12, "MODVFD Get Frequency Register" },
-    { Setting_VFD_13, "MODVFD Command word for CW" },
-    { Setting_VFD_14, "MODVFD Command word for CCW" },
-    { Setting_VFD_15, "MODVFD Command word for stop" },
-    { Setting_VFD_16, "MODVFD RPM value multiplier for programming RPM" },
-    { Setting_VFD_17, "MODVFD RPM value divider for programming RPM" },
-    { Setting_VFD_18, "MODVFD RPM value multiplier for reading RPM" },
-    { Setting_VFD_19, "MODVFD RPM value divider for reading RPM" },
-#endif
-};
+    return &vfd->data;
+}
 
-static void vfd_settings_save (void)
+static float vfd_get_load (void)
 {
-    hal.nvs.memcpy_to_nvs(nvs_address, (uint8_t *)&vfd_config, sizeof(vfd_settings_t), true);
+    return vfd_spindle && vfd_spindle->params.amps_max > 0.0f ? (vfd_spindle->telemetry.amps / vfd_spindle->params.amps_max) * 100.0f : 0.0f;
 }
 
-static void vfd_settings_restore (void)
+static bool vfd_spindle_config (spindle_ptrs_t *spindle)
 {
-#if N_SPINDLE > 1 || N_SYS_SPINDLE > 1
-    uint_fast8_t idx = VFD_N_ADRESSES;
-    do {
-        idx--;
-        vfd_config.modbus_address[idx] = VFD_ADDRESS + idx;
-    } while(idx);
-#else
-    vfd_config.modbus_address = VFD_ADDRESS;
-#endif
-//MODVFD settings below are defaulted to values for GS20 VFD
-    vfd_config.vfd_rpm_hz = 60;
-    vfd_config.runstop_reg = 8192; //0x2000
-    vfd_config.set_freq_reg = 8193; //0x2001
-    vfd_config.get_freq_reg = 8451; //0x2103
-    vfd_config.run_cw_cmd = 18; //0x12
-    vfd_config.run_ccw_cmd = 34; //0x22
-    vfd_config.stop_cmd = 1; //0x02
-    vfd_config.in_multiplier = 50;
-    vfd_config.in_divider = 60;
-    vfd_config.out_multiplier = 60;
-    vfd_config.out_divider = 100;
-
-    hal.nvs.memcpy_to_nvs(nvs_address, (uint8_t *)&vfd_config, sizeof(vfd_settings_t), true);
+    return modbus_isup().rtu;
 }
 
-static void vfd_settings_load (void)
+static void select_driver (vfd_spindle_t *vfd, spindle_ptrs_t *spindle)
 {
-    if((hal.nvs.memcpy_from_nvs((uint8_t *)&vfd_config, nvs_address, sizeof(vfd_settings_t), true) != NVS_TransferResult_OK))
-        vfd_settings_restore();
+    vfd->spindle = spindle;
+    vfd->ready = false;
+    vfd->data.rpm_programmed = -1.0f;
+    vfd->ramp.timestamp = 0;
+    vfd->ramp.offset = 0.0f;
+    vfd->recovery.state = VFD_Recovery_Idle;
+    vfd->recovery.attempts = 0;
+    vfd->breaker.failures = 0;
+    vfd->breaker.open = vfd->breaker.closed = false;
+    vfd_atspeed_configure(spindle, &vfd->data);
+
+    modbus_set_silence(silence_get(vfd));
+    vfd->modbus_address = vfd_get_modbus_address(vfd->id);
+
+    combine_enable(vfd);
+    vfd_configure(vfd);
+
+    if(vfd->driver->n_params)
+        read_params(vfd);
 }
 
-static vfd_spindle_t *get_spindle (spindle_id_t spindle_id)
+spindle_id_t vfd_register_driver (const vfd_driver_t *driver)
 {
-    uint_fast8_t idx = n_spindle;
+    bool get_load = false;
+    uint_fast8_t idx = driver->n_params;
 
-    vfd_spindle_t *spindle = NULL;
+    while(idx) {
+        idx--;
+        get_load |= driver->params[idx].param[0] == VFD_Param_MaxAmps || driver->params[idx].param[1] == VFD_Param_MaxAmps;
+    }
 
-    if(n_spindle) do {
-        if(vfd_spindles[--idx].id == spindle_id)
-            spindle = &vfd_spindles[idx];
-    } while(idx && spindle == NULL);
+    vfd_spindle_ptrs_t vfd = {
+        .spindle = {
+            .type = SpindleType_VFD,
+            .ref_id = driver->ref_id,
+            .cap = {
+                .variable = On,
+                .at_speed = On,
+                .direction = On,
+                .cmd_controlled = On
+            },
+            .config = vfd_spindle_config,
+            .set_state = vfd_set_state,
+            .get_state = vfd_get_state,
+            .update_rpm = vfd_update_rpm,
+            .get_data = vfd_get_data
+        },
+        .vfd = {
+            .get_load = get_load ? vfd_get_load : NULL
+        }
+    };
 
-    return spindle;
+    return add_spindle(&vfd, vfd_poll_telemetry, driver->name, driver);
 }
 
-// Returns spindle state in a spindle_state_t variable.
-// Caps request interval to once every VFD_QUERY_INTERVAL ms max (default 150).
-static spindle_state_t vfd_get_state (spindle_ptrs_t *spindle)
+static void vfd_spindle_selected (spindle_ptrs_t *spindle)
 {
-    static uint32_t last_request;
-    static spindle_state_t state = (spindle_state_t){0};
+    spindle_changed = true;
 
-    uint32_t ms = hal.get_elapsed_ticks();
+    if(vfd_spindle) {
+        vfd_spindle->spindle = NULL;
+        vfd_spindle->in_flight = 0;
+        memset(vfd_spindle->command, 0, sizeof(vfd_spindle->command));
+        vfd_spindle->status = VFD_CommandIdle;
+        stats_flush(vfd_spindle);
+    }
+
+    legacy_spindle = get_legacy(spindle->id);
+
+    if((vfd_spindle = get_spindle(spindle->id))) {
 
-    if((ms = hal.get_elapsed_ticks()) - last_request >= VFD_QUERY_INTERVAL) {
-        state = vfd_spindle.hal.spindle.get_state(spindle);
-        last_request = ms;
+        memset(&vfd_spindle->telemetry, 0, sizeof(vfd_telemetry_t));
+        modbus_flush_queue();
+        stats_flush(vfd_spindle);
+
+        select_driver(vfd_spindle, spindle);
     }
 
-    return state;
+    if(on_spindle_selected)
+        on_spindle_selected(spindle);
 }
 
-static bool vfd_spindle_select (spindle_ptrs_t *spindle)
+static void vfd_settings_changed (settings_t *settings, settings_changed_flags_t changed)
 {
-    bool ok = on_spindle_select == NULL || on_spindle_select(spindle);
+    uint_fast8_t idx = n_spindle;
 
-    if(ok && get_spindle(spindle->id))
-        spindle->get_state = vfd_get_state;
+    settings_changed(settings, changed);
 
-    return ok;
+    if(changed.spindle && idx) do {
+        idx--;
+        spindle_get_hal(vfd_spindles[idx].id, SpindleHAL_Configured)->at_speed_tolerance = vfd_atspeed_configure(vfd_spindles[idx].spindle, &vfd_spindles[idx].data);
+    } while(idx);
 }
 
-static void vfd_spindle_selected (spindle_ptrs_t *spindle)
+static void vfd_report_options (bool newopt)
 {
-    vfd_spindle_t *vfd;
-
-    spindle_changed = true;
-    vfd_spindle.id = -1;
-    memset(&vfd_spindle.hal, 0, sizeof(vfd_spindle_ptrs_t));
+    uint_fast8_t idx;
 
-    if((vfd = get_spindle(spindle->id))) {
-        modbus_flush_queue();
-        vfd_spindle.id = spindle->id;
-        memcpy(&vfd_spindle.hal, &vfd->hal, sizeof(vfd_spindle_ptrs_t));
-    };
+    on_report_options(newopt);
 
-    if(on_spindle_selected)
-        on_spindle_selected(spindle);
+    if(!newopt) for(idx = 0; idx < n_spindle; idx++)
+        report_plugin(vfd_spindles[idx].driver->plugin, vfd_spindles[idx].driver->version);
 }
 
 static void raise_alarm (void *data)
@@ -418,9 +2626,23 @@ bool vfd_failed (bool disable)
     return ok;
 }
 
-const vfd_ptrs_t *vfd_get_active (void)
+// The ModBus queue is flushed on a reset, requeue any command that was lost
+// and read parameters from the VFD again.
+static void vfd_driver_reset (void)
 {
-    return vfd_spindle.id == -1 ? NULL : &vfd_spindle.hal.vfd;
+    driver_reset();
+
+    if(vfd_spindle) {
+
+        stats_flush(vfd_spindle);
+        pipeline_restart(vfd_spindle);
+
+        vfd_spindle->recovery.state = VFD_Recovery_Idle;
+        vfd_spindle->recovery.attempts = 0;
+
+        if(vfd_spindle->driver->n_params)
+            task_add_delayed(read_params_delayed, vfd_spindle, VFD_PARAMS_DELAY);
+    }
 }
 
 float vfd_atspeed_configure (spindle_ptrs_t *spindle, spindle_data_t *spindle_data)
@@ -433,6 +2655,317 @@ float vfd_atspeed_configure (spindle_ptrs_t *spindle, spindle_data_t *spindle_da
     return settings.spindle.at_speed_tolerance;
 }
 
+#if VFD_STATS
+
+static const char *request_names[VFD_N_REQUESTS] = { "control", "frequency", "status", "params" };
+
+// $VFDSTATS outputs bus statistics for all VFD spindles, $VFDSTATS=R clears them.
+static status_code_t vfd_stats_command (sys_state_t state, char *args)
+{
+    uint_fast8_t idx, type, bin;
+    vfd_stats_t *stats;
+
+    if(args) {
+
+        if(!((*args == 'R' || *args == 'r') && args[1] == '\0'))
+            return Status_InvalidStatement;
+
+        for(idx = 0; idx < n_spindle; idx++)
+            memset(vfd_spindles[idx].stats, 0, sizeof(vfd_spindles[idx].stats));
+
+        return Status_OK;
+    }
+
+    hal.stream.write("[VFDSTATS:bins");
+    for(bin = 0; bin < VFD_LATENCY_BINS - 1; bin++) {
+        hal.stream.write(bin ? "," : "|");
+        hal.stream.write(uitoa(latency_bins[bin]));
+    }
+    hal.stream.write("]" ASCII_EOL);
+
+    for(idx = 0; idx < n_spindle; idx++) {
+        for(type = 0; type < VFD_N_REQUESTS; type++) {
+
+            if((stats = &vfd_spindles[idx].stats[type])->requests == 0)
+                continue;
+
+            hal.stream.write("[VFDSTATS:");
+            hal.stream.write(uitoa(vfd_spindles[idx].id));
+            hal.stream.write("|");
+            hal.stream.write(spindle_get_name(vfd_spindles[idx].id));
+            hal.stream.write("|");
+            hal.stream.write(request_names[type]);
+            hal.stream.write("|");
+            hal.stream.write(uitoa(stats->requests));
+            hal.stream.write(",");
+            hal.stream.write(uitoa(stats->responses));
+            hal.stream.write(",");
+            hal.stream.write(uitoa(stats->exceptions));
+            hal.stream.write(",");
+            hal.stream.write(uitoa(stats->timeouts));
+            hal.stream.write("|");
+            hal.stream.write(uitoa(stats->latency_last));
+            hal.stream.write(",");
+            hal.stream.write(uitoa(stats->latency_max));
+            for(bin = 0; bin < VFD_LATENCY_BINS; bin++) {
+                hal.stream.write(bin ? "," : "|");
+                hal.stream.write(uitoa(stats->latency[bin]));
+            }
+            hal.stream.write("]" ASCII_EOL);
+        }
+    }
+
+    return Status_OK;
+}
+
+#endif // VFD_STATS
+
+static status_code_t vfd_info_command (sys_state_t state, char *args)
+{
+    uint_fast8_t idx;
+    vfd_telemetry_t *telemetry;
+
+    for(idx = 0; idx < n_spindle; idx++) {
+
+        if((telemetry = &vfd_spindles[idx].telemetry)->updates == 0)
+            continue;
+
+        hal.stream.write("[VFDINFO:");
+        hal.stream.write(uitoa(vfd_spindles[idx].id));
+        hal.stream.write("|");
+        hal.stream.write(spindle_get_name(vfd_spindles[idx].id));
+        hal.stream.write("|");
+        hal.stream.write(ftoa(telemetry->rpm, 0));
+        hal.stream.write(",");
+        hal.stream.write(ftoa(telemetry->amps, 1));
+        hal.stream.write(",");
+        hal.stream.write(ftoa(telemetry->power, 3));
+        hal.stream.write(",");
+        hal.stream.write(ftoa(telemetry->energy, 3));
+        hal.stream.write(",");
+        hal.stream.write(ftoa(telemetry->voltage, 1));
+        hal.stream.write(",");
+        hal.stream.write(ftoa(telemetry->temperature, 1));
+        hal.stream.write("|");
+        hal.stream.write(uitoa(telemetry->status));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(telemetry->fault));
+        hal.stream.write("|");
+        hal.stream.write(uitoa(vfd_telemetry_age(telemetry)));
+        hal.stream.write("]" ASCII_EOL);
+    }
+
+    return Status_OK;
+}
+
+/*
+ * Baud rate change.
+ *
+ * $VFDBAUD=<baud> writes the RS485 baud rate parameter of the active VFD, switches the ModBus port to
+ * the new baud rate by changing $374 and checks that the VFD responds. If not the port is switched back
+ * and the old baud rate is written to the VFD again, this also covers VFDs that only apply the change
+ * after a power cycle. The baud rate is shared by all devices on the bus.
+ */
+
+static const uint32_t baud_rates[VFD_N_BAUDRATES] = { 2400, 4800, 9600, 19200, 38400, 115200 };
+
+static bool baud_write (vfd_spindle_t *vfd, uint16_t code)
+{
+    modbus_message_t msg;
+    const vfd_baud_t *baud = &vfd->driver->baud;
+
+    if(vfd->driver->protocol == VFD_Protocol_Huanyang) {
+        huanyang_request(&msg, vfd->modbus_address, baud->function, 3, baud->address);
+        msg.adu[4] = code >> 8;
+        msg.adu[5] = code & 0xFF;
+    } else
+        write_register(&msg, vfd->modbus_address, baud->function, baud->address, code);
+
+    msg.crc_check = vfd->driver->crc_check;
+
+    return send_blocking(vfd, &msg, &probe_callbacks, false);
+}
+
+static bool baud_set (uint_fast8_t idx)
+{
+    return settings_store_setting(Setting_ModBus_BaudRate, uitoa(idx)) == Status_OK;
+}
+
+static status_code_t vfd_baud_command (sys_state_t state, char *args)
+{
+    char *end;
+    uint32_t baud;
+    uint_fast8_t idx = VFD_N_BAUDRATES, current;
+    vfd_spindle_t *vfd = vfd_spindle;
+    const setting_detail_t *setting;
+
+    if(state != STATE_IDLE || (vfd && vfd->data.state_programmed.on))
+        return Status_IdleError;
+
+    if(vfd == NULL || vfd->driver->baud.function == 0 || !vfd->ready ||
+        (setting = setting_get_details(Setting_ModBus_BaudRate, NULL)) == NULL)
+        return Status_InvalidStatement;
+
+    if(args == NULL)
+        return Status_InvalidStatement;
+
+    baud = strtoul(args, &end, 10);
+
+    if(*end != '\0')
+        return Status_InvalidStatement;
+
+    do {
+        if(baud_rates[--idx] == baud)
+            break;
+    } while(idx);
+
+    if(baud_rates[idx] != baud || vfd->driver->baud.code[idx] == VFD_BaudUnsupported)
+        return Status_SettingValueOutOfRange;
+
+    if((current = setting_get_int_value(setting, 0)) == idx)
+        return Status_OK;
+
+    if(current >= VFD_N_BAUDRATES || vfd->driver->baud.code[current] == VFD_BaudUnsupported)
+        return Status_SettingValueOutOfRange;
+
+    if(!baud_write(vfd, vfd->driver->baud.code[idx])) {
+        report_message("VFD baud rate parameter could not be written", Message_Warning);
+        return Status_InvalidStatement;
+    }
+
+    if(baud_set(idx) && probe(vfd, &probe_callbacks))
+        report_message("VFD baud rate changed", Message_Info);
+    else if(baud_set(current) && probe(vfd, &probe_callbacks) && baud_write(vfd, vfd->driver->baud.code[current]))
+        report_message("VFD did not respond at the new baud rate, reverted", Message_Warning);
+    else {
+        vfd_failed(false);
+        return Status_InvalidStatement;
+    }
+
+    return Status_OK;
+}
+
+/*
+ * Silence calibration.
+ *
+ * $VFDCAL steps the inter-frame silence for the current baud rate down by 1 ms from the driver value,
+ * or 3.5 characters if the driver does not set one, as long as VFD_CAL_REQUESTS back-to-back status
+ * requests without retries are all answered. The smallest reliable value plus VFD_SILENCE_MARGIN is
+ * stored for the VFD and used from then on. $VFDCAL=R reverts to the driver value.
+ */
+
+static const modbus_callbacks_t calibrate_callbacks = {
+    .retries = 0
+};
+
+static uint16_t *silence_value (modbus_silence_timeout_t *silence, uint_fast8_t idx)
+{
+    switch(idx) {
+
+        case 0:
+            return &silence->b2400;
+
+        case 1:
+            return &silence->b4800;
+
+        case 2:
+            return &silence->b9600;
+
+        case 3:
+            return &silence->b19200;
+
+        case 4:
+            return &silence->b38400;
+
+        default:
+            return &silence->b115200;
+    }
+}
+
+static status_code_t vfd_cal_command (sys_state_t state, char *args)
+{
+    static modbus_silence_timeout_t silence; // in use by the ModBus driver during calibration
+
+    char msg[40];
+    uint_fast8_t idx, n;
+    uint16_t *value, start, best = 0;
+    modbus_silence_timeout_t base;
+    vfd_silence_cal_t *entry;
+    const modbus_silence_timeout_t *current;
+    vfd_spindle_t *vfd = vfd_spindle;
+    const setting_detail_t *setting;
+
+    if(state != STATE_IDLE || (vfd && vfd->data.state_programmed.on))
+        return Status_IdleError;
+
+    if(vfd == NULL || !vfd->ready ||
+        (setting = setting_get_details(Setting_ModBus_BaudRate, NULL)) == NULL ||
+         (idx = setting_get_int_value(setting, 0)) >= VFD_N_BAUDRATES)
+        return Status_InvalidStatement;
+
+    if(args) {
+
+        if(!((*args == 'R' || *args == 'r') && args[1] == '\0'))
+            return Status_InvalidStatement;
+
+        if((entry = silence_entry(vfd))) {
+            entry->driver_id = 0;
+            silence_save();
+        }
+
+        modbus_set_silence(vfd->driver->silence);
+
+        return Status_OK;
+    }
+
+    memcpy(&base, vfd->driver->silence ? vfd->driver->silence : &silence_default, sizeof(modbus_silence_timeout_t));
+    memcpy(&silence, (current = silence_get(vfd)) ? current : &silence_default, sizeof(modbus_silence_timeout_t));
+
+    start = *silence_value(&base, idx);
+    value = silence_value(&silence, idx);
+
+    for(*value = start; *value > 0; (*value)--) {
+
+        modbus_set_silence(&silence);
+
+        for(n = 0; n < VFD_CAL_REQUESTS && probe(vfd, &calibrate_callbacks); n++);
+
+        if(n < VFD_CAL_REQUESTS)
+            break;
+
+        best = *value;
+    }
+
+    if(best) {
+        *value = min(best + VFD_SILENCE_MARGIN, start);
+        silence_put(vfd, &silence);
+        strcpy(msg, "VFD silence calibrated to ");
+        strcat(msg, uitoa(*value));
+        strcat(msg, " ms");
+    } else
+        strcpy(msg, "VFD silence calibration failed");
+
+    modbus_set_silence(silence_get(vfd));
+
+    report_message(msg, best ? Message_Info : Message_Warning);
+
+    return Status_OK;
+}
+
+static const sys_command_t vfd_command_list[] = {
+    { "VFDINFO", vfd_info_command, { .noargs = On, .allow_blocking = On }, { .str = "output latest VFD status readings" } },
+    { "VFDBAUD", vfd_baud_command, { .allow_blocking = On }, { .str = "$VFDBAUD=<baud> - change VFD and ModBus baud rate" } },
+    { "VFDCAL", vfd_cal_command, { .allow_blocking = On }, { .str = "calibrate VFD inter-frame silence, $VFDCAL=R reverts to default" } },
+#if VFD_STATS
+    { "VFDSTATS", vfd_stats_command, { .allow_blocking = On }, { .str = "output VFD bus statistics, $VFDSTATS=R clears them" } }
+#endif
+};
+
+static sys_commands_t vfd_commands = {
+    .n_commands = sizeof(vfd_command_list) / sizeof(sys_command_t),
+    .commands = vfd_command_list
+};
+
 void vfd_init (void)
 {
     static setting_details_t vfd_setting_details = {
@@ -449,6 +2982,11 @@ void vfd_init (void)
 
     if(modbus_enabled() && (nvs_address = nvs_alloc(sizeof(vfd_settings_t)))) {
 
+#if VFD_PARAM_CACHE
+        cache_address = nvs_alloc(sizeof(param_cache));
+#endif
+        silence_address = nvs_alloc(sizeof(silence_cal));
+
         settings_register(&vfd_setting_details);
 
 #if SPINDLE_ENABLE & (1<<SPINDLE_HUANYANG1)
@@ -486,11 +3024,30 @@ void vfd_init (void)
         vfd_nowforever_init();
 #endif
 
-        on_spindle_select = grbl.on_spindle_select;
-        grbl.on_spindle_select = vfd_spindle_select;
+#if VFD_PROFILES
+        extern void vfd_profiles_init (void);
+        vfd_profiles_init();
+#endif
 
         on_spindle_selected = grbl.on_spindle_selected;
         grbl.on_spindle_selected = vfd_spindle_selected;
+
+        driver_reset = hal.driver_reset;
+        hal.driver_reset = vfd_driver_reset;
+
+        on_execute_realtime = grbl.on_execute_realtime;
+        grbl.on_execute_realtime = vfd_execute_realtime;
+
+        on_execute_delay = grbl.on_execute_delay;
+        grbl.on_execute_delay = vfd_execute_delay;
+
+        settings_changed = hal.settings_changed;
+        hal.settings_changed = vfd_settings_changed;
+
+        on_report_options = grbl.on_report_options;
+        grbl.on_report_options = vfd_report_options;
+
+        system_register_commands(&vfd_commands);
     }
 }
 
@@ -43,27 +43,37 @@
 #ifndef VFD_ASYNC_EXCEPTION_LEVEL
 #define VFD_ASYNC_EXCEPTION_LEVEL 10
 #endif
+#ifndef VFD_PROFILES
+#define VFD_PROFILES    0 // Load user defined VFD profiles from the file system at startup
+#endif
 #define VFD_N_ADRESSES  4
 
-typedef enum {
-    VFD_Idle = 0,
-    VFD_GetRPM,
-    VFD_SetRPM,
-    VFD_GetMinRPM,
-    VFD_GetMaxRPM,
-    VFD_GetRPMRange,
-    VFD_GetRPMAt50Hz,
-    VFD_GetStatus,
-    VFD_SetStatus,
-    VFD_GetMaxAmps,
-    VFD_GetAmps
-} vfd_response_t;
+// Settings not enumerated by the core, allocated from the unused part of the VFD settings range.
+// $460 was used for VFD type selection by earlier versions and is no longer used by the core.
+#define Setting_VFD_Deadband         ((setting_id_t)460)
+#define Setting_VFD_PollIntervalFast ((setting_id_t)472)
+#define Setting_VFD_PollIntervalSlow ((setting_id_t)473)
+#define Setting_VFD_AdaptiveLoad     ((setting_id_t)474)
+#define Setting_VFD_Options          ((setting_id_t)475)
 
 typedef enum {
     VFD_NotReady = 0, // Must be 0
     VFD_Ready,
 } vfd_state_t;
 
+typedef union {
+    uint8_t value;
+    struct {
+        uint8_t report_stats     :1,
+                at_speed_predict :1,
+                stall_hold       :1,
+                fault_reset      :1,
+                poles_scaling    :1,
+                write_multiple   :1,
+                unassigned       :2;
+    };
+} vfd_options_t;
+
 typedef struct {
 #if N_SPINDLE > 1 || N_SYS_SPINDLE > 1
     uint8_t modbus_address[VFD_N_ADRESSES];
@@ -81,12 +91,170 @@ typedef struct {
     float in_divider;
     float out_multiplier;
     float out_divider;
+    // Settings below are appended to the layout of earlier versions, see vfd_settings_load().
+    uint16_t poll_fast;
+    uint16_t poll_slow;
+    vfd_options_t options;
+    uint8_t adaptive_load;  // target spindle load in % for adaptive feed, 0 if disabled
+    uint16_t deadband;      // RPM, speed changes within this are not written to the VFD
 } vfd_settings_t;
 
+// Latest data read from the VFD, one snapshot per VFD spindle updated by the poll engine.
+typedef struct {
+    uint32_t timestamp;     // hal.get_elapsed_ticks() at last update
+    uint32_t updates;       // number of updates, 0 if no data has been received yet
+    uint16_t exceptions;    // number of consecutive failed poll requests
+    float rpm;
+    float amps;
+    float power;            // output power in kW
+    float voltage;          // DC bus voltage in V
+    float temperature;      // heatsink temperature in °C
+    float energy;           // kWh, accumulated from output power readings
+    uint16_t status;        // raw run status word
+    uint16_t fault;         // raw fault code
+} vfd_telemetry_t;
+
+// Contiguous block of registers fetched by a single read transaction per poll.
+// Offsets are relative to the first register, -1 if the value is not available.
+// Frequency and current values occupy two registers each when the driver uses 32 bit values,
+// other values always occupy a single register.
+// For the Huanyang v1 protocol offsets are status indices, each read by a separate request.
+// The frequency is read on every poll, other values in turn replace it on every VFD_AMPS_POLL_RATIO poll.
+typedef struct {
+    uint8_t function;   // ModBus_ReadHoldingRegisters or ModBus_ReadInputRegisters
+    uint16_t address;   // first register
+    uint8_t n_regs;
+    int8_t freq;
+    int8_t amps;
+    int8_t status;
+    int8_t fault;
+    int8_t power;
+    int8_t voltage;         // DC bus voltage
+    int8_t temp;            // heatsink temperature, signed
+    uint8_t amps_scale;     // output current units per A
+    uint16_t power_scale;   // output power units per kW
+    uint8_t voltage_scale;  // DC bus voltage units per V
+    uint8_t temp_scale;     // temperature units per °C
+} vfd_telemetry_block_t;
+
+/*
+ * Driver descriptors for the generic VFD protocol engine in spindle.c.
+ */
+
+typedef enum {
+    VFD_Protocol_ModBus = 0,    // Standard ModBus RTU
+    VFD_Protocol_Huanyang,      // Huanyang v1, ModBus function codes with non-standard frames
+    VFD_Protocol_HuanyangP2A    // Standard requests, read responses are 8 bytes with a single value in bytes 4 and 5
+} vfd_protocol_t;
+
+typedef enum {
+    VFD_Scaling_Fixed = 0,      // RPM per Hz from the descriptor
+    VFD_Scaling_RPMHz,          // RPM per Hz from setting $461, from motor poles read from the VFD if enabled by $475
+    VFD_Scaling_RPMAt50Hz,      // RPM per Hz from RPM at 50 Hz read from the VFD, descriptor value is used until read
+    VFD_Scaling_MaxRPM          // Frequency written in 0.01% of max RPM read from the VFD, output frequency read in RPM
+} vfd_scaling_source_t;
+
+typedef enum {
+    VFD_Param_None = 0,
+    VFD_Param_MinFreq,          // in frequency register units
+    VFD_Param_MaxFreq,          // in frequency register units
+    VFD_Param_RPMAt50Hz,
+    VFD_Param_MaxRPM,
+    VFD_Param_MaxAmps,          // in 0.1 A
+    VFD_Param_Poles,            // number of motor poles
+    VFD_Param_AccelTime,        // in 0.1 s, from 0 to max frequency
+    VFD_Param_DecelTime         // in 0.1 s, from max frequency to 0
+} vfd_param_t;
+
+typedef struct {
+    uint8_t function;   // ModBus_WriteRegister, ModBus_WriteRegisters or ModBus_WriteCoil
+    uint16_t address;   // not used for ModBus_WriteCoil, the command word is the coil address
+    uint16_t stop;
+    uint16_t cw;
+    uint16_t ccw;
+} vfd_control_t;
+
+// Command that clears a VFD fault.
+typedef struct {
+    uint8_t function;   // ModBus_WriteRegister, 0 if not supported
+    uint16_t address;
+    uint16_t command;
+} vfd_fault_reset_t;
+
+#define VFD_BaudUnsupported 0xFFFF
+#define VFD_N_BAUDRATES     6
+
+// RS485 baud rate parameter written by $VFDBAUD. Codes are the parameter values for the baud rates
+// of the ModBus baud rate setting $374: 2400, 4800, 9600, 19200, 38400 and 115200 baud.
+typedef struct {
+    uint8_t function;   // ModBus_WriteRegister, for Huanyang v1 the write function data code. 0 if not supported
+    uint16_t address;   // register, for Huanyang v1 the PD number
+    uint16_t code[VFD_N_BAUDRATES];
+} vfd_baud_t;
+
+typedef struct {
+    uint8_t function;   // ModBus_WriteRegister or ModBus_WriteRegisters, ModBus_WriteRegisters is required for 32 bit values
+    uint16_t address;
+} vfd_register_t;
+
+typedef struct {
+    vfd_scaling_source_t source;
+    uint16_t units_per_hz;  // frequency register units per Hz
+    uint16_t rpm_per_hz;
+} vfd_scaling_t;
+
+// Parameter(s) read from the VFD on selection and after a reset, one transaction per entry.
+// When there is more than one entry the values are cached in NVS and the first entry is used as
+// fingerprint: if it reads back the cached value the remaining entries are taken from the cache.
+typedef struct {
+    uint8_t function;
+    uint16_t address;
+    uint8_t n_regs;
+    vfd_param_t param[2];   // parameter held by each register
+    uint16_t units_per_hz;  // units of frequency parameters per Hz, 0 if the same as for the frequency register
+    bool optional;          // the VFD may not support the parameter, a failed read is not an error
+} vfd_param_read_t;
+
+typedef struct {
+    const char *name;       // spindle name
+    const char *plugin;     // plugin name and version reported by $I
+    const char *version;
+    uint8_t ref_id;
+    vfd_protocol_t protocol;
+    bool crc_check;
+    uint8_t words;          // registers per frequency and telemetry value, 2 for 32 bit values, 0 or 1 for 16 bit values
+    bool lsw_first;         // word order of 32 bit values, least significant word first if true
+    bool user_defined;      // register map, command words and scaling from the MODVFD settings $462 - $471
+    bool write_multiple;    // Write Multiple Registers (0x10) is supported, run/direction and frequency writes to adjacent registers are combined
+    const modbus_silence_timeout_t *silence;
+    vfd_control_t control;
+    vfd_register_t frequency;
+    vfd_scaling_t scaling;
+    vfd_telemetry_block_t telemetry;
+    vfd_fault_reset_t fault_reset;
+    vfd_baud_t baud;
+    uint8_t n_fatal_faults;
+    const uint16_t *fatal_faults;   // fault codes that are not reset automatically
+    uint8_t n_params;
+    const vfd_param_read_t *params;
+} vfd_driver_t;
+
+/*
+ * Registration of VFDs handling the protocol themselves, deprecated - use a driver descriptor and vfd_register_driver() instead.
+ * Spindles registered by vfd_register() are not handled by the protocol engine, the plugin only provides
+ * ModBus address settings and load reporting for them.
+ */
+
+#if defined(__GNUC__)
+#define VFD_DEPRECATED __attribute__((deprecated("use vfd_register_driver()")))
+#else
+#define VFD_DEPRECATED
+#endif
+
 typedef float (*vfd_get_load_ptr)(void);
 
 typedef struct {
-    vfd_get_load_ptr get_load;
+    vfd_get_load_ptr get_load;  // NULL if the load is not available
 } vfd_ptrs_t;
 
 typedef struct {
@@ -96,10 +264,13 @@ typedef struct {
 
 extern vfd_settings_t vfd_config;
 
-spindle_id_t vfd_register (const vfd_spindle_ptrs_t *vfd, const char *name);
-const vfd_ptrs_t *vfd_get_active (void);
+spindle_id_t vfd_register (const vfd_spindle_ptrs_t *vfd, const char *name) VFD_DEPRECATED;
+const vfd_ptrs_t *vfd_get_active (void) VFD_DEPRECATED;
+spindle_id_t vfd_register_driver (const vfd_driver_t *driver);
 bool vfd_failed (bool disable);
 uint32_t vfd_get_modbus_address (spindle_id_t spindle_id);
 float vfd_atspeed_configure (spindle_ptrs_t *spindle, spindle_data_t *spindle_data);
+vfd_telemetry_t *vfd_get_telemetry (spindle_id_t spindle_id);
+uint32_t vfd_telemetry_age (const vfd_telemetry_t *telemetry);
 
 #endif
@@ -0,0 +1,192 @@
+/*
+
+  vfd/util.c - VFD protocol engine helpers without dependencies on the grblHAL core
+
+  Part of grblHAL
+
+  Copyright (c) 2026 Terje Io
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "spindle/shared.h"
+
+#if VFD_ENABLE
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+
+/*
+ * Fixed point scaling.
+ *
+ * RPM to frequency register unit conversions are resolved to fixed point factors from exact ratios
+ * of the descriptor, settings and parameter values when the VFD is configured. Commands and responses
+ * then only use an integer multiply and shift, RPM values have VFD_RPM_FRAC_BITS fractional bits.
+ * A frequency converted to RPM and back results in the same frequency as long as the VFD has less
+ * than 2^VFD_RPM_FRAC_BITS frequency units per RPM.
+ */
+
+// Sets the factor to num / den with the highest precision that fits in 32 bits.
+void vfd_factor_set (vfd_factor_t *factor, uint64_t num, uint64_t den)
+{
+    uint64_t mul = 0;
+    uint_fast8_t shift = 32;
+
+    if(num && den && num < (1ULL << 32)) {
+        while((mul = ((num << shift) + den / 2) / den) > 0xFFFFFFFFULL && shift)
+            shift--;
+    }
+
+    factor->mul = (uint32_t)(mul > 0xFFFFFFFFULL ? 0xFFFFFFFFULL : mul);
+    factor->shift = (uint8_t)shift;
+}
+
+uint32_t vfd_factor_apply (const vfd_factor_t *factor, uint32_t value)
+{
+    uint64_t result = (uint64_t)value * factor->mul;
+
+    if(factor->shift)
+        result = (result + (1ULL << (factor->shift - 1))) >> factor->shift;
+
+    return (uint32_t)(result > 0xFFFFFFFFULL ? 0xFFFFFFFFULL : result);
+}
+
+// Ramp model, see the description in spindle.c.
+
+// Called with a new RPM reading, low and high are the at speed limits. Target is 0 when the spindle is off.
+void vfd_ramp_update (vfd_ramp_t *ramp, float rpm, float target, float low, float high, uint32_t ms)
+{
+    float delta = rpm - ramp->rpm;
+
+    // Learn from readings where the spindle is ramping towards the target during the whole interval.
+    if(ramp->timestamp && ms > ramp->timestamp && fabsf(delta) >= 1.0f && (rpm < low || rpm > high) &&
+        (target - ramp->rpm) * delta > 0.0f && (target - rpm) * delta > 0.0f) {
+
+        float rate = fabsf(delta) * 1000.0f / (float)(ms - ramp->timestamp), *learned = delta > 0.0f ? &ramp->accel : &ramp->decel;
+
+        *learned = *learned > 0.0f ? *learned + (rate - *learned) * VFD_RAMP_LEARN_RATE : rate;
+    }
+
+    if(target > 0.0f && rpm >= low && rpm <= high)
+        ramp->offset += (rpm - target - ramp->offset) * VFD_RPM_FILTER;
+
+    ramp->rpm = rpm;
+    ramp->timestamp = ms;
+}
+
+// Returns estimated RPM at time ms, the last reading if no reading has been taken or the ramp rate is not known.
+float vfd_ramp_estimate (const vfd_ramp_t *ramp, float target, uint32_t ms)
+{
+    float rpm = ramp->rpm, dt;
+
+    if(target > 0.0f)
+        target += ramp->offset;
+
+    if(ramp->timestamp) {
+
+        dt = (float)(ms - ramp->timestamp) / 1000.0f;
+
+        if(target > rpm && ramp->accel > 0.0f)
+            rpm = fminf(target, rpm + ramp->accel * dt);
+        else if(target < rpm && ramp->decel > 0.0f)
+            rpm = fmaxf(target, rpm - ramp->decel * dt);
+    }
+
+    return rpm;
+}
+
+// Returns true if the frequency differs from the last written by more than the deadband,
+// starting from or changing to 0 is always written.
+bool vfd_freq_changed (uint32_t last, uint32_t freq, uint32_t deadband)
+{
+    return freq == 0 || last == 0 || (freq > last ? freq - last : last - freq) > deadband;
+}
+
+// Gets value of register n from a ModBus read registers response, a 32 bit value is read
+// from registers n and n + 1 when words is 2. Returns false if the response is too short.
+bool vfd_register_value (const uint8_t *adu, uint_fast8_t n, uint_fast8_t words, bool lsw_first, uint32_t *value)
+{
+    bool ok;
+
+    if((ok = adu[2] >= (n + words) * 2)) {
+        *value = (adu[3 + n * 2] << 8) | adu[4 + n * 2];
+        if(words == 2) {
+            uint32_t next = (adu[5 + n * 2] << 8) | adu[6 + n * 2];
+            *value = lsw_first ? (next << 16) | *value : (*value << 16) | next;
+        }
+    }
+
+    return ok;
+}
+
+// Returns value doubled the given number of times, limited to limit.
+uint32_t vfd_backoff (uint32_t value, uint_fast8_t doublings, uint32_t limit)
+{
+    while(doublings-- && value < limit)
+        value = value > limit >> 1 ? limit : value << 1;
+
+    return value > limit ? limit : value;
+}
+
+char *vfd_trim (char *s)
+{
+    char *end;
+
+    while(*s == ' ' || *s == '\t')
+        s++;
+
+    end = s + strlen(s);
+
+    while(end > s && (end[-1] == ' ' || end[-1] == '\t'))
+        end--;
+
+    *end = '\0';
+
+    return s;
+}
+
+// Parses n comma separated integer values, decimal or hexadecimal with 0x prefix.
+// Leading zeros do not denote octal values.
+bool vfd_parse_values (char *s, int32_t *values, uint_fast8_t n)
+{
+    char *end;
+    uint_fast8_t idx = 0;
+
+    while(idx < n) {
+
+        while(*s == ' ' || *s == '\t')
+            s++;
+
+        values[idx++] = (int32_t)strtol(s, &end, s[0] == '0' && (s[1] == 'x' || s[1] == 'X') ? 16 : 10);
+
+        if(end == s)
+            return false;
+
+        s = vfd_trim(end);
+
+        if(idx < n) {
+            if(*s != ',')
+                return false;
+            s++;
+        }
+    }
+
+    return *s == '\0';
+}
+
+#endif // VFD_ENABLE
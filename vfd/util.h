@@ -0,0 +1,71 @@
+/*
+
+  vfd/util.h - VFD protocol engine helpers without dependencies on the grblHAL core
+
+  Part of grblHAL
+
+  Copyright (c) 2026 Terje Io
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+ * Fixed point scaling, ramp model, frequency deadband, response decoding, retry backoff and
+ * profile value parsing. These only depend on the C library so that they can be built and
+ * tested on the host, see test/test_util.c.
+ */
+
+#ifndef _VFD_UTIL_H_
+#define _VFD_UTIL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef VFD_RAMP_LEARN_RATE
+#define VFD_RAMP_LEARN_RATE 0.25f // weight of a new ramp rate reading
+#endif
+
+#ifndef VFD_RPM_FILTER
+#define VFD_RPM_FILTER 0.25f // weight of a new reading for the at speed RPM offset
+#endif
+
+#define VFD_RPM_FRAC_BITS 4 // fractional bits of RPM values in fixed point conversions
+
+// Fixed point scale factor, value * factor is (value * mul) >> shift rounded.
+typedef struct {
+    uint32_t mul;       // 0 if not known
+    uint8_t shift;
+} vfd_factor_t;
+
+// Ramp model, rates are from VFD parameters if available and adjusted by readings taken while ramping.
+typedef struct {
+    float accel;        // RPM/s, 0 if not known
+    float decel;        // RPM/s, 0 if not known
+    float rpm;          // last reading
+    float offset;       // filtered deviation of readings from the programmed RPM when at speed
+    uint32_t timestamp; // time of last reading, 0 if none
+} vfd_ramp_t;
+
+void vfd_factor_set (vfd_factor_t *factor, uint64_t num, uint64_t den);
+uint32_t vfd_factor_apply (const vfd_factor_t *factor, uint32_t value);
+void vfd_ramp_update (vfd_ramp_t *ramp, float rpm, float target, float low, float high, uint32_t ms);
+float vfd_ramp_estimate (const vfd_ramp_t *ramp, float target, uint32_t ms);
+bool vfd_freq_changed (uint32_t last, uint32_t freq, uint32_t deadband);
+bool vfd_register_value (const uint8_t *adu, uint_fast8_t n, uint_fast8_t words, bool lsw_first, uint32_t *value);
+uint32_t vfd_backoff (uint32_t value, uint_fast8_t doublings, uint32_t limit);
+char *vfd_trim (char *s);
+bool vfd_parse_values (char *s, int32_t *values, uint_fast8_t n);
+
+#endif
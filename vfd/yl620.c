@@ -70,242 +70,68 @@
 
 #if SPINDLE_ENABLE & (1<<SPINDLE_YL620A)
 
-#include <math.h>
-#include <string.h>
-
 #include "spindle.h"
 
-static uint32_t modbus_address, rpm_max = 0, exceptions = 0;
-static spindle_id_t spindle_id;
-static spindle_ptrs_t *spindle_hal = NULL;
-static spindle_state_t spindle_state = {0};
-static spindle_data_t spindle_data = {0};
-static vfd_state_t vfd_state;
-
-static on_report_options_ptr on_report_options;
-static on_spindle_selected_ptr on_spindle_selected;
-static settings_changed_ptr settings_changed;
-
-static void rx_packet (modbus_message_t *msg);
-static void rx_exception (uint8_t code, void *context);
-
-static const modbus_callbacks_t callbacks = {
-    .retries = VFD_RETRIES,
-    .retry_delay = VFD_RETRY_DELAY,
-    .on_rx_packet = rx_packet,
-    .on_rx_exception = rx_exception
-};
-
-// TODO: this should be a mechanism to read max RPM from the VFD in order to configure RPM/Hz instead of above define.
-
-static bool spindleConfig (spindle_ptrs_t *spindle)
-{
-    return modbus_isup().rtu;
-}
-
-static void set_rpm (float rpm, bool block)
-{
-    static uint8_t busy = 0;
-
-    if(busy && !block)
-        return;
-
-    uint16_t data = ((uint32_t)(rpm) * 10) / vfd_config.vfd_rpm_hz;
-
-    modbus_message_t rpm_cmd = {
-        .context = (void *)VFD_SetRPM,
-        .crc_check = false,
-        .adu[0] = modbus_address,
-        .adu[1] = ModBus_WriteRegister,
-        .adu[2] = 0x20,
-        .adu[3] = 0x01,
-        .adu[4] = data >> 8,
-        .adu[5] = data & 0xFF,
-        .tx_length = 8,
-        .rx_length = 8
-    };
-
-    busy++;
-    modbus_send(&rpm_cmd, &callbacks, block);
-    spindle_set_at_speed_range(spindle_hal, &spindle_data, rpm);
-    busy--;
-}
-
-static void spindleUpdateRPM (spindle_ptrs_t *spindle, float rpm)
-{
-    UNUSED(spindle);
-
-    set_rpm(rpm, false);
-}
-
-// Start or stop spindle
-static void spindleSetState (spindle_ptrs_t *spindle, spindle_state_t state, float rpm)
-{
-    UNUSED(spindle);
-
-    static bool busy = false;
-
-    if(busy)
-        return;
-
-    uint8_t runstop = !state.on || rpm == 0.0f ? 0x1 : 0x2;
-    uint8_t direction = state.ccw ? 0x20 : 0x10;
-
-    modbus_message_t mode_cmd = {
-        .context = (void *)VFD_SetStatus,
-        .crc_check = false,
-        .adu[0] = modbus_address,
-        .adu[1] = ModBus_WriteRegister,
-        .adu[2] = 0x20,
-        .adu[3] = 0x00,
-        .adu[4] = 0x00,
-        .adu[5] = direction|runstop,
-        .tx_length = 8,
-        .rx_length = 8
-    };
-
-    busy = true;
-
-    if(spindle_state.ccw != state.ccw)
-        spindle_data.rpm_programmed = -1.0f;
-
-    spindle_state.on = spindle_data.state_programmed.on = state.on;
-    spindle_state.ccw = spindle_data.state_programmed.ccw = state.ccw;
-
-    if(modbus_send(&mode_cmd, &callbacks, true))
-        set_rpm(rpm, true);
-
-    busy = false;
-}
-
-static spindle_data_t *spindleGetData (spindle_data_request_t request)
-{
-    return &spindle_data;
-}
-
-// Returns spindle state in a spindle_state_t variable
-static spindle_state_t spindleGetState (spindle_ptrs_t *spindle)
-{
-    UNUSED(spindle);
-
-    if(vfd_state != VFD_Ready)
-        return spindle_state;
-
-    modbus_message_t mode_cmd = {
-        .context = (void *)VFD_GetRPM,
-        .crc_check = false,
-        .adu[0] = modbus_address,
-        .adu[1] = ModBus_ReadHoldingRegisters,
-        .adu[2] = 0x20,
-        .adu[3] = 0x0B,
-        .adu[4] = 0x00,
-        .adu[5] = 0x01,
-        .tx_length = 8,
-        .rx_length = 7
-    };
-
-    modbus_send(&mode_cmd, &callbacks, false); // TODO: add flag for not raising alarm?
-
-    spindle_state.at_speed = spindle->get_data(SpindleData_AtSpeed)->state_programmed.at_speed;
-
-    return spindle_state; // return previous state as we do not want to wait for the response
-}
-
-static void rx_packet (modbus_message_t *msg)
-{
-    if(!(msg->adu[0] & 0x80)) {
-
-        switch((vfd_response_t)msg->context) {
-
-			case VFD_SetStatus:
-                vfd_state = VFD_Ready;
-                break;
-
-            case VFD_GetRPM:
-                exceptions = 0;
-                spindle_validate_at_speed(spindle_data, (float)(((msg->adu[3] << 8) | msg->adu[4]) * vfd_config.vfd_rpm_hz / 10));
-                break;
-
-            default:
-                break;
-        }
-    }
-}
-
-static void rx_exception (uint8_t code, void *context)
-{
-    if((vfd_response_t)context != VFD_GetRPM || ++exceptions == VFD_ASYNC_EXCEPTION_LEVEL) {
-        exceptions = 0;
-        vfd_failed(false);
-    }
-}
-
-static void onReportOptions (bool newopt)
-{
-    on_report_options(newopt);
-
-    if(!newopt)
-        report_plugin("Yalang VFD YL620A", "0.07");
-}
-
-static void onSpindleSelected (spindle_ptrs_t *spindle)
-{
-    if(spindle->id == spindle_id) {
-
-        spindle_data.rpm_programmed = -1.0f;
-        vfd_atspeed_configure((spindle_hal = spindle), &spindle_data);
-
-        modbus_set_silence(NULL);
-        modbus_address = vfd_get_modbus_address(spindle_id);
-
-//        spindleGetMaxRPM();
-
-    } else
-        spindle_hal = NULL;
-
-    if(on_spindle_selected)
-        on_spindle_selected(spindle);
-}
-
-static void settingsChanged (settings_t *settings, settings_changed_flags_t changed)
-{
-    settings_changed(settings, changed);
-
-    if(changed.spindle)
-        spindle_get_hal(spindle_id, SpindleHAL_Configured)->at_speed_tolerance = vfd_atspeed_configure(spindle_hal, &spindle_data);
-}
-
 void vfd_yl620_init (void)
 {
-    static const vfd_spindle_ptrs_t vfd = {
-        .spindle = {
-            .type = SpindleType_VFD,
-            .ref_id = SPINDLE_YL620A,
-            .cap = {
-                .variable = On,
-                .at_speed = On,
-                .direction = On,
-                .cmd_controlled = On
-            },
-            .config = spindleConfig,
-            .set_state = spindleSetState,
-            .get_state = spindleGetState,
-            .update_rpm = spindleUpdateRPM,
-            .get_data = spindleGetData,
-        }
+    // P00.00 main frequency (0.01 Hz), P03.08 frequency given lower limit (0.1 Hz)
+    static const vfd_param_read_t params[] = {
+        { .function = ModBus_ReadHoldingRegisters, .address = 0x0000, .n_regs = 1, .param = { VFD_Param_MaxFreq }, .units_per_hz = 100, .optional = true },
+        { .function = ModBus_ReadHoldingRegisters, .address = 0x0308, .n_regs = 1, .param = { VFD_Param_MinFreq }, .optional = true }
     };
 
-    if((spindle_id = vfd_register(&vfd, "Yalang YS620")) != -1) {
-
-        on_spindle_selected = grbl.on_spindle_selected;
-        grbl.on_spindle_selected = onSpindleSelected;
-
-        settings_changed = hal.settings_changed;
-        hal.settings_changed = settingsChanged;
+    static const vfd_driver_t driver = {
+        .name = "Yalang YS620",
+        .plugin = "Yalang VFD YL620A",
+        .version = "0.11",
+        .ref_id = SPINDLE_YL620A,
+        .protocol = VFD_Protocol_ModBus,
+        .control = {
+            .function = ModBus_WriteRegister,
+            .address = 0x2000,
+            .stop = 0x11,
+            .cw = 0x12,
+            .ccw = 0x22
+        },
+        .frequency = {
+            .function = ModBus_WriteRegister,
+            .address = 0x2001
+        },
+        .scaling = {
+            .source = VFD_Scaling_RPMHz,
+            .units_per_hz = 10
+        },
+        // Output frequency (0.1 Hz) and output current (0.1 A)
+        .telemetry = {
+            .function = ModBus_ReadHoldingRegisters,
+            .address = 0x200B,
+            .n_regs = 2,
+            .freq = 0,
+            .amps = 1,
+            .status = -1,
+            .fault = -1,
+            .power = -1,
+            .voltage = -1,
+            .temp = -1,
+            .amps_scale = 10
+        },
+        // Command register bits 7:6 = b10: reset all error flags
+        .fault_reset = {
+            .function = ModBus_WriteRegister,
+            .address = 0x2000,
+            .command = 0x80
+        },
+        // P03.00 RS485 baud rate
+        .baud = {
+            .function = ModBus_WriteRegister,
+            .address = 0x0300,
+            .code = { 1, 2, 3, 4, 5, VFD_BaudUnsupported }
+        },
+        .n_params = sizeof(params) / sizeof(vfd_param_read_t),
+        .params = params
+    };
 
-        on_report_options = grbl.on_report_options;
-        grbl.on_report_options = onReportOptions;
-    }
+    vfd_register_driver(&driver);
 }
 
 #endif